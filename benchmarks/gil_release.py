@@ -0,0 +1,79 @@
+"""Measure how much a busy reader slows down the other Python threads.
+
+A worker thread spins on pure Python work, first on its own and then while a
+second thread scans for tags back to back. With the GIL released around every
+Reader Library call the worker should keep (almost) all of its throughput.
+
+Runs against the EXPLORE-NFC when present, or the simulated reader when nxppy
+was built with NXPPY_SIMULATOR=1 (a tag is placed in the field and every RF
+transaction is slowed down to roughly real world timings).
+
+usage: python benchmarks/gil_release.py [seconds]
+"""
+from __future__ import print_function
+
+import sys
+import threading
+import time
+
+import nxppy
+from nxppy import _mifare
+
+
+def spin(stop, counter):
+    n = 0
+    while not stop.is_set():
+        n += 1
+    counter.append(n)
+
+
+def scan(stop, counter):
+    reader = nxppy.Mifare()
+    n = 0
+    while not stop.is_set():
+        try:
+            reader.select()
+            reader.read_block(4)
+        except (nxppy.SelectError, nxppy.ReadError):
+            pass
+        n += 1
+    counter.append(n)
+
+
+def run(duration, scanning):
+    stop = threading.Event()
+    spins = []
+    scans = []
+    threads = [threading.Thread(target=spin, args=(stop, spins))]
+    if scanning:
+        threads.append(threading.Thread(target=scan, args=(stop, scans)))
+
+    for t in threads:
+        t.start()
+    time.sleep(duration)
+    stop.set()
+    for t in threads:
+        t.join()
+
+    return spins[0] / duration, (scans[0] / duration if scans else 0)
+
+
+def main():
+    duration = float(sys.argv[1]) if len(sys.argv) > 1 else 3.0
+
+    if _mifare.SIMULATOR:
+        _mifare.sim_remove_tag()
+        _mifare.sim_add_tag(_mifare.SIM_NTAG215)
+        _mifare.sim_set_latency(1000)
+
+    baseline, _ = run(duration, scanning=False)
+    loaded, scan_rate = run(duration, scanning=True)
+
+    print("worker alone:        %12.0f iterations/s" % baseline)
+    print("worker while scan:   %12.0f iterations/s" % loaded)
+    print("scans:               %12.1f select+read/s" % scan_rate)
+    print("worker throughput:   %11.1f%%" % (100.0 * loaded / baseline))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,191 @@
+"""Measure operations/s and latency percentiles of the common tag operations.
+
+Covers select, single page read, bulk read, page write, full tag dump and
+Ntag.read/Ntag.write at several payload sizes. Every operation is run a fixed
+number of times after a few warm up rounds; the results (and the SPI transfers
+each operation took, from Mifare.stats()) are written as JSON so two builds can
+be compared:
+
+    python benchmarks/throughput.py -o before.json
+    python benchmarks/throughput.py -o after.json --compare before.json
+
+--compare exits with status 1 when the median latency of any operation got
+worse by more than --threshold percent.
+
+Runs against the EXPLORE-NFC when present, with an NTAG21x in the field, or
+the simulated reader when nxppy was built with NXPPY_SIMULATOR=1 (an NTAG215
+is placed in the field and every RF transaction is slowed down by --latency
+microseconds). On real tags the user memory that gets written is restored at
+the end, pass --no-write to leave the tag alone altogether.
+
+usage: python benchmarks/throughput.py [-n ITERATIONS] [-o FILE] [--compare FILE]
+"""
+from __future__ import print_function
+
+import argparse
+import json
+import platform
+import sys
+import time
+
+import nxppy
+from nxppy import _mifare
+
+USER_PAGE = 4
+
+# time.perf_counter is py3 only
+clock = getattr(time, 'perf_counter', time.time)
+
+
+def percentile(ordered, pct):
+    """Nearest rank percentile of an already sorted list."""
+    rank = int(round(pct / 100.0 * (len(ordered) - 1)))
+    return ordered[rank]
+
+
+def measure(reader, name, func, iterations, warmup=3):
+    for _ in range(warmup):
+        func()
+
+    spi_before = reader.stats()['spi_transfers']
+    times = []
+    started = clock()
+    for _ in range(iterations):
+        t0 = clock()
+        func()
+        times.append(clock() - t0)
+    elapsed = clock() - started
+    spi = reader.stats()['spi_transfers'] - spi_before
+
+    times.sort()
+    us = [t * 1e6 for t in times]
+    return {
+        'name': name,
+        'iterations': iterations,
+        'ops_per_sec': iterations / elapsed,
+        'mean_us': sum(us) / len(us),
+        'min_us': us[0],
+        'p50_us': percentile(us, 50),
+        'p90_us': percentile(us, 90),
+        'p99_us': percentile(us, 99),
+        'max_us': us[-1],
+        'spi_transfers_per_op': float(spi) / iterations,
+    }
+
+
+def run(args):
+    if _mifare.SIMULATOR:
+        _mifare.sim_remove_tag()
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_NONE)
+        _mifare.sim_add_tag(_mifare.SIM_NTAG215)
+        _mifare.sim_set_latency(args.latency)
+
+    reader = nxppy.Mifare()
+    ntag = nxppy.Ntag(mifare=reader)
+    ntag.select()
+    user_bytes = ntag.size()
+    user_pages = user_bytes // ntag.BLOCK_SIZE
+
+    original = reader.read_range(USER_PAGE, USER_PAGE + user_pages)
+    image = bytearray(nxppy.image_size(256))
+    results = []
+
+    def bench(name, func):
+        result = measure(reader, name, func, args.iterations)
+        results.append(result)
+        if not args.quiet:
+            print("%-22s %10.1f ops/s  p50 %9.0f us  p99 %9.0f us  %6.1f spi/op" %
+                  (name, result['ops_per_sec'], result['p50_us'], result['p99_us'],
+                   result['spi_transfers_per_op']), file=sys.stderr)
+
+    try:
+        bench('select', reader.select)
+        reader.select()
+        bench('read_block', lambda: reader.read_block(USER_PAGE))
+        bench('read_range', lambda: reader.read_range(USER_PAGE, USER_PAGE + user_pages))
+        bench('dump_into', lambda: reader.dump_into(image))
+
+        if not args.no_write:
+            bench('write_block', lambda: reader.write_block(USER_PAGE, b'bnch'))
+
+            for size in args.sizes:
+                if size > user_bytes:
+                    continue
+                payload = u'x' * (size - 1)     # Ntag.write appends the terminator
+                bench('ntag_write_%d' % size, lambda: ntag.write(USER_PAGE, payload))
+                bench('ntag_read_%d' % size, lambda: ntag.read(USER_PAGE))
+        else:
+            # whatever string is on the tag
+            bench('ntag_read', lambda: ntag.read(USER_PAGE))
+    finally:
+        if not args.no_write and not _mifare.SIMULATOR:
+            reader.select()
+            reader.write_range(USER_PAGE, original)
+
+    return {
+        'meta': {
+            'timestamp': time.strftime('%Y-%m-%dT%H:%M:%S'),
+            'python': platform.python_version(),
+            'machine': platform.machine(),
+            'simulator': bool(_mifare.SIMULATOR),
+            'latency_us': args.latency if _mifare.SIMULATOR else None,
+            'iterations': args.iterations,
+            'tag_user_bytes': user_bytes,
+        },
+        'results': results,
+    }
+
+
+def compare(report, baseline, threshold):
+    """Print the change in median latency per operation, returns the regressions."""
+    old = dict((r['name'], r) for r in baseline['results'])
+    regressions = []
+
+    for result in report['results']:
+        before = old.get(result['name'])
+        if before is None or not before['p50_us']:
+            continue
+        change = 100.0 * (result['p50_us'] - before['p50_us']) / before['p50_us']
+        flag = ''
+        if change > threshold:
+            regressions.append(result['name'])
+            flag = '  REGRESSION'
+        print("%-22s p50 %9.0f -> %9.0f us  %+6.1f%%%s" %
+              (result['name'], before['p50_us'], result['p50_us'], change, flag), file=sys.stderr)
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('-n', '--iterations', type=int, default=200)
+    parser.add_argument('-o', '--output', help="write the JSON report here instead of stdout")
+    parser.add_argument('--sizes', type=lambda s: [int(n) for n in s.split(',')], default=[16, 64, 256, 480],
+                        help="Ntag payload sizes in bytes, comma separated")
+    parser.add_argument('--latency', type=int, default=1000,
+                        help="simulator only: microseconds added to every RF transaction")
+    parser.add_argument('--no-write', action='store_true', help="skip the benchmarks that write to the tag")
+    parser.add_argument('--compare', help="JSON report of a previous run to compare against")
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help="median latency increase in percent that counts as a regression")
+    parser.add_argument('-q', '--quiet', action='store_true')
+    args = parser.parse_args()
+
+    report = run(args)
+
+    output = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(output + '\n')
+    else:
+        print(output)
+
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        if compare(report, baseline, args.threshold):
+            sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,2 +1,11 @@
-from nxppy._mifare import Mifare, SelectError, WriteError, ReadError
-from nxppy._ntag import Ntag
+from nxppy._mifare import Mifare, SelectError, WriteError, ReadError
+from nxppy._mifare import OP_SELECT, OP_READ, OP_WRITE, OP_GET_VERSION, KEY_A, KEY_B
+from nxppy._mifare import TECH_A, TECH_B, TECH_F, TECH_V, MODE_NFC, MODE_EMVCO
+from nxppy._mifare import ERR_IO_TIMEOUT, ERR_INTEGRITY, ERR_COLLISION, ERR_PROTOCOL, ERR_AUTH, ERR_NO_TAG
+from nxppy._mifare import ndef_parse, ndef_encode, TNF_EMPTY, TNF_WELL_KNOWN, TNF_MIME, TNF_URI, TNF_EXTERNAL, TNF_UNKNOWN
+from nxppy._ntag import Ntag
+from nxppy._image import TagImage, image_size, iter_images
+
+import sys
+if sys.version_info >= (3, 5):
+    from nxppy._aio import AsyncMifare
@@ -0,0 +1,150 @@
+import asyncio
+import collections
+import os
+
+from nxppy._mifare import Mifare, OP_SELECT, OP_READ, OP_WRITE
+
+
+def _running_loop():
+    try:
+        return asyncio.get_running_loop()
+    except AttributeError:
+        # before 3.7, where the current loop is not deprecated yet
+        return asyncio.get_event_loop()
+    except RuntimeError:
+        raise RuntimeError("AsyncMifare needs loop= when no event loop is running")
+
+
+class AsyncMifare(object):
+    """asyncio front end to a Mifare.
+
+    Operations run on the reader's own worker thread and finish through an
+    eventfd watched by the event loop, so awaiting them costs no executor
+    threads and nothing at all while the reader is idle. Operations run one
+    after the other in the order they were started.
+    """
+
+    def __init__(self, mifare=None, loop=None):
+        """Use the loop running the calling coroutine, pass loop= from anywhere else."""
+        if loop is None:
+            loop = _running_loop()
+        # pass a Mifare to share a reader, or to use one on another SPI device
+        self._mifare = mifare if mifare is not None else Mifare()
+        self._loop = loop
+        self._pending = {}
+        self._backlog = collections.deque()
+        self._fd = self._mifare.async_fd()
+        self._loop.add_reader(self._fd, self._complete)
+
+    @property
+    def mifare(self):
+        return self._mifare
+
+    def close(self):
+        """Stop watching the reader, operations still running are cancelled."""
+        self._loop.remove_reader(self._fd)
+        for future in self._pending.values():
+            future.cancel()
+        for future, _, _ in self._backlog:
+            future.cancel()
+        self._pending.clear()
+        self._backlog.clear()
+
+    def _start(self, future, args, kwargs):
+        """Hand an operation to the worker, False if its queue is full."""
+        try:
+            job = self._mifare.submit(*args, **kwargs)
+        except Exception as e:
+            future.set_exception(e)
+            return True
+        if job is None:
+            return False
+        self._pending[job] = future
+        return True
+
+    def _submit(self, *args, **kwargs):
+        future = self._loop.create_future()
+        # keep the order: nothing jumps the queue while there is a backlog
+        if self._backlog or not self._start(future, args, kwargs):
+            self._backlog.append((future, args, kwargs))
+        return future
+
+    def _complete(self):
+        for job, result in self._mifare.completions():
+            future = self._pending.pop(job, None)
+            if future is None or future.cancelled():
+                continue
+            if isinstance(result, BaseException):
+                future.set_exception(result)
+            else:
+                future.set_result(result)
+
+        # the finished jobs made room in the queue
+        while self._backlog:
+            future, args, kwargs = self._backlog[0]
+            if not future.cancelled() and not self._start(future, args, kwargs):
+                break
+            self._backlog.popleft()
+
+    def select(self, raise_on_absent=True):
+        """Like Mifare.select(), returns a future."""
+        return self._submit(OP_SELECT, raise_on_absent=raise_on_absent)
+
+    def read_range(self, start, end):
+        """Like Mifare.read_range(), returns a future."""
+        return self._submit(OP_READ, start, end)
+
+    def read_block(self, block):
+        """Like Mifare.read_block(), returns a future."""
+        return self._submit(OP_READ, block, block + 1)
+
+    def write_range(self, start, data):
+        """Like Mifare.write_range(), returns a future."""
+        return self._submit(OP_WRITE, start, data=data)
+
+    def write_block(self, block, data):
+        """Like Mifare.write_block(), returns a future."""
+        if len(data) != 4:
+            raise ValueError("Write data MUST be specified as 4 bytes")
+        return self._submit(OP_WRITE, block, data=data)
+
+    def events(self):
+        """Async iterator over the events of a running start_polling() without callback."""
+        return _Events(self._mifare, self._loop)
+
+
+class _Events(object):
+
+    def __init__(self, mifare, loop):
+        self._mifare = mifare
+        self._loop = loop
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        while True:
+            event = self._mifare.get_event(0)
+            if event is not None:
+                return event
+
+            fd = self._mifare.event_fd()
+            if fd is None:
+                raise StopAsyncIteration
+
+            readable = self._loop.create_future()
+            self._loop.add_reader(fd, _resolve, readable)
+            try:
+                await readable
+            finally:
+                self._loop.remove_reader(fd)
+            try:
+                os.read(fd, 8)
+            except OSError:
+                pass    # drained by someone else
+
+
+def _resolve(future):
+    # the fd stays readable until drained, so this may run again before it is
+    if not future.done():
+        future.set_result(None)
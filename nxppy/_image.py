@@ -0,0 +1,80 @@
+import struct
+
+# Layout of the header written by Mifare.dump_into, see src/tag_image.h
+MAGIC = b'NXPI'
+FORMAT = 1
+HEADER_SIZE = 32
+FLAG_VERSION = 0x01
+PAGE_SIZE = 4
+
+_HEADER = struct.Struct('<4sBB10s8s2sBBHH')
+
+
+def image_size(pages, page_size=PAGE_SIZE):
+    """Size in bytes of a tag image holding the given number of pages."""
+    return HEADER_SIZE + pages * page_size
+
+
+class TagImage(object):
+    """Read-only view of a tag image produced by Mifare.dump_into.
+
+    Nothing is copied, the image can live in a bytearray, an mmap or any
+    other object supporting the buffer protocol.
+    """
+
+    def __init__(self, buffer, offset=0):
+        view = memoryview(buffer)
+
+        if len(view) - offset < HEADER_SIZE:
+            raise ValueError("buffer too small for a tag image header")
+
+        (magic, fmt, uid_len, uid, version, atqa, sak, flags,
+         page_size, page_count) = _HEADER.unpack_from(buffer, offset)
+
+        if magic != MAGIC or fmt != FORMAT or uid_len > len(uid):
+            raise ValueError("not a tag image")
+
+        self.size = image_size(page_count, page_size)
+        if len(view) - offset < self.size:
+            raise ValueError("truncated tag image")
+
+        self.buffer = view[offset:offset + self.size]
+        self.uid = uid[:uid_len]
+        self.version = version if flags & FLAG_VERSION else None
+        self.atqa = atqa
+        self.sak = sak
+        self.page_size = page_size
+        self.page_count = page_count
+
+
+    @property
+    def pages(self):
+        """All page data as one memoryview."""
+        return self.buffer[HEADER_SIZE:]
+
+
+    def page(self, index):
+        """Memoryview of a single page."""
+        if not 0 <= index < self.page_count:
+            raise IndexError("page out of range")
+        start = HEADER_SIZE + index * self.page_size
+        return self.buffer[start:start + self.page_size]
+
+
+    def diff(self, other):
+        """List the pages that differ from another image of the same size."""
+        if other.page_count != self.page_count or other.page_size != self.page_size:
+            raise ValueError("images have different layouts")
+
+        return [i for i in range(self.page_count) if self.page(i) != other.page(i)]
+
+
+def iter_images(buffer):
+    """Walk a buffer (e.g. an mmap of a file) of concatenated tag images."""
+    offset = 0
+    end = len(memoryview(buffer))
+
+    while offset < end:
+        image = TagImage(buffer, offset)
+        yield image
+        offset += image.size
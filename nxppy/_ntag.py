@@ -12,10 +12,12 @@ class Ntag(object):
     """Abstraction of the Mifare class to read/write strings to Ntag-21x cards."""
     BLOCK_SIZE = 4
     INIT_BLOCK = 4
+    READ_CHUNK = 15 # pages per FAST_READ
     ENCODING = 'utf-8'
     
-    def __init__(self, end_char="\0"):
-        self._mifare = Mifare()
+    def __init__(self, end_char="\0", mifare=None):
+        # pass a Mifare to share a reader, or to use one on another SPI device
+        self._mifare = mifare if mifare is not None else Mifare()
         self._end = end_char
         self._blocks = 0
         self._bytes = 0
@@ -80,35 +82,60 @@ class Ntag(object):
         
         self._check_block(block)
         
-        read = ""
-        for i in range(block, self._blocks):
-            d = str(self._mifare.read_block(i), self.ENCODING)
-            read += d
-            if len(d) == 0 or self._end in d:
+        end_block = self.INIT_BLOCK + self._blocks
+        end = self._end.encode(self.ENCODING)
+        
+        # start with what a single FAST_READ returns, grow until the terminator shows up
+        read = b""
+        chunk = self.READ_CHUNK
+        while block < end_block:
+            stop = min(block + chunk, end_block)
+            read += self._mifare.read_range(block, stop)
+            if end in read:
                 break
+            block = stop
+            chunk *= 2
         
-        return read.replace("\0", "")
+        return read.split(end)[0].decode(self.ENCODING).replace("\0", "")
     
     
-    def write(self, block, payload):
-        """Write a string, starting from the specified block."""
+    def write(self, block, payload, diff=False):
+        """Write a string, starting from the specified block.
+        
+        With diff=True only the pages whose contents changed are written."""
         
         self._check_block(block)
         
         if payload[-1] != self._end:
             payload += self._end
         
-        #size_blocks = -(-len(payload) // self.BLOCK_SIZE)
+        data = payload.encode(self.ENCODING)
+        size_blocks = -(-len(data) // self.BLOCK_SIZE)
+        end_block = self.INIT_BLOCK + self._blocks
+        
+        if block + size_blocks > end_block:
+            raise OverflowError("Payload too big {} < {}".format(end_block, block + size_blocks))
         
-        for b, i in enumerate(range(0, len(payload), self.BLOCK_SIZE), start=block):
-            if b >= self._blocks:
-                raise OverflowError("Payload too big {} < {}".format(self._blocks, b))
-            
-            data = payload[i:i+self.BLOCK_SIZE]
-            if len(data) < 4:
-                data = bytes("{:\0<4}".format(data), self.ENCODING)
-            
-            self._mifare.write_block(b, data)
+        if diff:
+            self._mifare.write_diff(block, data)
+        else:
+            self._mifare.write_range(block, data)
+    
+    
+    def read_ndef(self):
+        """Read the NDEF message as a list of record dicts, None if there is none."""
+        
+        if not self._blocks:
+            raise ReadError("No tag selected")
+        return self._mifare.read_ndef()
+    
+    
+    def write_ndef(self, records):
+        """Write a list of record dicts, e.g. [{'text': u'hello'}, {'uri': u'https://...'}], as the NDEF message."""
+        
+        if not self._blocks:
+            raise WriteError("No tag selected")
+        return self._mifare.write_ndef(records)
     
     
     def clear(self, start_block, end_block):
@@ -116,8 +143,8 @@ class Ntag(object):
         
         self._check_block(start_block)
         
-        for i in range(start_block, end_block):
-            self._mifare.clear_block(i)
+        if end_block > start_block:
+            self._mifare.write_range(start_block, b"\0" * ((end_block - start_block) * self.BLOCK_SIZE))
     
     
     def clear_all(self):
@@ -9,8 +9,23 @@ import multiprocessing
 from glob import glob
 
 
+# NXPPY_SIMULATOR=1 builds the extension against an in-process PN512 model
+# instead of /dev/spidev, so it can run without an EXPLORE-NFC attached.
+simulator = os.environ.get('NXPPY_SIMULATOR', '') not in ('', '0')
+
+macros = [('LINUX',None),('NATIVE_C_CODE',None),('NXPBUILD_CUSTOMER_HEADER_INCLUDED',None),('NXPBUILD__PHHAL_HW_RC523',None)]
+sources = ['src/Mifare.c', 'src/nxppy.c', 'src/poller.c', 'src/platform.c', 'src/worker.c',
+           'src/ndef.c', 'src/ndef_py.c', 'src/spi_bus.c']
+
+if simulator:
+    macros.append(('NXPPY_SIMULATOR',None))
+    sources += ['src/sim_pn512.c', 'src/sim_bal.c']
+else:
+    # our own BAL in place of the Reader Library's, batches SPI transfers
+    sources += ['src/spi_bal.c']
+
 mifare = Extension('nxppy._mifare',
-                    define_macros = [('LINUX',None),('NATIVE_C_CODE',None),('NXPBUILD_CUSTOMER_HEADER_INCLUDED',None),('NXPBUILD__PHHAL_HW_RC523',None)],
+                    define_macros = macros,
                     extra_compile_args=['-O0',
                                         '-std=gnu99',
                                         '-isystemnxp/nxprdlib/NxpRdLib/intfs',
@@ -25,7 +40,7 @@ mifare = Extension('nxppy._mifare',
                                         '-isystemnxp/linux/comps/phOsal/src/Posix'
                     ],
                     extra_link_args=['nxp/build/linux/libNxpRdLibLinuxPN512.a','-lpthread','-lrt'],
-                    sources = ['src/Mifare.c', 'src/nxppy.c']
+                    sources = sources
 )
 
 class build_nxppy(build):
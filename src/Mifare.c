@@ -1,238 +1,3386 @@
 #include "Mifare.h"
 #include "errors.h"
 #include "nxp_helpers.h"
+#include "tag_image.h"
+#include "poller.h"
+#include "ndef_py.h"
 
 uint8_t CLEAR_DATA[PHAL_MFUL_WRITE_BLOCK_LENGTH];
-uint8_t ident_sak;
+#define BEGIN_READER_CALL(nfc)  Py_BEGIN_ALLOW_THREADS reader_lock(nfc);
+#define END_READER_CALL(nfc)    reader_unlock(nfc); Py_END_ALLOW_THREADS
+
+/*
+ * Put the answer to a READ at page into the page cache. READ always returns
+ * four pages; the ones past the requested count are kept as well, unless the
+ * tag size is unknown and they could have rolled over to page 0.
+ */
+static void cache_read_answer(nfc_data *nfc, uint16_t page, const uint8_t *data, uint16_t requested)
+{
+    uint16_t pages = requested;
+
+    if (nfc->ident_version_valid && page + MFUL_READ_PAGES <= tag_image_pages_from_version(nfc->ident_version)) {
+        pages = MFUL_READ_PAGES;
+    }
+    page_cache_fill(&nfc->cache, page, data, pages);
+    nfc->cache.misses += requested;
+}
+
+/*
+ * Read pages [start, end) into buffer using as few RF round trips as the tag
+ * allows. Called with the reader lock held, without the GIL. *pagesRead tells
+ * how far it got when a transaction fails.
+ *
+ * With the page cache on, cached pages at either end of the range are served
+ * from it and everything in between is read in bulk, cached or not, since one
+ * FAST_READ costs less than two.
+ */
+static phStatus_t read_pages(nfc_data *nfc, uint16_t start, uint16_t end, uint8_t *buffer, uint16_t *pagesRead)
+{
+    phStatus_t status = PH_ERR_SUCCESS;
+    int cached = page_cache_usable(&nfc->cache, nfc->ident_uid, nfc->ident_uid_len);
+    uint16_t page = start;
+    uint16_t stop = end;
+
+    if (cached) {
+        for (; page < end && page_cache_has(&nfc->cache, page); page++) {
+            memcpy(&buffer[(page - start) * MFUL_PAGE_SIZE], &nfc->cache.data[page * MFUL_PAGE_SIZE], MFUL_PAGE_SIZE);
+            nfc->cache.hits++;
+        }
+        for (; stop > page && page_cache_has(&nfc->cache, stop - 1); stop--) {
+        }
+    }
+
+    while (page < stop) {
+        uint16_t count;
+
+        if (nfc->ident_fast_read) {
+            uint8_t *data = NULL;
+            uint16_t dataLen = 0;
+
+            count = stop - page;
+            if (count > MFUL_FAST_READ_MAX_PAGES) {
+                count = MFUL_FAST_READ_MAX_PAGES;
+            }
+
+            status = phalMful_FastRead(&nfc->salMfc, (uint8_t) page, (uint8_t) (page + count - 1), &data, &dataLen);
+            if (status == PH_ERR_SUCCESS && dataLen != count * MFUL_PAGE_SIZE) {
+                status = PH_ADD_COMPCODE(PH_ERR_LENGTH_ERROR, PH_COMP_AL_MFUL);
+            }
+            if (status != PH_ERR_SUCCESS) {
+                break;
+            }
+            // data points into the HAL buffer
+            memcpy(&buffer[(page - start) * MFUL_PAGE_SIZE], data, dataLen);
+            if (cached) {
+                page_cache_fill(&nfc->cache, page, data, count);
+                nfc->cache.misses += count;
+            }
+        } else {
+            uint8_t data[DATA_BUFFER_LEN];
+
+            count = stop - page;
+            if (count > MFUL_READ_PAGES) {
+                count = MFUL_READ_PAGES;
+            }
+
+            status = phalMful_Read(&nfc->salMfc, (uint8_t) page, data);
+            if (status != PH_ERR_SUCCESS) {
+                break;
+            }
+            memcpy(&buffer[(page - start) * MFUL_PAGE_SIZE], data, count * MFUL_PAGE_SIZE);
+            if (cached) {
+                cache_read_answer(nfc, page, data, count);
+            }
+        }
+        page += count;
+    }
+
+    if (status == PH_ERR_SUCCESS) {
+        for (; page < end; page++) {
+            memcpy(&buffer[(page - start) * MFUL_PAGE_SIZE], &nfc->cache.data[page * MFUL_PAGE_SIZE], MFUL_PAGE_SIZE);
+            nfc->cache.hits++;
+        }
+    }
+
+    *pagesRead = page - start;
+    return status;
+}
+
+/*
+ * Write len bytes to consecutive pages starting at start, padding the last
+ * page with zeroes. Same locking rules and progress reporting as read_pages.
+ */
+static phStatus_t write_pages(nfc_data *nfc, uint16_t start, const uint8_t *data, Py_ssize_t len, uint16_t *pagesWritten)
+{
+    phStatus_t status = PH_ERR_SUCCESS;
+    uint16_t pages = (uint16_t) ((len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE);
+    uint16_t i;
+
+    for (i = 0; i < pages; i++) {
+        uint8_t page[PHAL_MFUL_WRITE_BLOCK_LENGTH] = { 0 };
+        Py_ssize_t offset = (Py_ssize_t) i * MFUL_PAGE_SIZE;
+
+        memcpy(page, &data[offset], len - offset < MFUL_PAGE_SIZE ? len - offset : MFUL_PAGE_SIZE);
+
+        page_cache_invalidate(&nfc->cache, start + i);
+        status = phalMful_Write(&nfc->salMfc, (uint8_t) (start + i), page);
+        if (status != PH_ERR_SUCCESS) {
+            break;
+        }
+    }
+
+    *pagesWritten = i;
+    return status;
+}
+
+/*
+ * Like write_pages, but only writes the pages whose contents differ from what
+ * is on the tag. The current contents come from the page cache where it has
+ * them and from one bulk read otherwise. *pagesWritten counts the pages
+ * actually written.
+ */
+static phStatus_t write_changed_pages(nfc_data *nfc, uint16_t start, const uint8_t *data, Py_ssize_t len,
+                                      uint16_t *pagesWritten)
+{
+    uint8_t current[MFUL_MAX_PAGES * MFUL_PAGE_SIZE];
+    uint16_t pages = (uint16_t) ((len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE);
+    uint16_t pagesRead;
+    phStatus_t status;
+    uint16_t i;
+
+    *pagesWritten = 0;
+    status = read_pages(nfc, start, start + pages, current, &pagesRead);
+
+    for (i = 0; status == PH_ERR_SUCCESS && i < pages; i++) {
+        uint8_t page[PHAL_MFUL_WRITE_BLOCK_LENGTH] = { 0 };
+        Py_ssize_t offset = (Py_ssize_t) i * MFUL_PAGE_SIZE;
+
+        memcpy(page, &data[offset], len - offset < MFUL_PAGE_SIZE ? len - offset : MFUL_PAGE_SIZE);
+        if (memcmp(page, &current[offset], MFUL_PAGE_SIZE) == 0) {
+            continue;
+        }
+
+        page_cache_invalidate(&nfc->cache, start + i);
+        status = phalMful_Write(&nfc->salMfc, (uint8_t) (start + i), page);
+        if (status == PH_ERR_SUCCESS) {
+            (*pagesWritten)++;
+        }
+    }
+
+    return status;
+}
+
+/*
+ * Read the capability container and as much of the data area as it takes to
+ * get the whole NDEF TLV, into area (which starts at page 3). Starts with one
+ * READ worth of pages and only reads more once the TLV lengths say they are
+ * needed. Called with the reader lock held.
+ *
+ * *found is NDEF_OK with offset and length set relative to area,
+ * NDEF_NOT_FOUND, NDEF_NEED_MORE if the TLV runs past the data area or
+ * NDEF_MALFORMED if the tag has no capability container.
+ */
+static phStatus_t read_ndef_area(nfc_data *nfc, uint8_t *area, uint16_t *pages, int *found,
+                                 size_t *offset, size_t *length)
+{
+    phStatus_t status;
+    uint16_t limit;
+
+    *found = NDEF_MALFORMED;
+    status = read_pages(nfc, NDEF_CC_PAGE, NDEF_CC_PAGE + MFUL_READ_PAGES, area, pages);
+    if (status != PH_ERR_SUCCESS || area[0] != NDEF_CC_MAGIC) {
+        return status;
+    }
+
+    // the CC page plus the data area, CC byte 2 is its size in units of 8 bytes
+    limit = 1 + (area[2] * 8 + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE;
+    if (NDEF_CC_PAGE + limit > MFUL_MAX_PAGES) {
+        limit = MFUL_MAX_PAGES - NDEF_CC_PAGE;
+    }
+
+    for (;;) {
+        uint16_t more;
+        uint16_t pagesRead = 0;
+
+        *found = Ndef_FindMessage(&area[MFUL_PAGE_SIZE], (*pages - 1) * MFUL_PAGE_SIZE, offset, length);
+        if (*found != NDEF_NEED_MORE && *found != NDEF_END) {
+            break;
+        }
+
+        more = 1 + (*length + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE;
+        if (more > limit) {
+            // ran out between two TLVs, e.g. in the NULL padding of a blank tag
+            if (*found == NDEF_END) {
+                *found = NDEF_NOT_FOUND;
+            }
+            break;
+        }
+        // a READ costs the same for one page as for four
+        if (more < *pages + MFUL_READ_PAGES) {
+            more = *pages + MFUL_READ_PAGES < limit ? *pages + MFUL_READ_PAGES : limit;
+        }
+
+        status = read_pages(nfc, NDEF_CC_PAGE + *pages, NDEF_CC_PAGE + more, &area[*pages * MFUL_PAGE_SIZE],
+                            &pagesRead);
+        *pages += pagesRead;
+        if (status != PH_ERR_SUCCESS) {
+            break;
+        }
+    }
+
+    *offset += MFUL_PAGE_SIZE;
+    return status;
+}
+
+/*
+ * Account for a finished operation in the reader stats, including which kind
+ * of RF error it ran into. Called with the reader lock held.
+ */
+static void record_op(nfc_data *nfc, ReaderOp_t op, uint64_t started, phStatus_t status)
+{
+    reader_stats_record(&nfc->stats, op, started, status != PH_ERR_SUCCESS);
+
+    switch (status & PH_ERR_MASK) {
+    case PH_ERR_IO_TIMEOUT:
+        nfc->stats.rfTimeouts++;
+        break;
+    case PH_ERR_INTEGRITY_ERROR:
+        nfc->stats.crcErrors++;
+        break;
+    case PH_ERR_COLLISION_ERROR:
+        nfc->stats.collisions++;
+        break;
+    }
+}
+
+/*
+ * Attach how far a multi-page operation got to the exception being raised
+ */
+static void set_error_progress(const char *name, uint16_t pages)
+{
+    PyObject *type, *value, *traceback;
+    PyObject *count;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    count = Py_BuildValue("H", pages);
+    if (value != NULL && count != NULL) {
+        PyObject_SetAttrString(value, name, count);
+    }
+    Py_XDECREF(count);
+
+    PyErr_Restore(type, value, traceback);
+}
+
+/*
+ * Take the exception being raised as an object, for results that hand
+ * failures back instead of raising them
+ */
+static PyObject *fetch_error(void)
+{
+    PyObject *type, *value, *traceback;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    Py_XDECREF(type);
+    Py_XDECREF(traceback);
+
+    return value;
+}
+
+/*
+ * Release everything reader_open() set up. Called with the reader lock held,
+ * or from dealloc when nobody else can see the reader any more. Returns -1
+ * with errno set, leaving the reader as it is, if its IRQ thread would not
+ * stop.
+ */
+static int reader_close(nfc_data *nfc)
+{
+    if (!nfc->initialised) {
+        return 0;
+    }
+
+#ifndef NXPPY_SIMULATOR
+    if (Platform_StopIrq(&nfc->platform) != 0) {
+        return -1;
+    }
+#endif
+    phbalReg_ClosePort(&nfc->sBalReader);
+#ifndef NXPPY_SIMULATOR
+    Platform_Close(&nfc->platform);
+#endif
+
+    if (pHal == nfc->pHal) {
+        pHal = NULL;
+    }
+    nfc->pHal = NULL;
+    nfc->ident_uid_len = 0;
+    page_cache_drop(&nfc->cache);
+    nfc->keys.authSector = KEY_CACHE_NO_SECTOR;
+    nfc->iso_dep_active = 0;
+    nfc->initialised = 0;
+    return 0;
+}
+
+/*
+ * Bring up the reader on the given SPI device and GPIOs. Called with the
+ * reader lock held. Returns a Reader Library status, or -1 with errno set if
+ * the GPIOs could not be set up.
+ */
+static int reader_open(nfc_data *nfc, const char *spi, int resetGpio, int irqGpio)
+{
+#ifdef NXPPY_SIMULATOR
+    strcpy(nfc->platform.spiDevice, spi);
+    if (SimBal_Set_Interface_Link(spi) != 0) {
+        errno = ENOSPC;
+        return -1;
+    }
+    nfc->initialised = 1;
+    SimBal_Reset_reader_device(spi);
+#else
+    if (Platform_Open(&nfc->platform, spi, resetGpio, irqGpio) != 0) {
+        return -1;
+    }
+    nfc->initialised = 1;
+    if (Platform_Reset(&nfc->platform) != 0) {
+        return -1;
+    }
+#endif
+
+    return NfcRdLibInit(nfc);
+}
+
+/*
+ * Discovery profiles. The defaults are what the discovery loop always ran
+ * with: Type A only, bailing out on the first Type A tag, one tag per cycle,
+ * in NFC Forum mode with the guard times from the standards.
+ */
+static void profile_defaults(DiscoveryProfile_t *profile)
+{
+    profile->tech = TECH_A;
+    profile->bailOut = TECH_A;
+    profile->deviceLimit = 1;
+    profile->mode = RD_LIB_MODE_NFC;
+    profile->guardAUs = DISCOVERY_GUARD_A_US;
+    profile->guardBUs = DISCOVERY_GUARD_B_US;
+    profile->guardFUs = DISCOVERY_GUARD_F_US;
+    profile->fieldOffUs = 0;
+}
+
+/*
+ * Apply the settings in dict (keyword arguments or a profile= dict) on top
+ * of *profile. Returns -1 with an exception set, leaving *profile as it was,
+ * if any of them is unknown or out of range.
+ */
+static int parse_profile(PyObject *dict, DiscoveryProfile_t *profile)
+{
+    int tech = profile->tech;
+    int bailOut = -1;
+    int deviceLimit = profile->deviceLimit;
+    int mode = profile->mode;
+    int guardAUs = profile->guardAUs;
+    int guardBUs = profile->guardBUs;
+    int guardFUs = profile->guardFUs;
+    int fieldOffUs = profile->fieldOffUs;
+    int supported = TECH_A | TECH_B;
+    PyObject *noArgs;
+    int ok;
+
+    static char* kwlist[] = {"tech", "bail_out", "device_limit", "mode", "guard_a_us", "guard_b_us", "guard_f_us",
+                             "field_off_us", NULL};
+    if (dict == NULL || dict == Py_None) {
+        return 0;
+    }
+    if (!PyDict_Check(dict)) {
+        PyErr_SetString(PyExc_TypeError, "profile must be a dict");
+        return -1;
+    }
+    noArgs = PyTuple_New(0);
+    if (noArgs == NULL) {
+        return -1;
+    }
+    ok = PyArg_ParseTupleAndKeywords(noArgs, dict, "|iiiiiiii:configure_discovery", kwlist, &tech, &bailOut,
+                                     &deviceLimit, &mode, &guardAUs, &guardBUs, &guardFUs, &fieldOffUs);
+    Py_DECREF(noArgs);
+    if (!ok) {
+        return -1;
+    }
+
+#ifdef NXPBUILD__PHPAL_FELICA_SW
+    supported |= TECH_F;
+#endif
+    if (tech & TECH_V) {
+        PyErr_SetString(PyExc_ValueError, "The PN512 cannot poll for ISO15693 (TECH_V) tags");
+        return -1;
+    }
+    if (tech <= 0 || (tech & ~supported)) {
+        PyErr_Format(PyExc_ValueError, "tech must be a combination of TECH_A, TECH_B%s",
+                     (supported & TECH_F) ? " and TECH_F" : " (the Reader Library was built without FeliCa)");
+        return -1;
+    }
+    if (bailOut == -1) {
+        // not given: keep bailing out on what is still polled for
+        bailOut = profile->bailOut & tech;
+    }
+    if (bailOut < 0 || (bailOut & ~tech)) {
+        PyErr_SetString(PyExc_ValueError, "bail_out must be a combination of the technologies polled for");
+        return -1;
+    }
+    if (deviceLimit < 1 || deviceLimit > PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED) {
+        PyErr_Format(PyExc_ValueError, "device_limit must be between 1 and %d", PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED);
+        return -1;
+    }
+    if (mode != RD_LIB_MODE_NFC && mode != RD_LIB_MODE_EMVCO) {
+        PyErr_SetString(PyExc_ValueError, "mode must be MODE_NFC or MODE_EMVCO");
+        return -1;
+    }
+    if (guardAUs < 1 || guardAUs > 0xFFFF || guardBUs < 1 || guardBUs > 0xFFFF || guardFUs < 1 || guardFUs > 0xFFFF) {
+        PyErr_SetString(PyExc_ValueError, "Guard times must be between 1 and 65535 us");
+        return -1;
+    }
+    if (fieldOffUs < 0 || fieldOffUs > 0xFFFF) {
+        PyErr_SetString(PyExc_ValueError, "field_off_us must be between 0 and 65535");
+        return -1;
+    }
+
+    profile->tech = (uint16_t) tech;
+    profile->bailOut = (uint16_t) bailOut;
+    profile->deviceLimit = (uint8_t) deviceLimit;
+    profile->mode = (uint8_t) mode;
+    profile->guardAUs = (uint16_t) guardAUs;
+    profile->guardBUs = (uint16_t) guardBUs;
+    profile->guardFUs = (uint16_t) guardFUs;
+    profile->fieldOffUs = (uint16_t) fieldOffUs;
+    return 0;
+}
+
+static PyObject *profile_dict(const DiscoveryProfile_t *profile)
+{
+    return Py_BuildValue("{s:H, s:H, s:B, s:B, s:H, s:H, s:H, s:H}",
+                         "tech", profile->tech,
+                         "bail_out", profile->bailOut,
+                         "device_limit", profile->deviceLimit,
+                         "mode", profile->mode,
+                         "guard_a_us", profile->guardAUs,
+                         "guard_b_us", profile->guardBUs,
+                         "guard_f_us", profile->guardFUs,
+                         "field_off_us", profile->fieldOffUs);
+}
+
+PyObject *Mifare_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
+{
+    Mifare *self = (Mifare *) type->tp_alloc(type, 0);
+
+    if (self != NULL) {
+        KeyCache_t *keys = &self->data.keys;
+
+        pthread_mutex_init(&self->data.lock, NULL);
+        SpiBus_Init(&self->data.spi);
+        Platform_Init(&self->data.platform);
+
+        // transport configuration, what blank MIFARE Classic tags ship with
+        keys->keys[0].type = PHHAL_HW_MFC_KEYA;
+        keys->keys[1].type = PHHAL_HW_MFC_KEYB;
+        memset(keys->keys[0].key, 0xFF, KEY_CACHE_KEY_SIZE);
+        memset(keys->keys[1].key, 0xFF, KEY_CACHE_KEY_SIZE);
+        keys->keyCount = 2;
+        keys->authSector = KEY_CACHE_NO_SECTOR;
+
+        self->data.iso_dep_max_rate = ISO_DEP_MAX_DATARATE;
+        profile_defaults(&self->data.profile);
+    }
+    return (PyObject *) self;
+}
 
 PyObject *Mifare_init(Mifare * self, PyObject * args, PyObject * kwds)
 {
+    nfc_data *nfc = &self->data;
+    const char *spi = PLATFORM_DEFAULT_SPI;
+    int resetGpio = PLATFORM_DEFAULT_RESET_GPIO;
+    int irqGpio = PLATFORM_DEFAULT_IRQ_GPIO;
+    PyObject *profileDict = NULL;
+    DiscoveryProfile_t profile;
+    unsigned int spiSpeedHz = SPI_BUS_DEFAULT_SPEED_HZ;
+    int spiBuffer = SPI_BUS_DEFAULT_QUEUE;
     int ret;
-    ret = Set_Interface_Link();
-    if (handle_error(ret, InitError)) return NULL;
 
-    Reset_reader_device();
+    static char* kwlist[] = {"spi", "reset_gpio", "irq_gpio", "profile", "spi_speed_hz", "spi_buffer", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|siiOIi", kwlist, &spi, &resetGpio, &irqGpio, &profileDict,
+                                     &spiSpeedHz, &spiBuffer)) {
+       return NULL;
+    }
+    if (spiSpeedHz < 100000 || spiSpeedHz > SPI_BUS_MAX_SPEED_HZ) {
+        return PyErr_Format(PyExc_ValueError, "spi_speed_hz must be between 100000 and %d", SPI_BUS_MAX_SPEED_HZ);
+    }
+    if (spiBuffer < 0 || spiBuffer > SPI_BUS_MAX_QUEUE) {
+        return PyErr_Format(PyExc_ValueError, "spi_buffer must be between 0 and %d bytes", SPI_BUS_MAX_QUEUE);
+    }
+    profile_defaults(&profile);
+    if (parse_profile(profileDict, &profile) < 0) {
+        return NULL;
+    }
+    if (strlen(spi) >= sizeof(nfc->platform.spiDevice)) {
+        return PyErr_Format(PyExc_ValueError, "SPI device name too long");
+    }
+    if (self->pollerReady && (Poller_IsRunning(&self->poller) || self->dispatching)) {
+        return PyErr_Format(PyExc_RuntimeError, "Stop polling before initialising the reader again");
+    }
 
-    ret = NfcRdLibInit();
+    BEGIN_READER_CALL(nfc)
+    ret = reader_close(nfc);
+    if (ret == 0) {
+        nfc->profile = profile;
+        SpiBus_Configure(&nfc->spi, spiSpeedHz, (uint16_t) spiBuffer);
+        ret = reader_open(nfc, spi, resetGpio, irqGpio);
+    }
+    END_READER_CALL(nfc)
+    if (ret == -1) {
+        return PyErr_Format(InitError, "Unable to set up %s (reset GPIO %d, IRQ GPIO %d): %s",
+                            spi, resetGpio, irqGpio, strerror(errno));
+    }
     if (handle_error(ret, InitError)) return NULL;
 
-    //prep clear data
-    int i;
-    for (i=0; i<PHAL_MFUL_WRITE_BLOCK_LENGTH; i++) {
-        CLEAR_DATA[i] = 0;
+    //prep clear data
+    int i;
+    for (i=0; i<PHAL_MFUL_WRITE_BLOCK_LENGTH; i++) {
+        CLEAR_DATA[i] = 0;
+    }
+    
+    Py_RETURN_NONE;
+}
+
+/*
+ * Poller threads must be gone before the interpreter is torn down. Readers
+ * that ever polled are kept on a list (with the GIL held, dealloc takes them
+ * off again) and one atexit hook stops them all, so the hook does not keep
+ * any reader alive.
+ */
+static Mifare *sPollingReaders;
+
+void Mifare_dealloc(Mifare * self)
+{
+    if (self->pollerReady) {
+        Mifare **link = &sPollingReaders;
+
+        while (*link != self) {
+            link = &(*link)->nextPolling;
+        }
+        *link = self->nextPolling;
+        Py_XDECREF(Mifare_stop_polling(self));
+        Poller_Destroy(&self->poller);
+    }
+    if (self->workerReady) {
+        Worker_Destroy(&self->worker);
+    }
+    if (reader_close(&self->data) != 0) {
+        // its IRQ thread still points into the reader, so it cannot be freed
+        PyErr_SetFromErrno(PyExc_OSError);
+        PyErr_WriteUnraisable(NULL);
+        return;
+    }
+    SpiBus_Destroy(&self->data.spi);
+    Platform_Destroy(&self->data.platform);
+    pthread_mutex_destroy(&self->data.lock);
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+PyObject *Mifare_configure_discovery(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    DiscoveryProfile_t profile;
+    phStatus_t status = PH_ERR_SUCCESS;
+
+    if (PyTuple_GET_SIZE(args) != 0) {
+        return PyErr_Format(PyExc_TypeError, "configure_discovery() takes keyword arguments only");
+    }
+
+    BEGIN_READER_CALL(nfc)
+    profile = nfc->profile;
+    END_READER_CALL(nfc)
+    if (parse_profile(kwds, &profile) < 0) {
+        return NULL;
+    }
+
+    // straight into the discovery loop, no reinitialisation; a running poller picks it up on its next cycle
+    BEGIN_READER_CALL(nfc)
+    nfc->profile = profile;
+    if (nfc->initialised) {
+        status = LoadProfile(nfc);
+    }
+    END_READER_CALL(nfc)
+    if (handle_error(status, InitError)) return NULL;
+
+    return profile_dict(&profile);
+}
+
+/* kbit/s of PHPAL_I14443P4A_DATARATE_xxx */
+static const uint16_t sDataRates[] = { 106, 212, 424, 848 };
+
+/*
+ * The fastest bit rates within the cap that the TA(1) byte of the ATS in
+ * nfc->aData offers, as DRI (reader to tag) and DSI (tag to reader). Tags
+ * without TA(1) stay at 106 kbit/s.
+ */
+static void iso_dep_pick_rates(nfc_data *nfc, uint8_t *dri, uint8_t *dsi)
+{
+    const uint8_t *ats = nfc->aData;
+    uint8_t rate;
+
+    *dri = PHPAL_I14443P4A_DATARATE_106;
+    *dsi = PHPAL_I14443P4A_DATARATE_106;
+
+    // TL, T0 with TA(1) present, and TA(1) without the RFU bit
+    if (ats[0] < 3 || !(ats[1] & 0x10) || (ats[2] & 0x08)) {
+        return;
+    }
+    for (rate = nfc->iso_dep_max_rate; rate > PHPAL_I14443P4A_DATARATE_106; rate--) {
+        uint8_t toTag = ats[2] & (0x01 << (rate - 1));
+        uint8_t fromTag = ats[2] & (0x08 << rate);
+
+        if (ats[2] & 0x80) {
+            // the tag needs the same rate both ways
+            if (toTag && fromTag) {
+                *dri = *dsi = rate;
+                return;
+            }
+            continue;
+        }
+        if (toTag && *dri == PHPAL_I14443P4A_DATARATE_106) {
+            *dri = rate;
+        }
+        if (fromTag && *dsi == PHPAL_I14443P4A_DATARATE_106) {
+            *dsi = rate;
+        }
+    }
+}
+
+/*
+ * Hand the parameters of a RATS just done to the ISO14443-4 PAL, which chains
+ * frames by the FSC the tag asked for from then on, after moving to the
+ * fastest bit rates both sides can do with a PPS. Called with the reader lock
+ * held.
+ */
+static phStatus_t iso_dep_start(nfc_data *nfc)
+{
+    uint8_t cidEnabled, cid, nadSupported;
+    uint8_t dri, dsi;
+    phStatus_t status;
+
+    nfc->iso_dep_dri = PHPAL_I14443P4A_DATARATE_106;
+    nfc->iso_dep_dsi = PHPAL_I14443P4A_DATARATE_106;
+    iso_dep_pick_rates(nfc, &dri, &dsi);
+    if (dri != PHPAL_I14443P4A_DATARATE_106 || dsi != PHPAL_I14443P4A_DATARATE_106) {
+        // the PAL switches the HAL over once the tag confirmed, a tag that didn't stays at 106
+        if (phpalI14443p4a_Pps(&nfc->spalI14443p4a, dri, dsi) == PH_ERR_SUCCESS) {
+            nfc->iso_dep_dri = dri;
+            nfc->iso_dep_dsi = dsi;
+        }
+    }
+
+    status = phpalI14443p4a_GetProtocolParams(&nfc->spalI14443p4a, &cidEnabled, &cid, &nadSupported,
+                                              &nfc->iso_dep_fwi, &nfc->iso_dep_fsdi, &nfc->iso_dep_fsci);
+    if (status == PH_ERR_SUCCESS) {
+        status = phpalI14443p4_SetProtocol(&nfc->spalI14443p4, cidEnabled, cid, PH_OFF, 0,
+                                           nfc->iso_dep_fwi, nfc->iso_dep_fsdi, nfc->iso_dep_fsci);
+    }
+    nfc->iso_dep_active = status == PH_ERR_SUCCESS;
+
+    return status;
+}
+
+/*
+ * Run one discovery cycle, leaving the tag (if any) activated in nfc->sDiscLoop.
+ * Called with the reader lock held. *activated is set when a device was
+ * activated and *tagsDetected then holds the technologies found.
+ */
+static phStatus_t discover_tag(nfc_data *nfc, uint8_t *activated, uint16_t *tagsDetected)
+{
+    phStatus_t status = 0;
+
+    *activated = 0;
+    *tagsDetected = 0;
+
+    // with the field off any tag may be swapped for another, or rewritten elsewhere
+    page_cache_drop(&nfc->cache);
+    nfc->keys.authSector = KEY_CACHE_NO_SECTOR;
+    nfc->iso_dep_active = 0;
+
+    /*
+     * Field OFF
+     */
+    status = phhalHw_FieldOff(nfc->pHal);
+    CHECK_STATUS(status);
+    if (status == PH_ERR_SUCCESS && nfc->profile.fieldOffUs) {
+        status = phhalHw_Wait(nfc->pHal, PHHAL_HW_TIME_MICROSECONDS, nfc->profile.fieldOffUs);
+    }
+
+    /*
+     * Configure Discovery loop for Poll Mode
+     */
+    if (status == PH_ERR_SUCCESS) {
+        status = phacDiscLoop_SetConfig(&nfc->sDiscLoop,
+                                        PHAC_DISCLOOP_CONFIG_NEXT_POLL_STATE,
+                                        PHAC_DISCLOOP_POLL_STATE_DETECTION);
+        CHECK_STATUS(status);
+    }
+
+    /*
+     * Run Discovery loop
+     */
+    if (status == PH_ERR_SUCCESS) {
+        nfc->stats.discoveryLoops++;
+        nfc->aData[0] = 0;      // ATS length, only set if the loop took the tag to layer 4
+        status = phacDiscLoop_Run(&nfc->sDiscLoop, PHAC_DISCLOOP_ENTRY_POINT_POLL);
+        *activated = (status & PH_ERR_MASK) == PHAC_DISCLOOP_DEVICE_ACTIVATED;
+    }
+
+    /*
+     * Card detected
+     * Get the tag types detected info
+     */
+    if (*activated) {
+        status = phacDiscLoop_GetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_TECH_DETECTED, tagsDetected);
+    }
+    if (*activated && status == PH_ERR_SUCCESS && nfc->aData[0]) {
+        iso_dep_start(nfc);
+    }
+
+    return status;
+}
+
+/* Remember tag as the active one. Called with the reader lock held. */
+static void set_ident(nfc_data *nfc, const phacDiscLoop_Sw_TypeA_I3P3_t *tag)
+{
+    nfc->ident_uid_len = tag->bUidSize;
+    memcpy(nfc->ident_uid, tag->aUid, tag->bUidSize);
+    memcpy(nfc->ident_atqa, tag->aAtqa, sizeof(nfc->ident_atqa));
+    nfc->ident_sak = tag->aSak;
+    nfc->ident_fast_read = 0;
+    nfc->ident_version_valid = 0;
+    page_cache_bind(&nfc->cache, tag->aUid, tag->bUidSize);
+}
+
+/*
+ * Park the active tag (if any) in HALT and bring the tag with the given UID
+ * straight back with WUPA + SELECT, skipping the field reset and the
+ * anticollision of a full discovery. Called with the reader lock held.
+ */
+static phStatus_t wake_tag(nfc_data *nfc, const uint8_t *uid, uint8_t uidLen, uint8_t *sak)
+{
+    uint8_t uidOut[UID_BUFFER_SIZE];
+    uint8_t uidOutLen;
+    uint8_t moreCards;
+
+    nfc->keys.authSector = KEY_CACHE_NO_SECTOR;
+    if (nfc->iso_dep_active) {
+        // in ISO14443-4 only DESELECT is understood, it halts the tag just the same
+        phpalI14443p4_Deselect(&nfc->spalI14443p4);
+        nfc->iso_dep_active = 0;
+    } else if (nfc->ident_uid_len) {
+        phpalI14443p3a_HaltA(&nfc->spalI14443p3a);
+    }
+    if (nfc->iso_dep_dri != PHPAL_I14443P4A_DATARATE_106 || nfc->iso_dep_dsi != PHPAL_I14443P4A_DATARATE_106) {
+        // a deselected tag is back at 106 kbit/s, the only rate WUPA goes out at
+        phhalHw_SetConfig(nfc->pHal, PHHAL_HW_CONFIG_TXDATARATE_FRAMING,
+                          PHHAL_HW_RF_TYPE_A_FRAMING | PHHAL_HW_RF_DATARATE_106);
+        phhalHw_SetConfig(nfc->pHal, PHHAL_HW_CONFIG_RXDATARATE_FRAMING,
+                          PHHAL_HW_RF_TYPE_A_FRAMING | PHHAL_HW_RF_DATARATE_106);
+        nfc->iso_dep_dri = PHPAL_I14443P4A_DATARATE_106;
+        nfc->iso_dep_dsi = PHPAL_I14443P4A_DATARATE_106;
+    }
+
+    return phpalI14443p3a_ActivateCard(&nfc->spalI14443p3a, (uint8_t *) uid, uidLen, uidOut, &uidOutLen, sak, &moreCards);
+}
+
+/*
+ * Select a tag: the one from last time in a session, otherwise whatever a
+ * full discovery finds. uid must hold UID_BUFFER_SIZE bytes. Called with the
+ * reader lock held.
+ */
+static phStatus_t select_locked(nfc_data *nfc, uint8_t *uid, uint8_t *uidSize, uint8_t *activated)
+{
+    phStatus_t status = 0;
+    uint16_t wTagsDetected = 0;
+    uint64_t started = reader_stats_now();
+    uint8_t sak;
+
+    *activated = 0;
+    *uidSize = 0;
+
+    // in a session the tag from last time is tried first, without a field reset
+    if (nfc->session && nfc->ident_uid_len) {
+        if (wake_tag(nfc, nfc->ident_uid, nfc->ident_uid_len, &sak) == PH_ERR_SUCCESS) {
+            *uidSize = nfc->ident_uid_len;
+            memcpy(uid, nfc->ident_uid, *uidSize);
+            *activated = 1;
+            wTagsDetected = PHAC_DISCLOOP_POS_BIT_MASK_A;
+        } else {
+            nfc->ident_uid_len = 0;
+        }
+    }
+    if (!*activated) {
+        status = discover_tag(nfc, activated, &wTagsDetected);
+    }
+
+    /*
+     * Check for Type A tag detection
+     */
+    if (*activated && status == PH_ERR_SUCCESS && !*uidSize &&
+        PHAC_DISCLOOP_CHECK_ANDMASK(wTagsDetected, PHAC_DISCLOOP_POS_BIT_MASK_A)) {
+        *uidSize = nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].bUidSize;
+        memcpy(uid, nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aUid, *uidSize);
+        set_ident(nfc, &nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0]);
+    }
+    record_op(nfc, READER_OP_SELECT, started, status);
+
+    return status;
+}
+
+/*
+ * What select() returns for the outcome of select_locked. With raiseOnAbsent
+ * unset an empty field returns None without building an exception, the
+ * common case when polling.
+ */
+static PyObject *select_result(phStatus_t status, uint8_t activated, const uint8_t *uid, uint8_t uidSize,
+                               int raiseOnAbsent)
+{
+    if (!activated) {
+        if (!raiseOnAbsent && ((status & PH_ERR_MASK) == PHAC_DISCLOOP_NO_TECH_DETECTED ||
+                               (status & PH_ERR_MASK) == PHAC_DISCLOOP_LPCD_NO_TECH_DETECTED)) {
+            Py_RETURN_NONE;
+        }
+        if (handle_error(status, SelectError)) {
+            return NULL;
+        } else { // handle_error should catch everything, but if it doesn't
+            return PyErr_Format(SelectError, "DiscLoop_Run command failed: %02X", (status & PH_ERR_MASK));
+        }
+    }
+    if (handle_error(status, SelectError)) return NULL;
+
+    if (uidSize > 0) {
+        char asciiBuffer[UID_ASCII_BUFFER_SIZE];
+        uint8_t i;
+
+        for (i = 0; i < uidSize; i++) {
+            sprintf(&asciiBuffer[2 * i], "%02X", uid[i]);
+        }
+        
+        return PyUnicode_FromString(asciiBuffer);
+        
+    } else {
+        return PyErr_Format(SelectError, "DISCLOOP_CHECK_ANDMASK failed: %02X", (status & PH_ERR_MASK));
+    }
+}
+
+/* select() and begin_session() */
+static PyObject *select_tag(Mifare * self, int raiseOnAbsent)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t activated = 0;
+    uint8_t uid[UID_BUFFER_SIZE];
+    uint8_t uidSize = 0;
+
+    BEGIN_READER_CALL(nfc)
+    status = select_locked(nfc, uid, &uidSize, &activated);
+    END_READER_CALL(nfc)
+
+    return select_result(status, activated, uid, uidSize, raiseOnAbsent);
+}
+
+PyObject *Mifare_select(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *raiseOnAbsent = Py_True;
+
+    static char* kwlist[] = {"raise_on_absent", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &raiseOnAbsent)) {
+       return NULL;
+    }
+
+    int raise = PyObject_IsTrue(raiseOnAbsent);
+    if (raise < 0) {
+        return NULL;
+    }
+    return select_tag(self, raise);
+}
+
+/* Parse a UID given as hex, the way select() returns it. Returns 0 on success. */
+static int parse_uid(const char *ascii, uint8_t *uid, uint8_t *uidLen)
+{
+    size_t len = strlen(ascii);
+    size_t i;
+
+    if (len != 8 && len != 14 && len != 20) {
+        return -1;
+    }
+    for (i = 0; i < len / 2; i++) {
+        unsigned int byte;
+
+        if (!isxdigit(ascii[2 * i]) || !isxdigit(ascii[2 * i + 1]) ||
+            sscanf(&ascii[2 * i], "%2x", &byte) != 1) {
+            return -1;
+        }
+        uid[i] = (uint8_t) byte;
+    }
+    *uidLen = (uint8_t) (len / 2);
+
+    return 0;
+}
+
+PyObject *Mifare_select_all(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    phacDiscLoop_Sw_TypeA_I3P3_t tags[PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED];
+    unsigned int limit = PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED;
+    uint16_t wTagsDetected = 0;
+    uint8_t activated = 0;
+    uint8_t count = 0;
+    uint8_t i;
+
+    static char* kwlist[] = {"limit", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", kwlist, &limit)) {
+       return NULL;
+    }
+    if (limit < 1 || limit > PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED) {
+        return PyErr_Format(PyExc_ValueError, "limit must be between 1 and %d", PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED);
+    }
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_TYPEA_DEVICE_LIMIT, limit);
+    if (status == PH_ERR_SUCCESS) {
+        status = discover_tag(nfc, &activated, &wTagsDetected);
+
+        /*
+         * A single tag is activated straight away. With more than one the
+         * discovery loop resolves each UID and halts the tag again.
+         */
+        if ((activated && status == PH_ERR_SUCCESS) ||
+            (status & PH_ERR_MASK) == PHAC_DISCLOOP_MULTI_DEVICES_RESOLVED) {
+            count = nfc->sDiscLoop.sTypeATargetInfo.bTotalTagsFound;
+            if (count > limit) {
+                count = limit;
+            }
+            memcpy(tags, nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3, count * sizeof(tags[0]));
+            status = PH_ERR_SUCCESS;
+        } else if ((status & PH_ERR_MASK) == PHAC_DISCLOOP_NO_TECH_DETECTED) {
+            status = PH_ERR_SUCCESS;
+        }
+
+        if (activated && count == 1) {
+            set_ident(nfc, &tags[0]);
+        } else {
+            nfc->ident_uid_len = 0;
+        }
+
+        phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_TYPEA_DEVICE_LIMIT, nfc->profile.deviceLimit);
+    }
+    record_op(nfc, READER_OP_SELECT, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, SelectError)) return NULL;
+
+    PyObject *result = PyList_New(0);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        char asciiBuffer[UID_ASCII_BUFFER_SIZE];
+        PyObject *tag;
+        uint8_t j;
+
+        for (j = 0; j < tags[i].bUidSize; j++) {
+            sprintf(&asciiBuffer[2 * j], "%02X", tags[i].aUid[j]);
+        }
+        asciiBuffer[2 * j] = '\0';
+
+        tag = Py_BuildValue("{s:N, s:H, s:B}",
+                            "uid",  PyUnicode_FromString(asciiBuffer),
+                            "atqa", tags[i].aAtqa[0] | (tags[i].aAtqa[1] << 8),
+                            "sak",  tags[i].aSak);
+        if (tag == NULL || PyList_Append(result, tag) < 0) {
+            Py_XDECREF(tag);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(tag);
+    }
+
+    return result;
+}
+
+PyObject *Mifare_activate(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    phacDiscLoop_Sw_TypeA_I3P3_t tag;
+    const char *uidArg;
+    uint8_t uid[UID_BUFFER_SIZE];
+    uint8_t uidLen;
+    uint8_t i;
+
+    static char* kwlist[] = {"uid", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s", kwlist, &uidArg)) {
+       return NULL;
+    }
+    if (parse_uid(uidArg, uid, &uidLen) != 0) {
+        return PyErr_Format(PyExc_ValueError, "uid must be 4, 7 or 10 bytes in hex");
+    }
+
+    memset(&tag, 0, sizeof(tag));
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    // only one tag can be active, the current one is parked in HALT
+    status = wake_tag(nfc, uid, uidLen, &tag.aSak);
+    nfc->ident_uid_len = 0;
+    if (status == PH_ERR_SUCCESS) {
+        tag.bUidSize = uidLen;
+        memcpy(tag.aUid, uid, uidLen);
+        // ActivateCard does not report the ATQA, the last discovery run will have it
+        for (i = 0; i < nfc->sDiscLoop.sTypeATargetInfo.bTotalTagsFound && i < PHAC_DISCLOOP_CFG_MAX_CARDS_SUPPORTED; i++) {
+            if (nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[i].bUidSize == uidLen &&
+                memcmp(nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[i].aUid, uid, uidLen) == 0) {
+                memcpy(tag.aAtqa, nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[i].aAtqa, sizeof(tag.aAtqa));
+            }
+        }
+        set_ident(nfc, &tag);
+    }
+    record_op(nfc, READER_OP_SELECT, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, SelectError)) return NULL;
+
+    char asciiBuffer[UID_ASCII_BUFFER_SIZE];
+
+    for (i = 0; i < uidLen; i++) {
+        sprintf(&asciiBuffer[2 * i], "%02X", uid[i]);
+    }
+
+    return PyUnicode_FromString(asciiBuffer);
+}
+
+PyObject *Mifare_is_present(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status;
+    uint8_t uid[UID_BUFFER_SIZE];
+    uint8_t uidLen;
+    uint8_t present = 0;
+    uint8_t attempt;
+    uint8_t sak;
+
+    BEGIN_READER_CALL(nfc)
+    uidLen = nfc->ident_uid_len;
+    memcpy(uid, nfc->ident_uid, uidLen);
+
+    for (attempt = 0; uidLen && !present && attempt < 2; attempt++) {
+        status = wake_tag(nfc, uid, uidLen, &sak);
+        present = status == PH_ERR_SUCCESS;
+
+        // silence means the tag has gone, anything else may just be a bad frame
+        if ((status & PH_ERR_MASK) == PH_ERR_IO_TIMEOUT) {
+            break;
+        }
+    }
+    if (!present) {
+        nfc->ident_uid_len = 0;
+        page_cache_drop(&nfc->cache);
+    }
+    END_READER_CALL(nfc)
+
+    return PyBool_FromLong(present);
+}
+
+PyObject *Mifare_begin_session(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+
+    // select_tag() reads it with the lock held, maybe on another thread
+    BEGIN_READER_CALL(nfc)
+    nfc->session = 1;
+    END_READER_CALL(nfc)
+    return Mifare_select(self, args, kwds);
+}
+
+PyObject *Mifare_end_session(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+
+    BEGIN_READER_CALL(nfc)
+    nfc->session = 0;
+    END_READER_CALL(nfc)
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_read_block(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    uint8_t blockIdx;
+    static char* kwlist[] = {"block", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &blockIdx)) {
+       return NULL;
+    }
+
+    phStatus_t status = 0;
+    uint8_t data[DATA_BUFFER_LEN];
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    if (page_cache_usable(&nfc->cache, nfc->ident_uid, nfc->ident_uid_len) && page_cache_has(&nfc->cache, blockIdx)) {
+        memcpy(data, &nfc->cache.data[blockIdx * MFUL_PAGE_SIZE], MFUL_PAGE_SIZE);
+        nfc->cache.hits++;
+    } else {
+        status = phalMful_Read(&nfc->salMfc, blockIdx, data);
+        if (status == PH_ERR_SUCCESS && page_cache_usable(&nfc->cache, nfc->ident_uid, nfc->ident_uid_len)) {
+            cache_read_answer(nfc, blockIdx, data, 1);
+        }
+    }
+    record_op(nfc, READER_OP_READ, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) return NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("y#", &data[0], MFC_BLOCK_DATA_SIZE);
+#else
+    return Py_BuildValue("s#", &data[0], MFC_BLOCK_DATA_SIZE);
+
+#endif
+}
+
+PyObject *Mifare_read_range(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    unsigned int start;
+    unsigned int end;
+    static char* kwlist[] = {"start", "end", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "II", kwlist, &start, &end)) {
+       return NULL;
+    }
+
+    if (start >= end || end > MFUL_MAX_PAGES) {
+        return PyErr_Format(ReadError, "Invalid page range %u-%u", start, end);
+    }
+
+    phStatus_t status = 0;
+    uint16_t pagesRead = 0;
+    PyObject *result = PyBytes_FromStringAndSize(NULL, (end - start) * MFUL_PAGE_SIZE);
+    if (result == NULL) {
+        return NULL;
+    }
+    // nobody else can see result yet, so it can be filled without the GIL
+    uint8_t *buffer = (uint8_t *) PyBytes_AS_STRING(result);
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = read_pages(nfc, start, end, buffer, &pagesRead);
+    record_op(nfc, READER_OP_READ, started, status);
+    END_READER_CALL(nfc)
+    if (status != PH_ERR_SUCCESS) {
+        Py_DECREF(result);
+        handle_error(status, ReadError);
+        set_error_progress("pages_read", pagesRead);
+        return NULL;
+    }
+
+    return result;
+}
+
+PyObject *Mifare_read_sign(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    const size_t bufferSize = PHAL_MFUL_SIG_LENGTH;
+    uint8_t data[bufferSize];
+    uint8_t *sign = data;
+
+    phStatus_t status = 0;
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = phalMful_ReadSign(&nfc->salMfc, '\0', &sign);
+    // sign points into the HAL buffer, copy it out while we still own the reader
+    if (status == PH_ERR_SUCCESS && sign != data) {
+        memcpy(data, sign, bufferSize);
+    }
+    record_op(nfc, READER_OP_READ_SIGN, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) return NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("y#", data, bufferSize);
+#else
+    return Py_BuildValue("s#", data, bufferSize);
+#endif
+}
+
+PyObject *Mifare_write_block(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t blockIdx;
+    uint8_t *data;
+    int dataLen;
+    
+    static char* kwlist[] = {"block", "data", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "bs#", kwlist,
+                                     &blockIdx, &data, &dataLen)) {
+       return NULL;
+    }
+
+    if (dataLen != PHAL_MFUL_WRITE_BLOCK_LENGTH) {
+        return PyErr_Format(WriteError, "Write data MUST be specified as %d bytes", PHAL_MFUL_WRITE_BLOCK_LENGTH);
+    }
+
+    // data belongs to an argument we hold a reference to, safe without the GIL
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    page_cache_invalidate(&nfc->cache, blockIdx);
+    status = phalMful_Write(&nfc->salMfc, blockIdx, data);
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, WriteError)) return NULL;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_write_range(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    unsigned int start;
+    Py_buffer data;
+    uint16_t pagesWritten = 0;
+
+    static char* kwlist[] = {"start", "data", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Is*", kwlist, &start, &data)) {
+       return NULL;
+    }
+
+    if (data.len == 0 || start + (data.len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE > MFUL_MAX_PAGES) {
+        PyBuffer_Release(&data);
+        return PyErr_Format(WriteError, "Invalid page range for %d bytes at page %u", (int) data.len, start);
+    }
+
+    // the buffer stays exported until released, safe to use without the GIL
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = write_pages(nfc, start, data.buf, data.len, &pagesWritten);
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+    PyBuffer_Release(&data);
+
+    if (status != PH_ERR_SUCCESS) {
+        handle_error(status, WriteError);
+        set_error_progress("pages_written", pagesWritten);
+        return NULL;
+    }
+
+    return Py_BuildValue("H", pagesWritten);
+}
+
+PyObject *Mifare_write_diff(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    unsigned int start;
+    Py_buffer data;
+    uint16_t pagesWritten = 0;
+
+    static char* kwlist[] = {"start", "data", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Is*", kwlist, &start, &data)) {
+       return NULL;
+    }
+
+    if (data.len == 0 || start + (data.len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE > MFUL_MAX_PAGES) {
+        PyBuffer_Release(&data);
+        return PyErr_Format(WriteError, "Invalid page range for %d bytes at page %u", (int) data.len, start);
+    }
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = write_changed_pages(nfc, start, data.buf, data.len, &pagesWritten);
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+    PyBuffer_Release(&data);
+
+    if (status != PH_ERR_SUCCESS) {
+        handle_error(status, WriteError);
+        set_error_progress("pages_written", pagesWritten);
+        return NULL;
+    }
+
+    return Py_BuildValue("H", pagesWritten);
+}
+
+PyObject *Mifare_read_ndef(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint16_t pages = 0;
+    size_t offset = 0;
+    size_t length = 0;
+    int found;
+
+    PyObject *area = PyBytes_FromStringAndSize(NULL, (MFUL_MAX_PAGES - NDEF_CC_PAGE) * MFUL_PAGE_SIZE);
+    if (area == NULL) {
+        return NULL;
+    }
+    // read straight into the object the record payloads end up viewing
+    uint8_t *buffer = (uint8_t *) PyBytes_AS_STRING(area);
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = read_ndef_area(nfc, buffer, &pages, &found, &offset, &length);
+    record_op(nfc, READER_OP_READ, started, status);
+    END_READER_CALL(nfc)
+    if (status != PH_ERR_SUCCESS) {
+        Py_DECREF(area);
+        handle_error(status, ReadError);
+        set_error_progress("pages_read", pages);
+        return NULL;
+    }
+
+    if (found == NDEF_MALFORMED) {
+        Py_DECREF(area);
+        return PyErr_Format(ReadError, "Tag has no NDEF capability container");
+    }
+    if (found == NDEF_NEED_MORE) {
+        Py_DECREF(area);
+        return PyErr_Format(ReadError, "NDEF TLV runs past the end of the data area");
+    }
+    if (found == NDEF_NOT_FOUND) {
+        Py_DECREF(area);
+        Py_RETURN_NONE;
+    }
+
+    if (_PyBytes_Resize(&area, pages * MFUL_PAGE_SIZE) < 0) {
+        return NULL;
+    }
+    PyObject *result = Ndef_ToList(area, (uint8_t *) PyBytes_AS_STRING(area), offset, length, ReadError);
+    Py_DECREF(area);
+    return result;
+}
+
+PyObject *Mifare_write_ndef(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    PyObject *records;
+    uint8_t message[MFUL_MAX_PAGES * MFUL_PAGE_SIZE];
+    uint8_t cc[MFUL_READ_PAGES * MFUL_PAGE_SIZE];
+    uint16_t pagesRead = 0;
+    uint16_t pagesWritten = 0;
+    Py_ssize_t len;
+
+    static char* kwlist[] = {"records", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &records)) {
+       return NULL;
+    }
+
+    len = Ndef_Encode(records, message, (MFUL_MAX_PAGES - NDEF_DATA_PAGE) * MFUL_PAGE_SIZE);
+    if (len < 0) {
+        return NULL;
+    }
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    status = read_pages(nfc, NDEF_CC_PAGE, NDEF_CC_PAGE + 1, cc, &pagesRead);
+    if (status == PH_ERR_SUCCESS && cc[0] == NDEF_CC_MAGIC && len <= cc[2] * 8) {
+        status = write_changed_pages(nfc, NDEF_DATA_PAGE, message, len, &pagesWritten);
+    }
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+
+    if (status != PH_ERR_SUCCESS) {
+        handle_error(status, WriteError);
+        set_error_progress("pages_written", pagesWritten);
+        return NULL;
+    }
+    if (cc[0] != NDEF_CC_MAGIC) {
+        return PyErr_Format(WriteError, "Tag has no NDEF capability container");
+    }
+    if (len > cc[2] * 8) {
+        return PyErr_Format(PyExc_OverflowError, "NDEF message of %d bytes does not fit in %d", (int) len, cc[2] * 8);
+    }
+
+    return Py_BuildValue("H", pagesWritten);
+}
+
+PyObject *Mifare_dump_into(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = PH_ERR_SUCCESS;
+    Py_buffer buffer;
+    unsigned int pages = 0;
+    uint16_t pagesRead = 0;
+    uint8_t versionValid;
+
+    static char* kwlist[] = {"buffer", "pages", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*|I", kwlist, &buffer, &pages)) {
+       return NULL;
+    }
+    if (pages > MFUL_MAX_PAGES) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(ReadError, "A tag has at most %d pages", MFUL_MAX_PAGES);
+    }
+
+    uint8_t *image = buffer.buf;
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    // the size of the tag comes from GET_VERSION unless the caller knows better
+    if (!pages && !nfc->ident_version_valid) {
+        // tags without GET_VERSION drop out of ACTIVE here, the error below asks for pages
+        if (phalMful_GetVersion(&nfc->salMfc, nfc->ident_version) == PH_ERR_SUCCESS) {
+            nfc->ident_fast_read = nfc->ident_version[2] == 0x04 || nfc->ident_version[2] == 0x03;
+            nfc->ident_version_valid = 1;
+        }
+    }
+    if (!pages && nfc->ident_version_valid) {
+        pages = tag_image_pages_from_version(nfc->ident_version);
+    }
+    versionValid = nfc->ident_version_valid;
+
+    if (pages && buffer.len >= TAG_IMAGE_HEADER_SIZE + pages * MFUL_PAGE_SIZE) {
+        tag_image_write_header(image,
+                               nfc->ident_uid, nfc->ident_uid_len,
+                               nfc->ident_version_valid ? nfc->ident_version : NULL,
+                               nfc->ident_atqa, nfc->ident_sak, MFUL_PAGE_SIZE, pages);
+        status = read_pages(nfc, 0, pages, &image[TAG_IMAGE_HEADER_SIZE], &pagesRead);
+    }
+    record_op(nfc, READER_OP_READ, started, status);
+    END_READER_CALL(nfc)
+
+    if (status != PH_ERR_SUCCESS) {
+        PyBuffer_Release(&buffer);
+        handle_error(status, ReadError);
+        set_error_progress("pages_read", pagesRead);
+        return NULL;
+    }
+    if (!pages) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(ReadError, "Unknown tag size (version %s), specify pages", versionValid ? "not recognised" : "unavailable");
+    }
+    if (buffer.len < TAG_IMAGE_HEADER_SIZE + pages * MFUL_PAGE_SIZE) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(PyExc_BufferError, "Buffer too small, a %u page image needs %u bytes",
+                            pages, TAG_IMAGE_HEADER_SIZE + pages * MFUL_PAGE_SIZE);
+    }
+
+    PyBuffer_Release(&buffer);
+    return Py_BuildValue("I", TAG_IMAGE_HEADER_SIZE + pages * MFUL_PAGE_SIZE);
+}
+
+PyObject *Mifare_restore_from(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = PH_ERR_SUCCESS;
+    Py_buffer buffer;
+    int start = -1;
+    int end = -1;
+    PyObject *force = Py_False;
+    uint16_t pagesWritten = 0;
+    uint8_t uidMatches;
+
+    static char* kwlist[] = {"buffer", "start", "end", "force", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s*|iiO", kwlist, &buffer, &start, &end, &force)) {
+       return NULL;
+    }
+
+    const uint8_t *image = buffer.buf;
+
+    if (tag_image_check(image, buffer.len) != 0 ||
+        tag_image_get_u16(image, TAG_IMAGE_OFS_PAGE_SIZE) != MFUL_PAGE_SIZE) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(WriteError, "Not a Type 2 tag image");
+    }
+
+    uint16_t pageCount = tag_image_get_u16(image, TAG_IMAGE_OFS_PAGE_COUNT);
+    if (pageCount > MFUL_MAX_PAGES) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(WriteError, "Image has %u pages, a Type 2 tag has at most %d", pageCount, MFUL_MAX_PAGES);
+    }
+    const uint8_t *pageData = &image[TAG_IMAGE_HEADER_SIZE];
+
+    // by default only the user memory announced by the capability container is restored
+    if (start < 0) {
+        start = 4;
+    }
+    if (end < 0) {
+        end = pageCount;
+        if (pageCount > 3 && pageData[3 * MFUL_PAGE_SIZE] == 0xE1 && 4 + pageData[3 * MFUL_PAGE_SIZE + 2] * 2 < end) {
+            end = 4 + pageData[3 * MFUL_PAGE_SIZE + 2] * 2;
+        }
+    }
+    // page addresses are a single byte, past MFUL_MAX_PAGES they would wrap onto the UID and lock bytes
+    if (start < 2 || start >= end || end > pageCount || end > MFUL_MAX_PAGES) {
+        PyBuffer_Release(&buffer);
+        return PyErr_Format(WriteError, "Invalid page range %d-%d for a %u page image", start, end, pageCount);
+    }
+
+    int forced = PyObject_IsTrue(force);
+    if (forced < 0) {
+        PyBuffer_Release(&buffer);
+        return NULL;
+    }
+
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    uidMatches = nfc->ident_uid_len == image[TAG_IMAGE_OFS_UID_LEN] &&
+        memcmp(nfc->ident_uid, &image[TAG_IMAGE_OFS_UID],
+               image[TAG_IMAGE_OFS_UID_LEN]) == 0;
+    if (uidMatches || forced) {
+        status = write_pages(nfc, start, &pageData[start * MFUL_PAGE_SIZE], (end - start) * MFUL_PAGE_SIZE, &pagesWritten);
+    }
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+    PyBuffer_Release(&buffer);
+
+    if (status != PH_ERR_SUCCESS) {
+        handle_error(status, WriteError);
+        set_error_progress("pages_written", pagesWritten);
+        return NULL;
+    }
+    if (!uidMatches && !forced) {
+        return PyErr_Format(WriteError, "Image was taken from a different tag, use force=True to clone it");
+    }
+
+    return Py_BuildValue("H", pagesWritten);
+}
+
+/*
+ * MIFARE Classic. Blocks are 16 bytes and a sector has to be authenticated
+ * before its blocks can be touched, key_cache.h has how the key is picked.
+ */
+#define CLASSIC_MAX_SECTORS         40      /* MIFARE Classic 4K */
+
+/* One MFAuthent for the sector of block. Called with the reader lock held. */
+static phStatus_t classic_try_key(nfc_data *nfc, uint8_t block, const ClassicKey_t *key)
+{
+    uint64_t started = reader_stats_now();
+    phStatus_t status;
+
+    // Crypto1 is keyed with the last 4 bytes of a 7 byte UID
+    status = phpalMifare_MfcAuthenticate(&nfc->spalMifare, block, key->type, (uint8_t *) key->key,
+                                         &nfc->ident_uid[nfc->ident_uid_len - 4]);
+    nfc->keys.authentications++;
+    record_op(nfc, READER_OP_AUTH, started, status);
+
+    return status;
+}
+
+/*
+ * A Classic command failed and took the tag out of its Crypto1 session back
+ * to idle. Wake it up again so the next command finds it active. Called with
+ * the reader lock held.
+ */
+static void classic_recover(nfc_data *nfc)
+{
+    uint8_t sak;
+
+    wake_tag(nfc, nfc->ident_uid, nfc->ident_uid_len, &sak);
+}
+
+/*
+ * Authenticate the active tag for the sector of block, unless it already is.
+ * The key that opened the sector last time is tried first, then the other
+ * candidates in order. With explicit set, only that key is tried. Called with
+ * the reader lock held.
+ */
+static phStatus_t classic_authenticate(nfc_data *nfc, uint8_t block, const ClassicKey_t *explicit)
+{
+    KeyCache_t *keys = &nfc->keys;
+    uint8_t sector = key_cache_sector(block);
+    const ClassicKey_t *known = NULL;
+    ClassicKey_t failed;
+    phStatus_t status = PH_ADD_COMPCODE(PH_ERR_AUTH_ERROR, PH_COMP_AL_MFC);
+    int tried = 0;
+    int skipFailed = 0;
+    uint8_t sak;
+    uint8_t i;
+
+    if (nfc->ident_uid_len < 4) {
+        // nothing selected
+        return PH_ADD_COMPCODE(PH_ERR_USE_CONDITION, PH_COMP_AL_MFC);
+    }
+    if (explicit == NULL && keys->authSector == sector) {
+        keys->sessionHits++;
+        return PH_ERR_SUCCESS;
+    }
+
+    if (explicit != NULL) {
+        status = classic_try_key(nfc, block, explicit);
+        known = explicit;
+        tried = 1;
+    } else {
+        known = key_cache_find(keys, nfc->ident_uid, nfc->ident_uid_len, sector);
+        if (known != NULL) {
+            status = classic_try_key(nfc, block, known);
+            tried = 1;
+            if (status == PH_ERR_SUCCESS) {
+                keys->hits++;
+            } else {
+                failed = *known;
+                skipFailed = 1;
+                key_cache_forget(keys, nfc->ident_uid, nfc->ident_uid_len, sector);
+            }
+        }
+        if (status != PH_ERR_SUCCESS) {
+            keys->misses++;
+        }
+
+        for (i = 0; status != PH_ERR_SUCCESS && i < keys->keyCount; i++) {
+            // no second MFAuthent with the remembered key that just failed
+            if (skipFailed && key_cache_same_key(&keys->keys[i], &failed)) {
+                continue;
+            }
+            // a failed MFAuthent leaves the tag idle
+            if (tried) {
+                status = wake_tag(nfc, nfc->ident_uid, nfc->ident_uid_len, &sak);
+                if (status != PH_ERR_SUCCESS) {
+                    return status;
+                }
+            }
+            known = &keys->keys[i];
+            status = classic_try_key(nfc, block, known);
+            tried = 1;
+        }
+    }
+
+    if (status != PH_ERR_SUCCESS) {
+        classic_recover(nfc);
+        return status;
+    }
+
+    key_cache_store(keys, nfc->ident_uid, nfc->ident_uid_len, sector, known);
+    keys->authSector = sector;
+    return status;
+}
+/* Read count blocks from block on, all in one sector. Called with the reader lock held. */
+static phStatus_t classic_read_blocks(nfc_data *nfc, uint8_t block, uint8_t count, uint8_t *data)
+{
+    uint64_t started;
+    phStatus_t status;
+    uint8_t i;
+
+    status = classic_authenticate(nfc, block, NULL);
+    if (status != PH_ERR_SUCCESS) {
+        return status;
+    }
+
+    started = reader_stats_now();
+    for (i = 0; i < count && status == PH_ERR_SUCCESS; i++) {
+        status = phalMfc_Read(&nfc->salMfc, block + i, &data[i * PHAL_MFC_DATA_BLOCK_LENGTH]);
+    }
+    record_op(nfc, READER_OP_READ, started, status);
+    if (status != PH_ERR_SUCCESS) {
+        classic_recover(nfc);
+    }
+
+    return status;
+}
+
+/* Called with the reader lock held */
+static phStatus_t classic_write_block(nfc_data *nfc, uint8_t block, const uint8_t *data)
+{
+    uint64_t started;
+    phStatus_t status;
+
+    status = classic_authenticate(nfc, block, NULL);
+    if (status != PH_ERR_SUCCESS) {
+        return status;
+    }
+
+    started = reader_stats_now();
+    status = phalMfc_Write(&nfc->salMfc, block, (uint8_t *) data);
+    record_op(nfc, READER_OP_WRITE, started, status);
+    if (status != PH_ERR_SUCCESS) {
+        classic_recover(nfc);
+    }
+
+    return status;
+}
+
+/* Parse a (KEY_A or KEY_B, 6 byte key) tuple */
+static int parse_classic_key(PyObject *item, ClassicKey_t *key)
+{
+    unsigned char type;
+    const char *bytes;
+    int len;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(item, "By#:key", &type, &bytes, &len)) {
+#else
+    if (!PyArg_ParseTuple(item, "Bs#:key", &type, &bytes, &len)) {
+#endif
+        return -1;
+    }
+    if (type != PHHAL_HW_MFC_KEYA && type != PHHAL_HW_MFC_KEYB) {
+        PyErr_Format(PyExc_ValueError, "Key type must be KEY_A or KEY_B");
+        return -1;
+    }
+    if (len != KEY_CACHE_KEY_SIZE) {
+        PyErr_Format(PyExc_ValueError, "MIFARE Classic keys are %d bytes", KEY_CACHE_KEY_SIZE);
+        return -1;
+    }
+
+    key->type = type;
+    memcpy(key->key, bytes, KEY_CACHE_KEY_SIZE);
+    return 0;
+}
+
+PyObject *Mifare_set_classic_keys(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    ClassicKey_t keys[KEY_CACHE_MAX_KEYS];
+    PyObject *sequence;
+    PyObject *items;
+    Py_ssize_t count, i;
+
+    static char* kwlist[] = {"keys", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &sequence)) {
+       return NULL;
+    }
+
+    items = PySequence_Fast(sequence, "keys must be a sequence of (key_type, key) tuples");
+    if (items == NULL) {
+        return NULL;
+    }
+    count = PySequence_Fast_GET_SIZE(items);
+    if (count == 0 || count > KEY_CACHE_MAX_KEYS) {
+        Py_DECREF(items);
+        return PyErr_Format(PyExc_ValueError, "Between 1 and %d keys", KEY_CACHE_MAX_KEYS);
+    }
+    for (i = 0; i < count; i++) {
+        if (parse_classic_key(PySequence_Fast_GET_ITEM(items, i), &keys[i]) < 0) {
+            Py_DECREF(items);
+            return NULL;
+        }
+    }
+    Py_DECREF(items);
+
+    BEGIN_READER_CALL(nfc)
+    memcpy(nfc->keys.keys, keys, count * sizeof(ClassicKey_t));
+    nfc->keys.keyCount = (uint8_t) count;
+    // keys that worked before may be exactly the ones being retired
+    key_cache_clear(&nfc->keys);
+    END_READER_CALL(nfc)
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_classic_authenticate(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t blockIdx;
+    PyObject *keyObj = Py_None;
+    ClassicKey_t key;
+
+    static char* kwlist[] = {"block", "key", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b|O", kwlist, &blockIdx, &keyObj)) {
+       return NULL;
+    }
+    if (keyObj != Py_None && parse_classic_key(keyObj, &key) < 0) {
+        return NULL;
+    }
+
+    BEGIN_READER_CALL(nfc)
+    status = classic_authenticate(nfc, blockIdx, keyObj != Py_None ? &key : NULL);
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) return NULL;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_classic_read_block(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t blockIdx;
+    uint8_t data[PHAL_MFC_DATA_BLOCK_LENGTH];
+
+    static char* kwlist[] = {"block", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &blockIdx)) {
+       return NULL;
+    }
+
+    BEGIN_READER_CALL(nfc)
+    status = classic_read_blocks(nfc, blockIdx, 1, data);
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) return NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("y#", data, PHAL_MFC_DATA_BLOCK_LENGTH);
+#else
+    return Py_BuildValue("s#", data, PHAL_MFC_DATA_BLOCK_LENGTH);
+#endif
+}
+
+PyObject *Mifare_classic_write_block(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t blockIdx;
+    Py_buffer data;
+    PyObject *trailer = Py_False;
+
+    static char* kwlist[] = {"block", "data", "trailer", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "bs*|O", kwlist, &blockIdx, &data, &trailer)) {
+       return NULL;
+    }
+
+    if (data.len != PHAL_MFC_DATA_BLOCK_LENGTH) {
+        PyBuffer_Release(&data);
+        return PyErr_Format(WriteError, "Write data MUST be specified as %d bytes", PHAL_MFC_DATA_BLOCK_LENGTH);
+    }
+    int allowTrailer = PyObject_IsTrue(trailer);
+    if (allowTrailer < 0) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+    // a bad trailer locks the sector for good
+    if (key_cache_is_trailer(blockIdx) && !allowTrailer) {
+        PyBuffer_Release(&data);
+        return PyErr_Format(WriteError, "Block %d is a sector trailer, pass trailer=True to write it", blockIdx);
+    }
+
+    BEGIN_READER_CALL(nfc)
+    status = classic_write_block(nfc, blockIdx, data.buf);
+    END_READER_CALL(nfc)
+    PyBuffer_Release(&data);
+    if (handle_error(status, WriteError)) return NULL;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_classic_read_sector(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t sector;
+    uint8_t blocks;
+    PyObject *result;
+
+    static char* kwlist[] = {"sector", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &sector)) {
+       return NULL;
+    }
+    if (sector >= CLASSIC_MAX_SECTORS) {
+        return PyErr_Format(ReadError, "Invalid sector %d", sector);
+    }
+
+    blocks = key_cache_sector_blocks(sector);
+    result = PyBytes_FromStringAndSize(NULL, blocks * PHAL_MFC_DATA_BLOCK_LENGTH);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    // nobody else can see result yet, so it can be filled without the GIL
+    BEGIN_READER_CALL(nfc)
+    status = classic_read_blocks(nfc, key_cache_first_block(sector), blocks, (uint8_t *) PyBytes_AS_STRING(result));
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+PyObject *Mifare_classic_key_stats(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    KeyCache_t *keys = &nfc->keys;
+    unsigned long long sessionHits, hits, misses, authentications;
+    uint8_t keyCount;
+
+    BEGIN_READER_CALL(nfc)
+    keyCount = keys->keyCount;
+    sessionHits = keys->sessionHits;
+    hits = keys->hits;
+    misses = keys->misses;
+    authentications = keys->authentications;
+    END_READER_CALL(nfc)
+
+    return Py_BuildValue("{s:B, s:K, s:K, s:K, s:K}",
+                         "keys",            keyCount,
+                         "session_hits",    sessionHits,
+                         "hits",            hits,
+                         "misses",          misses,
+                         "authentications", authentications);
+}
+
+/*
+ * ISO14443-4 (ISO-DEP) APDUs. The PAL chains I-blocks in both directions by
+ * itself and only hands answers back in pieces once they outgrow the HAL
+ * receive buffer; those are collected here into one buffer that grows from
+ * TX_RX_BUFFER_SIZE as needed.
+ */
+#define ISO_DEP_MAX_APDU            0xFFFF          /* PAL transmit length is 16 bits */
+#define ISO_DEP_MAX_ANSWER          (65536 + 2)     /* extended length answer and SW1 SW2 */
+
+static const uint16_t sFsdiSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+static uint16_t iso_dep_frame_size(uint8_t fsi)
+{
+    return sFsdiSizes[fsi < 8 ? fsi : 8];
+}
+
+/* Take the active tag to ISO14443-4 unless it already is. Called with the reader lock held. */
+static phStatus_t iso_dep_activate(nfc_data *nfc)
+{
+    phStatus_t status;
+
+    if (nfc->iso_dep_active) {
+        return PH_ERR_SUCCESS;
+    }
+    if (!nfc->ident_uid_len || !(nfc->ident_sak & 0x20)) {
+        // nothing selected, or a tag without ISO14443-4
+        return PH_ADD_COMPCODE(PH_ERR_USE_CONDITION, PH_COMP_PAL_ISO14443P4);
+    }
+
+    status = phpalI14443p4a_ActivateCard(&nfc->spalI14443p4a, ISO_DEP_FSDI, 0, PHPAL_I14443P4A_DATARATE_106,
+                                         PHPAL_I14443P4A_DATARATE_106, nfc->aData);
+    if (status == PH_ERR_SUCCESS) {
+        status = iso_dep_start(nfc);
+    }
+
+    return status;
+}
+
+/*
+ * Send one APDU and collect the whole answer into *answer, which the caller
+ * frees whether or not this succeeded. Called with the reader lock held.
+ */
+static phStatus_t iso_dep_exchange(nfc_data *nfc, const uint8_t *apdu, uint16_t len, uint8_t **answer,
+                                   size_t *answerLen)
+{
+    uint64_t started = reader_stats_now();
+    uint16_t option = PH_EXCHANGE_DEFAULT;
+    size_t size = 0;
+    uint8_t *rx;
+    uint16_t rxLen;
+    phStatus_t status;
+
+    *answer = NULL;
+    *answerLen = 0;
+
+    status = iso_dep_activate(nfc);
+    while (status == PH_ERR_SUCCESS) {
+        status = phpalI14443p4_Exchange(&nfc->spalI14443p4, option, (uint8_t *) apdu, len, &rx, &rxLen);
+        if (status != PH_ERR_SUCCESS && (status & PH_ERR_MASK) != PH_ERR_SUCCESS_CHAINING) {
+            break;
+        }
+
+        if (*answerLen + rxLen > size) {
+            uint8_t *grown;
+
+            if (*answerLen + rxLen > ISO_DEP_MAX_ANSWER) {
+                status = PH_ADD_COMPCODE(PH_ERR_BUFFER_OVERFLOW, PH_COMP_PAL_ISO14443P4);
+                break;
+            }
+            for (size = size ? size : TX_RX_BUFFER_SIZE; size < *answerLen + rxLen; size *= 2) {
+            }
+            grown = realloc(*answer, size);
+            if (grown == NULL) {
+                status = PH_ADD_COMPCODE(PH_ERR_RESOURCE_ERROR, PH_COMP_PAL_ISO14443P4);
+                break;
+            }
+            *answer = grown;
+        }
+        // rx points into the HAL buffer, which the next piece overwrites
+        memcpy(*answer + *answerLen, rx, rxLen);
+        *answerLen += rxLen;
+
+        if (status == PH_ERR_SUCCESS) {
+            break;
+        }
+        status = PH_ERR_SUCCESS;
+        option = PH_EXCHANGE_RXCHAINING;
+        apdu = NULL;
+        len = 0;
+    }
+    record_op(nfc, READER_OP_APDU, started, status);
+
+    return status;
+}
+
+PyObject *Mifare_transceive_apdu(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    Py_buffer apdu;
+    uint8_t *answer;
+    size_t answerLen;
+    PyObject *result;
+
+    static char* kwlist[] = {"apdu", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s*", kwlist, &apdu)) {
+       return NULL;
+    }
+    if (apdu.len == 0 || apdu.len > ISO_DEP_MAX_APDU) {
+        PyBuffer_Release(&apdu);
+        return PyErr_Format(PyExc_ValueError, "APDU must be 1 to %d bytes", ISO_DEP_MAX_APDU);
+    }
+
+    BEGIN_READER_CALL(nfc)
+    status = iso_dep_exchange(nfc, apdu.buf, (uint16_t) apdu.len, &answer, &answerLen);
+    END_READER_CALL(nfc)
+    PyBuffer_Release(&apdu);
+
+    if (handle_error(status, ReadError)) {
+        free(answer);
+        return NULL;
+    }
+    result = PyBytes_FromStringAndSize((const char *) answer, answerLen);
+    free(answer);
+
+    return result;
+}
+
+PyObject *Mifare_transceive_apdus(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    PyObject *sequence;
+    PyObject *items;
+    PyObject *result = NULL;
+    Py_buffer *apdus;
+    uint8_t **answers;
+    size_t *answerLens;
+    Py_ssize_t count, parsed, done, i;
+
+    static char* kwlist[] = {"apdus", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &sequence)) {
+       return NULL;
+    }
+
+    items = PySequence_Fast(sequence, "apdus must be a sequence of bytes-like objects");
+    if (items == NULL) {
+        return NULL;
+    }
+    count = PySequence_Fast_GET_SIZE(items);
+
+    apdus = PyMem_Malloc((count ? count : 1) * sizeof(Py_buffer));
+    answers = PyMem_Malloc((count ? count : 1) * sizeof(uint8_t *));
+    answerLens = PyMem_Malloc((count ? count : 1) * sizeof(size_t));
+    if (apdus == NULL || answers == NULL || answerLens == NULL) {
+        PyErr_NoMemory();
+        parsed = 0;
+        goto out;
+    }
+
+    for (parsed = 0; parsed < count; parsed++) {
+        Py_buffer *apdu = &apdus[parsed];
+
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(items, parsed), apdu, PyBUF_SIMPLE) < 0) {
+            goto out;
+        }
+        if (apdu->len == 0 || apdu->len > ISO_DEP_MAX_APDU) {
+            PyBuffer_Release(apdu);
+            PyErr_Format(PyExc_ValueError, "APDU %d must be 1 to %d bytes", (int) parsed, ISO_DEP_MAX_APDU);
+            goto out;
+        }
+        answers[parsed] = NULL;
+    }
+
+    // the buffers stay exported until released, safe to use without the GIL
+    BEGIN_READER_CALL(nfc)
+    for (done = 0; done < count; done++) {
+        status = iso_dep_exchange(nfc, apdus[done].buf, (uint16_t) apdus[done].len, &answers[done], &answerLens[done]);
+        if (status != PH_ERR_SUCCESS) {
+            break;
+        }
+    }
+    END_READER_CALL(nfc)
+
+    if (status != PH_ERR_SUCCESS) {
+        handle_error(status, ReadError);
+        set_error_progress("apdus_completed", (uint16_t) done);
+        goto out;
+    }
+
+    result = PyList_New(count);
+    for (i = 0; result != NULL && i < count; i++) {
+        PyObject *answer = PyBytes_FromStringAndSize((const char *) answers[i], answerLens[i]);
+
+        if (answer == NULL) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, answer);
+    }
+
+out:
+    for (i = 0; i < parsed; i++) {
+        PyBuffer_Release(&apdus[i]);
+        free(answers[i]);
+    }
+    PyMem_Free(apdus);
+    PyMem_Free(answers);
+    PyMem_Free(answerLens);
+    Py_DECREF(items);
+
+    return result;
+}
+
+PyObject *Mifare_get_iso_dep(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    uint8_t ats[sizeof(nfc->aData)];
+    uint8_t active, atsLen, fsdi, fsci, fwi, dri, dsi;
+
+    BEGIN_READER_CALL(nfc)
+    active = nfc->iso_dep_active;
+    atsLen = nfc->aData[0] < sizeof(ats) ? nfc->aData[0] : sizeof(ats);
+    memcpy(ats, nfc->aData, atsLen);
+    fsdi = nfc->iso_dep_fsdi;
+    fsci = nfc->iso_dep_fsci;
+    fwi = nfc->iso_dep_fwi;
+    dri = nfc->iso_dep_dri;
+    dsi = nfc->iso_dep_dsi;
+    END_READER_CALL(nfc)
+
+    if (!active) {
+        Py_RETURN_NONE;
+    }
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("{s:y#, s:H, s:H, s:B, s:H, s:H}",
+#else
+    return Py_BuildValue("{s:s#, s:H, s:H, s:B, s:H, s:H}",
+#endif
+                         "ats", ats, (int) atsLen,
+                         "fsd", iso_dep_frame_size(fsdi),
+                         "fsc", iso_dep_frame_size(fsci),
+                         "fwi", fwi,
+                         "tx_bitrate", sDataRates[dri],
+                         "rx_bitrate", sDataRates[dsi]);
+}
+
+PyObject *Mifare_set_max_bitrate(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    unsigned int kbps;
+    uint8_t rate;
+
+    static char* kwlist[] = {"kbps", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "I", kwlist, &kbps)) {
+       return NULL;
+    }
+
+    for (rate = 0; rate <= ISO_DEP_MAX_DATARATE; rate++) {
+        if (sDataRates[rate] == kbps) {
+            break;
+        }
+    }
+    if (rate > ISO_DEP_MAX_DATARATE) {
+        return PyErr_Format(PyExc_ValueError, "Bit rate must be 106, 212, 424 or 848 kbit/s");
+    }
+
+    // takes effect from the next activation, PPS is only allowed right after RATS
+    BEGIN_READER_CALL(nfc)
+    nfc->iso_dep_max_rate = rate;
+    END_READER_CALL(nfc)
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_get_identity(Mifare* self)
+{
+    nfc_data *nfc = &self->data;
+    uint8_t byteBufferSize;
+    uint8_t uid[UID_BUFFER_SIZE];
+    uint8_t atqaBytes[PHAC_DISCLOOP_I3P3A_MAX_ATQA_LENGTH];
+    uint8_t sak;
+    char asciiBuffer[UID_ASCII_BUFFER_SIZE];
+    uint16_t atqa = 0x00;
+    uint8_t i;
+
+    BEGIN_READER_CALL(nfc)
+    byteBufferSize = nfc->ident_uid_len;
+    memcpy(uid, nfc->ident_uid, byteBufferSize);
+    memcpy(atqaBytes, nfc->ident_atqa, sizeof(atqaBytes));
+    sak = nfc->ident_sak;
+    END_READER_CALL(nfc)
+    if (!byteBufferSize) {
+        return PyErr_Format(ReadError, "No tag selected.");
+    }
+
+    for (i = 0; i < byteBufferSize; i++) {
+        sprintf(&asciiBuffer[2 * i], "%02X", uid[i]);
+    }
+    
+    for (i = 0; i < PHAC_DISCLOOP_I3P3A_MAX_ATQA_LENGTH; i++) {
+        atqa = atqa | atqaBytes[i] << i * sizeof(uint8_t);
+    }
+    
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("{s:y#, s:B, s:B}",
+#else
+    return Py_BuildValue("{s:s#, s:B, s:B}",
+#endif
+                         "uid\0",  &asciiBuffer[0], byteBufferSize * 2,
+                         "atqa\0", atqa,
+                         "sak\0",  sak
+                        );
+}
+
+/*
+ * GET_VERSION, remembering the answer for the active tag. version must hold
+ * PHAL_MFC_VERSION_LENGTH bytes. Called with the reader lock held.
+ */
+static phStatus_t get_version_locked(nfc_data *nfc, uint8_t *version)
+{
+    uint64_t started = reader_stats_now();
+    phStatus_t status;
+
+    status = phalMful_GetVersion(&nfc->salMfc, version);
+    if (status == PH_ERR_SUCCESS) {
+        // NTAG21x and Ultralight EV1 both implement FAST_READ
+        nfc->ident_fast_read = version[2] == 0x04 || version[2] == 0x03;
+        memcpy(nfc->ident_version, version, sizeof(nfc->ident_version));
+        nfc->ident_version_valid = 1;
+    }
+    record_op(nfc, READER_OP_GET_VERSION, started, status);
+
+    return status;
+}
+
+static PyObject *version_dict(const uint8_t *version)
+{
+    return Py_BuildValue("{s:B, s:B, s:B, s:B, s:B, s:B, s:B}",
+                         "vendor\0",       version[1],
+                         "tag_type\0",     version[2],
+                         "tag_subtype\0",  version[3],
+                         "version_major\0",version[4],
+                         "version_minor\0",version[5],
+                         "tag_size\0",     version[6],
+                         "protocol\0",     version[7]
+                        );
+}
+
+PyObject *Mifare_get_version(Mifare* self)
+{
+    nfc_data *nfc = &self->data;
+    uint8_t version[PHAL_MFC_VERSION_LENGTH];
+    
+    phStatus_t status = 0;
+    
+    BEGIN_READER_CALL(nfc)
+    status = get_version_locked(nfc, version);
+    END_READER_CALL(nfc)
+    if (handle_error(status, ReadError)) return NULL;
+    
+    return version_dict(version);
+}
+
+PyObject* Mifare_clear_block(Mifare* self, PyObject* args, PyObject* kwds) {
+    nfc_data *nfc = &self->data;
+    phStatus_t status = 0;
+    uint8_t blockIdx;
+    
+    static char* kwlist[] = {"block", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &blockIdx)) {
+        return NULL;
+    }
+    
+    BEGIN_READER_CALL(nfc)
+    uint64_t started = reader_stats_now();
+    page_cache_invalidate(&nfc->cache, blockIdx);
+    status = phalMful_Write(&nfc->salMfc, blockIdx, CLEAR_DATA);
+    record_op(nfc, READER_OP_WRITE, started, status);
+    END_READER_CALL(nfc)
+    if (handle_error(status, WriteError)) return NULL;
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_enable_cache(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    PyObject *enabled = Py_True;
+
+    static char* kwlist[] = {"enabled", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &enabled)) {
+       return NULL;
+    }
+
+    int enable = PyObject_IsTrue(enabled);
+    if (enable < 0) {
+        return NULL;
+    }
+
+    BEGIN_READER_CALL(nfc)
+    nfc->cache.enabled = enable;
+    if (nfc->cache.enabled) {
+        // start with the active tag, its pages fill in as they are read
+        page_cache_bind(&nfc->cache, nfc->ident_uid, nfc->ident_uid_len);
+    } else {
+        page_cache_drop(&nfc->cache);
+    }
+    END_READER_CALL(nfc)
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_cache_stats(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    PageCache_t *cache = &nfc->cache;
+    unsigned long long hits, misses, invalidations;
+    uint16_t pages;
+    uint8_t enabled;
+
+    BEGIN_READER_CALL(nfc)
+    enabled = cache->enabled;
+    pages = page_cache_count(cache);
+    hits = cache->hits;
+    misses = cache->misses;
+    invalidations = cache->invalidations;
+    END_READER_CALL(nfc)
+
+    return Py_BuildValue("{s:O, s:H, s:K, s:K, s:K}",
+                         "enabled",       enabled ? Py_True : Py_False,
+                         "pages",         pages,
+                         "hits",          hits,
+                         "misses",        misses,
+                         "invalidations", invalidations);
+}
+
+static const char *const sOpNames[READER_OP_COUNT] = {
+    "select",
+    "read",
+    "write",
+    "get_version",
+    "read_sign",
+    "auth",
+    "apdu",
+};
+
+static PyObject *op_stats_dict(const ReaderOpStats_t *op)
+{
+    PyObject *histogram = PyList_New(READER_STATS_BUCKETS);
+    int i;
+
+    if (histogram == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < READER_STATS_BUCKETS; i++) {
+        PyList_SET_ITEM(histogram, i, PyLong_FromUnsignedLongLong(op->buckets[i]));
+    }
+
+    return Py_BuildValue("{s:K, s:K, s:K, s:K, s:N}",
+                         "count",     (unsigned long long) op->count,
+                         "errors",    (unsigned long long) op->errors,
+                         "total_ns",  (unsigned long long) op->totalNs,
+                         "max_ns",    (unsigned long long) op->maxNs,
+                         "histogram", histogram);
+}
+
+PyObject *Mifare_stats(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+    ReaderStats_t stats;
+    ReaderOpStats_t irq;
+    SpiBusCounters_t spi;
+    PyObject *result;
+    PyObject *op;
+    int i;
+
+    // a snapshot, so the dict is built without holding up the reader
+    BEGIN_READER_CALL(nfc)
+    memcpy(&stats, &nfc->stats, sizeof(stats));
+    SpiBus_GetCounters(&nfc->spi, &spi);
+    Platform_GetIrqStats(&nfc->platform, &irq);
+    END_READER_CALL(nfc)
+
+    result = Py_BuildValue("{s:K, s:K, s:K, s:K, s:K, s:K, s:K}",
+                           "spi_transfers",   (unsigned long long) spi.transfers,
+                           "spi_messages",    (unsigned long long) spi.messages,
+                           "rf_commands",     (unsigned long long) spi.rfCommands,
+                           "rf_timeouts",     (unsigned long long) stats.rfTimeouts,
+                           "crc_errors",      (unsigned long long) stats.crcErrors,
+                           "collisions",      (unsigned long long) stats.collisions,
+                           "discovery_loops", (unsigned long long) stats.discoveryLoops);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < READER_OP_COUNT; i++) {
+        op = op_stats_dict(&stats.ops[i]);
+
+        if (op == NULL || PyDict_SetItemString(result, sOpNames[i], op) < 0) {
+            Py_XDECREF(op);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(op);
+    }
+
+    // edge to handler on the IRQ thread, for IRQ sources that timestamp their edges
+    op = op_stats_dict(&irq);
+    if (op == NULL || PyDict_SetItemString(result, "irq", op) < 0) {
+        Py_XDECREF(op);
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(op);
+
+    return result;
+}
+
+PyObject *Mifare_reset_stats(Mifare * self)
+{
+    nfc_data *nfc = &self->data;
+
+    BEGIN_READER_CALL(nfc)
+    reader_stats_reset(&nfc->stats);
+    SpiBus_ResetCounters(&nfc->spi);
+    Platform_ResetIrqStats(&nfc->platform);
+    END_READER_CALL(nfc)
+
+    Py_RETURN_NONE;
+}
+
+/***********************************
+** Python Type Definiton
+***********************************/
+/*
+ * Background polling. Each reader has its own poller, events are handed out
+ * by get_event()/iteration or, if a callback was given, by a dispatcher thread
+ * that takes the GIL only while there is something to deliver.
+ */
+typedef struct {
+    Mifare *self;
+    unsigned int generation;
+} Dispatch_t;
+
+/* Poller scan function, runs on the poller thread */
+static int poll_scan(void *ctx, PollerTag_t *tag)
+{
+    Mifare *self = ctx;
+    nfc_data *nfc = &self->data;
+    phStatus_t status;
+    uint16_t tagsDetected;
+    uint8_t activated;
+    int found = 0;
+
+    reader_lock(nfc);
+    status = discover_tag(nfc, &activated, &tagsDetected);
+    if (activated && status == PH_ERR_SUCCESS &&
+        PHAC_DISCLOOP_CHECK_ANDMASK(tagsDetected, PHAC_DISCLOOP_POS_BIT_MASK_A)) {
+        tag->uidLen = nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].bUidSize;
+        if (tag->uidLen > POLLER_MAX_UID_LENGTH) {
+            tag->uidLen = POLLER_MAX_UID_LENGTH;
+        }
+        memcpy(tag->uid, nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aUid, tag->uidLen);
+        memcpy(tag->atqa, nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aAtqa, sizeof(tag->atqa));
+        tag->sak = nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aSak;
+        found = 1;
+    } else if (activated || (status & PH_ERR_MASK) != PHAC_DISCLOOP_NO_TECH_DETECTED) {
+        found = -1;
+    }
+    // the discovery loop changed the active tag under select(), keep what we know about it in step
+    if (found == 1) {
+        set_ident(nfc, &nfc->sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0]);
+    } else {
+        nfc->ident_uid_len = 0;
+    }
+    if (self->pollLpcd) {
+        // the probes decide when to look again, no point keeping the tag powered
+        phhalHw_FieldOff(nfc->pHal);
+    }
+    reader_unlock(nfc);
+
+    return found;
+}
+
+/*
+ * LPCD probe. The PN512 has no hardware low-power card detection, so this is
+ * the cheapest software equivalent: raise the field just long enough for a
+ * tag to power up, send one WUPA and drop the field again. Any answer at all,
+ * garbled or colliding ones included, counts as something in the field.
+ */
+static int lpcd_probe(void *ctx)
+{
+    nfc_data *nfc = &((Mifare *) ctx)->data;
+    phStatus_t status;
+    uint8_t atqa[PHAC_DISCLOOP_I3P3A_MAX_ATQA_LENGTH];
+
+    reader_lock(nfc);
+    page_cache_drop(&nfc->cache);
+    nfc->keys.authSector = KEY_CACHE_NO_SECTOR;
+    nfc->iso_dep_active = 0;
+    status = phhalHw_ApplyProtocolSettings(nfc->pHal, PHHAL_HW_CARDTYPE_ISO14443A);
+    if (status == PH_ERR_SUCCESS) {
+        status = phhalHw_FieldOn(nfc->pHal);
+    }
+    if (status == PH_ERR_SUCCESS) {
+        status = phhalHw_Wait(nfc->pHal, PHHAL_HW_TIME_MICROSECONDS, nfc->profile.guardAUs);
+    }
+    if (status == PH_ERR_SUCCESS) {
+        status = phpalI14443p3a_WakeUpA(&nfc->spalI14443p3a, atqa);
+    }
+    phhalHw_FieldOff(nfc->pHal);
+    reader_unlock(nfc);
+
+    return (status & PH_ERR_MASK) != PH_ERR_IO_TIMEOUT;
+}
+
+static const char *sEventNames[] = {
+    [POLLER_EVENT_ARRIVAL] = "arrival",
+    [POLLER_EVENT_DEPARTURE] = "departure",
+    [POLLER_EVENT_REPRESENT] = "represent",
+};
+
+static PyObject *build_event(const PollerEvent_t *event)
+{
+    char asciiBuffer[UID_ASCII_BUFFER_SIZE];
+    uint8_t i;
+
+    for (i = 0; i < event->tag.uidLen; i++) {
+        sprintf(&asciiBuffer[2 * i], "%02X", event->tag.uid[i]);
+    }
+    asciiBuffer[2 * i] = '\0';
+
+    return Py_BuildValue("{s:s, s:N, s:H, s:B, s:K}",
+                         "event",        sEventNames[event->type],
+                         "uid",          PyUnicode_FromString(asciiBuffer),
+                         "atqa",         event->tag.atqa[0] | (event->tag.atqa[1] << 8),
+                         "sak",          event->tag.sak,
+                         "timestamp_ns", (unsigned long long) event->timestampNs);
+}
+
+static void *dispatch_thread(void *arg)
+{
+    Dispatch_t dispatch = *(Dispatch_t *) arg;
+    Mifare *self = dispatch.self;
+    unsigned int generation = dispatch.generation;
+    PollerEvent_t event;
+    PyGILState_STATE gil;
+
+    free(arg);
+
+    // Poller_Wait only fails once the poller has stopped and the queue is empty
+    while (generation == self->dispatchGeneration && (Poller_Wait(&self->poller, -1) || Poller_IsRunning(&self->poller))) {
+        PyObject *callback;
+
+        gil = PyGILState_Ensure();
+        callback = self->pollCallback;
+
+        Py_XINCREF(callback);
+        while (callback != NULL && generation == self->dispatchGeneration && Poller_Pop(&self->poller, &event)) {
+            PyObject *result = NULL;
+            PyObject *dict = build_event(&event);
+
+            if (dict != NULL) {
+                result = PyObject_CallFunctionObjArgs(callback, dict, NULL);
+                Py_DECREF(dict);
+            }
+            if (result == NULL) {
+                PyErr_WriteUnraisable(callback);
+            }
+            Py_XDECREF(result);
+        }
+        Py_XDECREF(callback);
+
+        PyGILState_Release(gil);
+    }
+
+    // start_polling took a reference so self outlives a detached dispatcher
+    gil = PyGILState_Ensure();
+    Py_DECREF(self);
+    PyGILState_Release(gil);
+
+    return NULL;
+}
+
+/*
+ * Next event, waiting up to timeout seconds (forever if negative). Returns
+ * NULL without an exception on timeout or once polling has stopped and every
+ * event has been consumed.
+ */
+static PyObject *next_event(Mifare * self, double timeout)
+{
+    uint64_t deadline = timeout < 0 ? 0 : Poller_Now() + (uint64_t) (timeout * 1e9);
+    PollerEvent_t event;
+
+    if (!self->pollerReady) {
+        return NULL;
+    }
+
+    for (;;) {
+        int waitMs = 100;   // wake up regularly to look for KeyboardInterrupt
+
+        if (Poller_Pop(&self->poller, &event)) {
+            return build_event(&event);
+        }
+        if (!Poller_IsRunning(&self->poller)) {
+            return NULL;
+        }
+        if (deadline) {
+            uint64_t now = Poller_Now();
+
+            if (now >= deadline) {
+                return NULL;
+            }
+            if ((deadline - now) / 1000000 < (uint64_t) waitMs) {
+                waitMs = (int) ((deadline - now + 999999) / 1000000);
+            }
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        Poller_Wait(&self->poller, waitMs);
+        Py_END_ALLOW_THREADS
+
+        if (PyErr_CheckSignals()) {
+            return NULL;
+        }
+    }
+}
+
+/*
+ * One atexit hook for every reader, see sPollingReaders. The list only holds
+ * borrowed pointers and a reader left to its dispatcher goes away as soon as
+ * the dispatcher stops, so each one is held while it is stopped. Stopping a
+ * reader can free others (through its callback), so the walk starts over
+ * after each one.
+ */
+PyObject *Mifare_stop_all_polling(PyObject * module, PyObject * unused)
+{
+    for (;;) {
+        Mifare *reader = sPollingReaders;
+        PyObject *result;
+
+        while (reader != NULL && !reader->dispatching && !Poller_IsRunning(&reader->poller)) {
+            reader = reader->nextPolling;
+        }
+        if (reader == NULL) {
+            break;
+        }
+
+        Py_INCREF(reader);
+        result = Mifare_stop_polling(reader);
+        Py_DECREF(reader);
+        if (result == NULL) {
+            return NULL;
+        }
+        Py_DECREF(result);
+    }
+    Py_RETURN_NONE;
+}
+
+static int register_stop_at_exit(void)
+{
+    static int registered;
+    PyObject *module;
+    PyObject *atexit;
+    PyObject *result;
+
+    if (registered) {
+        return 0;
+    }
+    module = PyImport_ImportModule("nxppy._mifare");
+    if (module == NULL) {
+        return -1;
+    }
+    atexit = PyImport_ImportModule("atexit");
+    if (atexit == NULL) {
+        Py_DECREF(module);
+        return -1;
+    }
+    result = PyObject_CallMethod(atexit, "register", "N", PyObject_GetAttrString(module, "_stop_all_polling"));
+    Py_DECREF(atexit);
+    Py_DECREF(module);
+    if (result == NULL) {
+        return -1;
+    }
+    Py_DECREF(result);
+    registered = 1;
+    return 0;
+}
+
+PyObject *Mifare_start_polling(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    unsigned int intervalUs = 100000;
+    PyObject *callback = Py_None;
+    PyObject *lpcd = Py_False;
+    unsigned int lpcdThreshold = 1;
+    unsigned int holdUs = 0;
+    unsigned int rearmUs = 0;
+    unsigned int maxUids = 1;
+
+    static char* kwlist[] = {"interval_us", "callback", "lpcd", "lpcd_threshold", "hold_us", "rearm_us", "max_uids", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|IOOIIII", kwlist, &intervalUs, &callback, &lpcd, &lpcdThreshold,
+                                     &holdUs, &rearmUs, &maxUids)) {
+       return NULL;
+    }
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        return PyErr_Format(PyExc_TypeError, "callback must be callable");
+    }
+    if (lpcdThreshold < 1 || lpcdThreshold > 255) {
+        return PyErr_Format(PyExc_ValueError, "lpcd_threshold must be between 1 and 255");
+    }
+    if (maxUids < 1 || maxUids > POLLER_MAX_UIDS) {
+        return PyErr_Format(PyExc_ValueError, "max_uids must be between 1 and %d", POLLER_MAX_UIDS);
+    }
+
+    if (!self->pollerReady) {
+        if (register_stop_at_exit() < 0) {
+            return NULL;
+        }
+        if (Poller_Init(&self->poller) != 0) {
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+        self->pollerReady = 1;
+        self->nextPolling = sPollingReaders;
+        sPollingReaders = self;
+    }
+    if (Poller_IsRunning(&self->poller) || self->dispatching) {
+        return PyErr_Format(PyExc_RuntimeError, "Already polling");
+    }
+
+    self->pollLpcd = PyObject_IsTrue(lpcd) == 1;
+    Poller_SetLpcd(&self->poller, self->pollLpcd ? lpcd_probe : NULL, (uint8_t) lpcdThreshold);
+    Poller_SetFilter(&self->poller, holdUs, rearmUs, maxUids);
+    if (Poller_Start(&self->poller, intervalUs, poll_scan, self) != 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    if (callback != Py_None) {
+        Dispatch_t *dispatch = malloc(sizeof(*dispatch));
+        int ret = ENOMEM;
+
+        Py_INCREF(callback);
+        self->pollCallback = callback;
+
+        if (dispatch != NULL) {
+            dispatch->self = self;
+            dispatch->generation = self->dispatchGeneration;
+            Py_INCREF(self);
+            ret = pthread_create(&self->dispatchThread, NULL, dispatch_thread, dispatch);
+            if (ret != 0) {
+                Py_DECREF(self);
+                free(dispatch);
+            }
+        }
+        if (ret != 0) {
+            Py_BEGIN_ALLOW_THREADS
+            Poller_Stop(&self->poller);
+            Py_END_ALLOW_THREADS
+            Py_CLEAR(self->pollCallback);
+            errno = ret;
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+        self->dispatching = 1;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyObject *Mifare_stop_polling(Mifare * self)
+{
+    int dispatching = self->dispatching;
+    PyObject *callback = self->pollCallback;
+
+    if (!self->pollerReady) {
+        Py_RETURN_NONE;
+    }
+
+    // taken over before the GIL goes, so a caller that comes in meanwhile has no dispatcher to join or detach
+    self->dispatching = 0;
+    self->pollCallback = NULL;
+    self->dispatchGeneration++;
+    if (dispatching && pthread_equal(pthread_self(), self->dispatchThread)) {
+        // called from the callback, the dispatcher winds down once it returns
+        Py_BEGIN_ALLOW_THREADS
+        Poller_Stop(&self->poller);
+        Py_END_ALLOW_THREADS
+        pthread_detach(self->dispatchThread);
+    } else {
+        Py_BEGIN_ALLOW_THREADS
+        Poller_Stop(&self->poller);
+        if (dispatching) {
+            pthread_join(self->dispatchThread, NULL);
+        }
+        Py_END_ALLOW_THREADS
     }
-    
-    ident_sak = -1;
-    
+    Py_XDECREF(callback);
+
     Py_RETURN_NONE;
 }
 
-PyObject *Mifare_select(Mifare * self)
+PyObject *Mifare_polling_stats(Mifare * self)
 {
-    phStatus_t status = 0;
-    uint16_t wTagsDetected = 0;
+    if (!self->pollerReady) {
+        return PyDict_New();
+    }
 
-    /*
-     * Field OFF
-     */
-    status = phhalHw_FieldOff(pHal);
-    CHECK_STATUS(status);
-    if (handle_error(status, SelectError)) return NULL;
-    
-    /*
-     * Configure Discovery loop for Poll Mode
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop,
-                                    PHAC_DISCLOOP_CONFIG_NEXT_POLL_STATE,
-                                    PHAC_DISCLOOP_POLL_STATE_DETECTION);
-    CHECK_STATUS(status);
-    if (handle_error(status, SelectError)) return NULL;
-    
-    /*
-     * Run Discovery loop
-     */
-    status = phacDiscLoop_Run(&sDiscLoop, PHAC_DISCLOOP_ENTRY_POINT_POLL);
-    if ((status & PH_ERR_MASK) != PHAC_DISCLOOP_DEVICE_ACTIVATED) {
-        if (handle_error(status, SelectError)) {
+    return Py_BuildValue("{s:O, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K}",
+                         "lpcd",              self->pollLpcd ? Py_True : Py_False,
+                         "scans",             (unsigned long long) self->poller.scans,
+                         "scan_errors",       (unsigned long long) self->poller.scanErrors,
+                         "scan_time_ns",      (unsigned long long) self->poller.scanNs,
+                         "probes",            (unsigned long long) self->poller.probes,
+                         "probe_time_ns",     (unsigned long long) self->poller.probeNs,
+                         "wakeups",           (unsigned long long) self->poller.wakeups,
+                         "false_wakeups",     (unsigned long long) self->poller.falseWakeups,
+                         "last_detection_ns", (unsigned long long) self->poller.lastDetectionNs,
+                         "events",            (unsigned long long) self->poller.events,
+                         "dropped",           (unsigned long long) self->poller.dropped,
+                         "suppressed",        (unsigned long long) self->poller.suppressed,
+                         "evicted",           (unsigned long long) self->poller.evicted);
+}
+
+PyObject *Mifare_get_event(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *timeout = Py_None;
+    PyObject *event;
+    double seconds = -1;
+
+    static char* kwlist[] = {"timeout", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout)) {
+       return NULL;
+    }
+    if (timeout != Py_None) {
+        seconds = PyFloat_AsDouble(timeout);
+        if (seconds == -1 && PyErr_Occurred()) {
             return NULL;
-        } else { // handle_error should catch everything, but if it doesn't
-            return PyErr_Format(SelectError, "DiscLoop_Run command failed: %02X", (status & PH_ERR_MASK));
+        }
+        if (seconds < 0) {
+            seconds = 0;
         }
     }
-    
-    /*
-     * Card detected
-     * Get the tag types detected info
-     */
-    status = phacDiscLoop_GetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_TECH_DETECTED, &wTagsDetected);
-    if (handle_error(status, SelectError)) return NULL;
 
-    /*
-     * Check for Type A tag detection
-     */
-    if (PHAC_DISCLOOP_CHECK_ANDMASK(wTagsDetected, PHAC_DISCLOOP_POS_BIT_MASK_A)) {
+    event = next_event(self, seconds);
+    if (event == NULL && !PyErr_Occurred()) {
+        Py_RETURN_NONE;
+    }
+    return event;
+}
 
-        uint8_t byteBufferSize = sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].bUidSize;
-        char asciiBuffer[byteBufferSize];
-        uint8_t i;
+PyObject *Mifare_iternext(Mifare * self)
+{
+    // NULL without an exception set ends the iteration
+    return next_event(self, -1);
+}
+
+PyObject *Mifare_event_fd(Mifare * self)
+{
+    if (!self->pollerReady || !Poller_IsRunning(&self->poller)) {
+        Py_RETURN_NONE;
+    }
+    return Py_BuildValue("i", self->poller.eventFd);
+}
+
+/*
+ * Asynchronous operations. submit() queues a job for the reader's worker
+ * thread and returns its id straight away, completions() hands out the
+ * results of finished jobs once async_fd() turns readable. nxppy.AsyncMifare
+ * turns these into asyncio futures.
+ */
+#define ASYNC_FLAG_RAISE            0x01    /* select: raise on an empty field */
+#define ASYNC_FLAG_ACTIVATED        0x02    /* select: a tag was activated, set by async_run */
 
-        for (i = 0; i < byteBufferSize; i++) {
-            sprintf(&asciiBuffer[2 * i], "%02X", sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aUid[i]);
+/* Worker run function, runs on the worker thread without the GIL */
+static void async_run(void *ctx, WorkerJob_t *job)
+{
+    nfc_data *nfc = ctx;
+    uint64_t started = reader_stats_now();
+    uint8_t activated = 0;
+    uint8_t uidSize = 0;
+
+    reader_lock(nfc);
+    switch (job->op) {
+    case OP_SELECT:
+        job->status = select_locked(nfc, job->data, &uidSize, &activated);
+        job->len = uidSize;
+        if (activated) {
+            job->flags |= ASYNC_FLAG_ACTIVATED;
         }
-        
-        ident_sak = sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aSak;
-        return PyUnicode_FromString(asciiBuffer);
-        
-    } else {
-        return PyErr_Format(SelectError, "DISCLOOP_CHECK_ANDMASK failed: %02X", (status & PH_ERR_MASK));
+        break;
+    case OP_READ:
+        job->status = read_pages(nfc, job->start, job->end, job->data, &job->progress);
+        job->len = (job->end - job->start) * MFUL_PAGE_SIZE;
+        record_op(nfc, READER_OP_READ, started, job->status);
+        break;
+    case OP_WRITE:
+        job->status = write_pages(nfc, job->start, job->data, job->len, &job->progress);
+        record_op(nfc, READER_OP_WRITE, started, job->status);
+        break;
+    }
+    reader_unlock(nfc);
+}
+
+/* The result of a finished job, or the exception it raised as an object */
+static PyObject *async_result(const WorkerJob_t *job)
+{
+    PyObject *result = NULL;
+
+    switch (job->op) {
+    case OP_SELECT:
+        result = select_result(job->status, job->flags & ASYNC_FLAG_ACTIVATED, job->data, (uint8_t) job->len,
+                               job->flags & ASYNC_FLAG_RAISE);
+        break;
+    case OP_READ:
+        if (handle_error(job->status, ReadError)) {
+            set_error_progress("pages_read", job->progress);
+        } else {
+            result = PyBytes_FromStringAndSize((const char *) job->data, job->len);
+        }
+        break;
+    case OP_WRITE:
+        if (handle_error(job->status, WriteError)) {
+            set_error_progress("pages_written", job->progress);
+        } else {
+            result = Py_BuildValue("H", job->progress);
+        }
+        break;
     }
 
-    Py_RETURN_NONE;
+    return result != NULL ? result : fetch_error();
 }
 
-PyObject *Mifare_read_block(Mifare * self, PyObject * args, PyObject * kwds)
+static int async_start(Mifare * self)
 {
-    uint8_t blockIdx;
-    static char* kwlist[] = {"block", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &blockIdx)) {
+    if (self->workerReady) {
+        return 0;
+    }
+
+    if (Worker_Init(&self->worker) != 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    if (Worker_Start(&self->worker, async_run, &self->data) != 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        Worker_Destroy(&self->worker);
+        return -1;
+    }
+    self->workerReady = 1;
+    return 0;
+}
+
+PyObject *Mifare_submit(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    unsigned char op;
+    unsigned int start = 0;
+    unsigned int end = 0;
+    Py_buffer data = { NULL };
+    PyObject *raiseOnAbsent = Py_True;
+    WorkerJob_t *job;
+    int raise;
+
+    static char* kwlist[] = {"op", "start", "end", "data", "raise_on_absent", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "B|IIz*O", kwlist, &op, &start, &end, &data, &raiseOnAbsent)) {
        return NULL;
     }
 
-    phStatus_t status = 0;
+    raise = PyObject_IsTrue(raiseOnAbsent);
+    if (raise < 0) {
+        goto fail;
+    }
+    if (op == OP_READ && (start >= end || end > MFUL_MAX_PAGES)) {
+        PyErr_Format(ReadError, "Invalid page range %u-%u", start, end);
+        goto fail;
+    }
+    if (op == OP_WRITE && (data.buf == NULL || data.len == 0 || data.len > WORKER_DATA_SIZE ||
+                              start + (data.len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE > MFUL_MAX_PAGES)) {
+        PyErr_Format(WriteError, "Invalid page range for %d bytes at page %u", (int) data.len, start);
+        goto fail;
+    }
+    if (op != OP_SELECT && op != OP_READ && op != OP_WRITE) {
+        PyErr_Format(PyExc_ValueError, "Unknown operation %u", op);
+        goto fail;
+    }
+    if (async_start(self) < 0) {
+        goto fail;
+    }
 
-    status = phalMful_Read(&salMfc, blockIdx, bDataBuffer);
-    if (handle_error(status, ReadError)) return NULL;
+    job = Worker_Reserve(&self->worker);
+    if (job == NULL) {
+        // the caller keeps it until completions() makes room
+        if (data.buf != NULL) {
+            PyBuffer_Release(&data);
+        }
+        Py_RETURN_NONE;
+    }
 
-#if PY_MAJOR_VERSION >= 3
-    return Py_BuildValue("y#", &bDataBuffer[0], MFC_BLOCK_DATA_SIZE);
-#else
-    return Py_BuildValue("s#", &bDataBuffer[0], MFC_BLOCK_DATA_SIZE);
+    job->op = op;
+    job->flags = raise ? ASYNC_FLAG_RAISE : 0;
+    job->start = (uint16_t) start;
+    job->end = (uint16_t) end;
+    if (op == OP_WRITE) {
+        memcpy(job->data, data.buf, data.len);
+        job->len = (uint16_t) data.len;
+    }
+    if (data.buf != NULL) {
+        PyBuffer_Release(&data);
+    }
 
-#endif
+    return Py_BuildValue("I", Worker_Submit(&self->worker));
+
+fail:
+    if (data.buf != NULL) {
+        PyBuffer_Release(&data);
+    }
+    return NULL;
 }
 
-PyObject *Mifare_read_sign(Mifare * self)
+PyObject *Mifare_completions(Mifare * self)
 {
-    const size_t bufferSize = PHAL_MFUL_SIG_LENGTH;
-    uint8_t data[bufferSize];
-    uint8_t *sign = data;
+    PyObject *result = PyList_New(0);
+    WorkerJob_t job;
 
-    phStatus_t status = 0;
+    if (result == NULL || !self->workerReady) {
+        return result;
+    }
 
-    status = phalMful_ReadSign(&salMfc, '\0', &sign);
-    if (handle_error(status, ReadError)) return NULL;
+    while (Worker_Collect(&self->worker, &job)) {
+        PyObject *value = async_result(&job);
+        PyObject *item = Py_BuildValue("(IN)", job.id, value);
 
-#if PY_MAJOR_VERSION >= 3
-    return Py_BuildValue("y#", sign, bufferSize);
-#else
-    return Py_BuildValue("s#", sign, bufferSize);
-#endif
+        if (item == NULL || PyList_Append(result, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+
+    return result;
 }
 
-PyObject *Mifare_write_block(Mifare * self, PyObject * args, PyObject * kwds)
+PyObject *Mifare_async_fd(Mifare * self)
 {
-    phStatus_t status = 0;
-    uint8_t blockIdx;
-    uint8_t *data;
-    int dataLen;
-    
-    static char* kwlist[] = {"block", "data", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "bs#", kwlist,
-                                     &blockIdx, &data, &dataLen)) {
-       return NULL;
+    if (async_start(self) < 0) {
+        return NULL;
     }
+    return Py_BuildValue("i", Worker_Fd(&self->worker));
+}
 
-    if (dataLen != PHAL_MFUL_WRITE_BLOCK_LENGTH) {
-        return PyErr_Format(WriteError, "Write data MUST be specified as %d bytes", PHAL_MFUL_WRITE_BLOCK_LENGTH);
+/*
+ * Batches. execute() parses a whole list of operations up front and runs
+ * them in one reader call, so a check-in costs one argument parse and one
+ * GIL release instead of one per operation.
+ */
+typedef struct {
+    uint8_t op;
+    uint16_t start;
+    uint16_t end;
+    Py_buffer data;                 /* OP_WRITE */
+    PyObject *bytes;                /* OP_READ: allocated up front, filled without the GIL */
+
+    /* Filled in by run_batch_op */
+    phStatus_t status;
+    uint16_t progress;
+    uint8_t activated;
+    uint8_t outLen;
+    uint8_t out[UID_BUFFER_SIZE];   /* select: the UID, get_version: the version */
+} BatchOp_t;
+
+/* Fill in op from one (OP_x, args...) tuple of execute(). Returns 0 on success. */
+static int parse_batch_op(PyObject *item, Py_ssize_t index, BatchOp_t *op)
+{
+    unsigned int start = 0;
+    unsigned int end = 0;
+    PyObject *ignored;
+    long code;
+
+    if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) < 1) {
+        PyErr_Format(PyExc_TypeError, "Operation %d is not an (op, args...) tuple", (int) index);
+        return -1;
+    }
+    code = PyLong_AsLong(PyTuple_GET_ITEM(item, 0));
+    if (code == -1 && PyErr_Occurred()) {
+        return -1;
     }
+    op->op = (uint8_t) code;
 
-    status = phalMful_Write(&salMfc, blockIdx, data);
-    if (handle_error(status, WriteError)) return NULL;
+    switch (code) {
+    case OP_SELECT:
+    case OP_GET_VERSION:
+        if (PyTuple_GET_SIZE(item) != 1) {
+            PyErr_Format(PyExc_TypeError, "Operation %d takes no arguments", (int) index);
+            return -1;
+        }
+        return 0;
+    case OP_READ:
+        if (!PyArg_ParseTuple(item, "OII:execute", &ignored, &start, &end)) {
+            return -1;
+        }
+        if (start >= end || end > MFUL_MAX_PAGES) {
+            PyErr_Format(ReadError, "Invalid page range %u-%u in operation %d", start, end, (int) index);
+            return -1;
+        }
+        op->bytes = PyBytes_FromStringAndSize(NULL, (end - start) * MFUL_PAGE_SIZE);
+        break;
+    case OP_WRITE:
+        if (!PyArg_ParseTuple(item, "OIs*:execute", &ignored, &start, &op->data)) {
+            return -1;
+        }
+        if (op->data.len == 0 || start + (op->data.len + MFUL_PAGE_SIZE - 1) / MFUL_PAGE_SIZE > MFUL_MAX_PAGES) {
+            PyErr_Format(WriteError, "Invalid page range for %d bytes at page %u in operation %d",
+                         (int) op->data.len, start, (int) index);
+            return -1;
+        }
+        break;
+    default:
+        PyErr_Format(PyExc_ValueError, "Unknown operation %ld at %d", code, (int) index);
+        return -1;
+    }
 
-    Py_RETURN_NONE;
+    op->start = (uint16_t) start;
+    op->end = (uint16_t) end;
+    return op->op == OP_READ && op->bytes == NULL ? -1 : 0;
 }
 
-PyObject *Mifare_get_identity(Mifare* self)
+/* Returns 0 if op failed. Called with the reader lock held. */
+static int run_batch_op(nfc_data *nfc, BatchOp_t *op)
 {
-    if (ident_sak < 0)
-        return PyErr_Format(ReadError, "No tag selected.");
-    
-    uint8_t byteBufferSize = sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].bUidSize;
-    char asciiBuffer[byteBufferSize];
-    uint16_t atqa = 0x00;
-    uint8_t i;
+    uint64_t started = reader_stats_now();
 
-    for (i = 0; i < byteBufferSize; i++) {
-        sprintf(&asciiBuffer[2 * i], "%02X", sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aUid[i]);
+    switch (op->op) {
+    case OP_SELECT:
+        op->status = select_locked(nfc, op->out, &op->outLen, &op->activated);
+        return op->status == PH_ERR_SUCCESS && op->activated && op->outLen;
+    case OP_GET_VERSION:
+        op->status = get_version_locked(nfc, op->out);
+        break;
+    case OP_READ:
+        op->status = read_pages(nfc, op->start, op->end, (uint8_t *) PyBytes_AS_STRING(op->bytes), &op->progress);
+        record_op(nfc, READER_OP_READ, started, op->status);
+        break;
+    case OP_WRITE:
+        op->status = write_pages(nfc, op->start, op->data.buf, op->data.len, &op->progress);
+        record_op(nfc, READER_OP_WRITE, started, op->status);
+        break;
     }
-    
-    for (i = 0; i < PHAC_DISCLOOP_I3P3A_MAX_ATQA_LENGTH; i++) {
-        atqa = atqa | sDiscLoop.sTypeATargetInfo.aTypeA_I3P3[0].aAtqa[i] << i * sizeof(uint8_t);
+
+    return op->status == PH_ERR_SUCCESS;
+}
+
+/* What the matching single call returns for a finished op, NULL with the exception set if it failed */
+static PyObject *batch_op_result(BatchOp_t *op)
+{
+    switch (op->op) {
+    case OP_SELECT:
+        return select_result(op->status, op->activated, op->out, op->outLen, 1);
+    case OP_GET_VERSION:
+        if (handle_error(op->status, ReadError)) return NULL;
+        return version_dict(op->out);
+    case OP_READ:
+        if (handle_error(op->status, ReadError)) {
+            set_error_progress("pages_read", op->progress);
+            return NULL;
+        }
+        Py_INCREF(op->bytes);
+        return op->bytes;
+    case OP_WRITE:
+        if (handle_error(op->status, WriteError)) {
+            set_error_progress("pages_written", op->progress);
+            return NULL;
+        }
+        return Py_BuildValue("H", op->progress);
     }
-    
-#if PY_MAJOR_VERSION >= 3
-    return Py_BuildValue("{s:y#, s:B, s:B}",
-#else
-    return Py_BuildValue("{s:s#, s:B, s:B}",
-#endif
-                         "uid\0",  &asciiBuffer[0], byteBufferSize * 2,
-                         "atqa\0", atqa,
-                         "sak\0",  ident_sak
-                        );
+    return NULL;
 }
 
-PyObject *Mifare_get_version(Mifare* self)
+static void release_batch(BatchOp_t *ops, Py_ssize_t count)
 {
-    const size_t bufferSize = PHAL_MFC_VERSION_LENGTH;
-    unsigned char version[bufferSize];
-    
-    phStatus_t status = 0;
-    
-    status = phalMful_GetVersion(&salMfc, version);
-    if (handle_error(status, ReadError)) return NULL;
-    
-    return Py_BuildValue("{s:B, s:B, s:B, s:B, s:B, s:B, s:B}",
-                         "vendor\0",       version[1],
-                         "tag_type\0",     version[2],
-                         "tag_subtype\0",  version[3],
-                         "version_major\0",version[4],
-                         "version_minor\0",version[5],
-                         "tag_size\0",     version[6],
-                         "protocol\0",     version[7]
-                        );
+    Py_ssize_t i;
+
+    for (i = 0; i < count; i++) {
+        if (ops[i].data.buf != NULL) {
+            PyBuffer_Release(&ops[i].data);
+        }
+        Py_XDECREF(ops[i].bytes);
+    }
+    PyMem_Free(ops);
 }
 
-PyObject* Mifare_clear_block(Mifare* self, PyObject* args, PyObject* kwds) {
-    phStatus_t status = 0;
-    uint8_t blockIdx;
-    
-    static char* kwlist[] = {"block", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b", kwlist, &blockIdx)) {
+PyObject *Mifare_execute(Mifare * self, PyObject * args, PyObject * kwds)
+{
+    nfc_data *nfc = &self->data;
+    PyObject *sequence;
+    PyObject *items;
+    PyObject *results = NULL;
+    PyObject *error = NULL;
+    PyObject *failed = NULL;
+    PyObject *outcome = NULL;
+    BatchOp_t *ops;
+    Py_ssize_t count, parsed, done, i;
+
+    static char* kwlist[] = {"ops", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &sequence)) {
+       return NULL;
+    }
+
+    items = PySequence_Fast(sequence, "ops must be a sequence of (op, args...) tuples");
+    if (items == NULL) {
         return NULL;
     }
-    
-    status = phalMful_Write(&salMfc, blockIdx, CLEAR_DATA);
-    if (handle_error(status, WriteError)) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
 
-    Py_RETURN_NONE;
+    ops = PyMem_Malloc((count ? count : 1) * sizeof(BatchOp_t));
+    if (ops == NULL) {
+        Py_DECREF(items);
+        return PyErr_NoMemory();
+    }
+    memset(ops, 0, (count ? count : 1) * sizeof(BatchOp_t));
+
+    // everything is checked before the first operation runs
+    for (parsed = 0; parsed < count; parsed++) {
+        if (parse_batch_op(PySequence_Fast_GET_ITEM(items, parsed), parsed, &ops[parsed]) < 0) {
+            release_batch(ops, parsed + 1);
+            Py_DECREF(items);
+            return NULL;
+        }
+    }
+    Py_DECREF(items);
+
+    // write buffers stay exported and read results unseen until release_batch, safe without the GIL
+    BEGIN_READER_CALL(nfc)
+    for (done = 0; done < count; done++) {
+        if (!run_batch_op(nfc, &ops[done])) {
+            break;
+        }
+    }
+    END_READER_CALL(nfc)
+
+    results = PyList_New(0);
+    if (results == NULL) {
+        goto out;
+    }
+    for (i = 0; i < done; i++) {
+        PyObject *result = batch_op_result(&ops[i]);
+
+        if (result == NULL || PyList_Append(results, result) < 0) {
+            Py_XDECREF(result);
+            goto out;
+        }
+        Py_DECREF(result);
+    }
+
+    if (done < count) {
+        PyObject *unexpected = batch_op_result(&ops[done]);
+
+        if (unexpected != NULL) {
+            // run_batch_op and batch_op_result disagree, should not happen
+            Py_DECREF(unexpected);
+            PyErr_Format(PyExc_SystemError, "Operation %d failed without an error", (int) done);
+        }
+        error = fetch_error();
+        failed = Py_BuildValue("n", done);
+    } else {
+        Py_INCREF(Py_None);
+        Py_INCREF(Py_None);
+        error = Py_None;
+        failed = Py_None;
+    }
+    if (error != NULL && failed != NULL) {
+        outcome = Py_BuildValue("{s:O, s:O, s:O}",
+                                "results", results,
+                                "failed", failed,
+                                "error", error);
+    }
+
+out:
+    Py_XDECREF(results);
+    Py_XDECREF(error);
+    Py_XDECREF(failed);
+    release_batch(ops, count);
+    return outcome;
 }
 
-/***********************************
-** Python Type Definiton
-***********************************/
 PyMethodDef Mifare_methods[] = {
-    {"select", (PyCFunction) Mifare_select, METH_NOARGS, "Select a Mifare card if present. Returns the card UID"}
+    {"select", (PyCFunction) Mifare_select, METH_VARARGS | METH_KEYWORDS, "Select a Mifare card if present. Returns the card UID, or None with raise_on_absent=False and no card in the field."}
+    ,
+    {"select_all", (PyCFunction) Mifare_select_all, METH_VARARGS | METH_KEYWORDS, "Resolve up to limit Type A tags in one anticollision run, returns a list of dicts with uid, atqa and sak."}
+    ,
+    {"activate", (PyCFunction) Mifare_activate, METH_VARARGS | METH_KEYWORDS, "Activate the tag with the given UID (as returned by select_all), halting the active one."}
+    ,
+    {"is_present", (PyCFunction) Mifare_is_present, METH_NOARGS, "Check that the active tag is still in the field with HLTA/WUPA/SELECT, keeping the field on. Leaves the tag active."}
+    ,
+    {"begin_session", (PyCFunction) Mifare_begin_session, METH_VARARGS | METH_KEYWORDS, "Select a tag and keep it across select() calls until it leaves the field. Returns the card UID"}
+    ,
+    {"end_session", (PyCFunction) Mifare_end_session, METH_NOARGS, "Go back to a full discovery on every select()."}
     ,
     {"read_block", (PyCFunction) Mifare_read_block, METH_VARARGS | METH_KEYWORDS, "Read 4 bytes starting at the specified block."}
     ,
+    {"read_range", (PyCFunction) Mifare_read_range, METH_VARARGS | METH_KEYWORDS, "Read pages start up to (not including) end as a single bytes object."}
+    ,
     {"read_sign", (PyCFunction) Mifare_read_sign, METH_NOARGS, "Read 32 bytes card manufacturer signature."}
     ,
     {"write_block", (PyCFunction) Mifare_write_block, METH_VARARGS | METH_KEYWORDS, "Write 4 bytes starting at the specified block."}
     ,
+    {"write_range", (PyCFunction) Mifare_write_range, METH_VARARGS | METH_KEYWORDS, "Write any bytes-like object to consecutive pages starting at start. Returns the number of pages written."}
+    ,
+    {"write_diff", (PyCFunction) Mifare_write_diff, METH_VARARGS | METH_KEYWORDS, "Like write_range, but only writes the pages whose contents changed. Returns the number of pages written."}
+    ,
+    {"read_ndef", (PyCFunction) Mifare_read_ndef, METH_NOARGS, "Read the NDEF message as a list of record dicts, None if the tag has none. Only reads as many pages as the TLV needs."}
+    ,
+    {"write_ndef", (PyCFunction) Mifare_write_ndef, METH_VARARGS | METH_KEYWORDS, "Encode a list of record dicts as the NDEF message, only writing the pages that changed. Returns the number of pages written."}
+    ,
+    {"dump_into", (PyCFunction) Mifare_dump_into, METH_VARARGS | METH_KEYWORDS, "Dump the whole tag as a tag image into a writable buffer. Returns the image size."}
+    ,
+    {"restore_from", (PyCFunction) Mifare_restore_from, METH_VARARGS | METH_KEYWORDS, "Write the user pages of a tag image back to the tag. Returns the number of pages written."}
+    ,
     {"get_version", (PyCFunction) Mifare_get_version, METH_NOARGS, "Read version data as a dict."}
     ,
+    {"start_polling", (PyCFunction) Mifare_start_polling, METH_VARARGS | METH_KEYWORDS, "Poll for tags on a background thread every interval_us, queueing arrival and departure events (or passing them to callback). lpcd=True only runs a full discovery after lpcd_threshold cheap probes in a row see a change. A UID departs once unseen for hold_us, is reported again as represent every rearm_us it stays, and up to max_uids are tracked."}
+    ,
+    {"stop_polling", (PyCFunction) Mifare_stop_polling, METH_NOARGS, "Stop background polling. Queued events can still be read."}
+    ,
+    {"polling_stats", (PyCFunction) Mifare_polling_stats, METH_NOARGS, "Poller counters as a dict, to compare LPCD and full discovery polling."}
+    ,
+    {"get_event", (PyCFunction) Mifare_get_event, METH_VARARGS | METH_KEYWORDS, "Wait for the next polling event as a dict. Returns None on timeout or when polling has stopped."}
+    ,
+    {"event_fd", (PyCFunction) Mifare_event_fd, METH_NOARGS, "File descriptor that turns readable when polling queues an event, None unless polling. For event loops, drain with get_event(0)."}
+    ,
+    {"submit", (PyCFunction) Mifare_submit, METH_VARARGS | METH_KEYWORDS, "Queue op (OP_SELECT, OP_READ or OP_WRITE) for the reader's worker thread. Returns a job id, or None if the queue is full."}
+    ,
+    {"completions", (PyCFunction) Mifare_completions, METH_NOARGS, "Finished jobs as a list of (id, result) tuples, result being the exception for failed ones."}
+    ,
+    {"async_fd", (PyCFunction) Mifare_async_fd, METH_NOARGS, "File descriptor that turns readable when submitted jobs finish."}
+    ,
+    {"execute", (PyCFunction) Mifare_execute, METH_VARARGS | METH_KEYWORDS, "Run a list of (OP_x, args...) tuples in one native call, stopping at the first failure. Returns a dict of results, failed (the index, or None) and error."}
+    ,
+    {"set_classic_keys", (PyCFunction) Mifare_set_classic_keys, METH_VARARGS | METH_KEYWORDS, "Set the (KEY_A or KEY_B, key) tuples tried in order on MIFARE Classic sectors with no remembered key. Forgets the remembered ones."}
+    ,
+    {"classic_authenticate", (PyCFunction) Mifare_classic_authenticate, METH_VARARGS | METH_KEYWORDS, "Authenticate the sector of a MIFARE Classic block, with the given (key_type, key) or the remembered key and candidates."}
+    ,
+    {"classic_read_block", (PyCFunction) Mifare_classic_read_block, METH_VARARGS | METH_KEYWORDS, "Read a 16 byte MIFARE Classic block, authenticating its sector if needed."}
+    ,
+    {"classic_write_block", (PyCFunction) Mifare_classic_write_block, METH_VARARGS | METH_KEYWORDS, "Write a 16 byte MIFARE Classic block, authenticating its sector if needed. Sector trailers need trailer=True."}
+    ,
+    {"classic_read_sector", (PyCFunction) Mifare_classic_read_sector, METH_VARARGS | METH_KEYWORDS, "Read every block of a MIFARE Classic sector, trailer included, with one authentication."}
+    ,
+    {"classic_key_stats", (PyCFunction) Mifare_classic_key_stats, METH_NOARGS, "Key cache counters as a dict: session_hits, hits and misses (in sector visits) and authentications sent."}
+    ,
+    {"transceive_apdu", (PyCFunction) Mifare_transceive_apdu, METH_VARARGS | METH_KEYWORDS, "Send a command APDU to the active ISO14443-4 tag and return the whole answer, SW1 SW2 included. Frames are chained natively."}
+    ,
+    {"transceive_apdus", (PyCFunction) Mifare_transceive_apdus, METH_VARARGS | METH_KEYWORDS, "Send a list of APDUs in one native call, returns the list of answers. On failure the ReadError carries apdus_completed."}
+    ,
+    {"get_iso_dep", (PyCFunction) Mifare_get_iso_dep, METH_NOARGS, "ATS, negotiated frame sizes (fsd, fsc), fwi and bit rates in kbit/s (tx_bitrate to the tag, rx_bitrate from it) of the active ISO14443-4 tag as a dict, None if there is none."}
+    ,
+    {"configure_discovery", (PyCFunction) Mifare_configure_discovery, METH_VARARGS | METH_KEYWORDS, "Change how the discovery loop polls (tech, bail_out, device_limit, mode, guard_a_us, guard_b_us, guard_f_us, field_off_us) without reinitialising the reader. Returns the whole profile as a dict."}
+    ,
+    {"set_max_bitrate", (PyCFunction) Mifare_set_max_bitrate, METH_VARARGS | METH_KEYWORDS, "Cap the bit rate (106, 212, 424 or 848 kbit/s, default 848) negotiated with ISO14443-4 tags from their next activation."}
+    ,
     {"get_ident", (PyCFunction) Mifare_get_identity, METH_NOARGS, "Read uid, atqa, and sak as a dict."}
     ,
+    {"enable_cache", (PyCFunction) Mifare_enable_cache, METH_VARARGS | METH_KEYWORDS, "Cache the pages of the active tag as they are read, until it is written to or may have left the field."}
+    ,
+    {"cache_stats", (PyCFunction) Mifare_cache_stats, METH_NOARGS, "Page cache counters as a dict: hits and misses (in pages), invalidations and pages held."}
+    ,
+    {"stats", (PyCFunction) Mifare_stats, METH_NOARGS, "Snapshot of the reader counters and the latency of select, read, write, get_version, read_sign and IRQ edges as a dict. Histogram bucket i counts operations under 2^(i+10) ns."}
+    ,
+    {"reset_stats", (PyCFunction) Mifare_reset_stats, METH_NOARGS, "Zero the counters and histograms returned by stats()."}
+    ,
     {"clear_block", (PyCFunction) Mifare_clear_block, METH_VARARGS | METH_KEYWORDS, "Clear 4 bytes starting at the specifed block."}
     ,
     {NULL}                      /* Sentinel */
@@ -243,7 +3391,7 @@ PyTypeObject MifareType = {
         "nxppy._mifare.Mifare", /* tp_name */
     sizeof(Mifare),             /* tp_basicsize */
     0,                          /* tp_itemsize */
-    0,                          /* tp_dealloc */
+    (destructor) Mifare_dealloc, /* tp_dealloc */
     0,                          /* tp_print */
     0,                          /* tp_getattr */
     0,                          /* tp_setattr */
@@ -264,8 +3412,8 @@ PyTypeObject MifareType = {
     0,                          /* tp_clear */
     0,                          /* tp_richcompare */
     0,                          /* tp_weaklistoffset */
-    0,                          /* tp_iter */
-    0,                          /* tp_iternext */
+    PyObject_SelfIter,          /* tp_iter */
+    (iternextfunc) Mifare_iternext, /* tp_iternext */
     Mifare_methods,             /* tp_methods */
     0,                          /* tp_members */
     0,                          /* tp_getset */
@@ -275,4 +3423,6 @@ PyTypeObject MifareType = {
     0,                          /* tp_descr_set */
     0,                          /* tp_dictoffset */
     (initproc) Mifare_init,     /* tp_init */
+    0,                          /* tp_alloc */
+    (newfunc) Mifare_new,       /* tp_new */
 };
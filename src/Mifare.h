@@ -24,9 +24,14 @@
 
 #include <Python.h>
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 
 /**
  * Header for hardware configuration: bus interface, reset of attached reader ID, onboard LED handling etc.
@@ -97,34 +102,193 @@
 #include <phalMfc.h>
 
 #include <phpalI14443p3b.h>
+#ifdef NXPBUILD__PHPAL_FELICA_SW
+#include <phpalFelica.h>
+#endif
+
+#include "platform.h"
+#include "spi_bus.h"
+#include "poller.h"
+#include "worker.h"
+#include "page_cache.h"
+#include "key_cache.h"
+#include "reader_stats.h"
 
 #define UID_BUFFER_SIZE 20
 #define UID_ASCII_BUFFER_SIZE ((UID_BUFFER_SIZE * 2) + 1)
 
+#define TX_RX_BUFFER_SIZE           256 // one ISO14443-4 frame of the largest FSD
+#define ISO_DEP_FSDI                8   /* FSD 256, what TX_RX_BUFFER_SIZE holds */
+#define ISO_DEP_MAX_DATARATE        PHPAL_I14443P4A_DATARATE_848   /* fastest the PN512 does for Type A */
+#define DATA_BUFFER_LEN             16  /* Buffer length */
+#define PHAL_MFC_VERSION_LENGTH     0x08 // from src/phalMFC_Int.h
+
+/* Operations of Mifare.submit() and Mifare.execute() */
+#define OP_SELECT                   1
+#define OP_READ                     2
+#define OP_WRITE                    3
+#define OP_GET_VERSION              4   /* execute() only */
+
+/* Technologies of a discovery profile */
+#define TECH_A                      PHAC_DISCLOOP_POS_BIT_MASK_A
+#define TECH_B                      PHAC_DISCLOOP_POS_BIT_MASK_B
+#define TECH_F                      (PHAC_DISCLOOP_POS_BIT_MASK_F212 | PHAC_DISCLOOP_POS_BIT_MASK_F424)
+#define TECH_V                      PHAC_DISCLOOP_POS_BIT_MASK_V
+
+/* Guard times, field on to the first poll command, as ISO14443-3 and JIS X 6319-4 give them */
+#define DISCOVERY_GUARD_A_US        5100
+#define DISCOVERY_GUARD_B_US        5100
+#define DISCOVERY_GUARD_F_US        20400
+
+/*
+ * How the discovery loop polls, see configure_discovery(). There are no
+ * response timeouts here: the PALs set the HAL timeout from the standards
+ * before every poll and anticollision command, so a profile value would be
+ * overwritten before it is used.
+ */
 typedef struct {
-    phbalReg_Stub_DataParams_t balReader;
-    phhalHw_Nfc_Ic_DataParams_t hal;
-    phpalI14443p4_Sw_DataParams_t I14443p4;
-    phpalMifare_Sw_DataParams_t palMifare;
-    phpalI14443p3a_Sw_DataParams_t I14443p3a;
-    phalMful_Sw_DataParams_t alMful;
-    uint8_t bHalBufferReader[0x40];
-} nfc_data;
+    uint16_t tech;              /* TECH_xxx polled for */
+    uint16_t bailOut;           /* TECH_xxx that end a poll cycle as soon as one is found */
+    uint8_t deviceLimit;        /* Type A tags resolved per cycle */
+    uint8_t mode;               /* RD_LIB_MODE_xxx */
+    uint16_t guardAUs;
+    uint16_t guardBUs;
+    uint16_t guardFUs;
+    uint16_t fieldOffUs;        /* field kept off before each cycle so tags reset, 0 for none */
+} DiscoveryProfile_t;
 
+/*
+ * Everything one reader needs: its Reader Library stack, buffers, GPIOs and
+ * what we know about the tag it has active.
+ */
 typedef struct {
+    phbalReg_Stub_DataParams_t sBalReader;          /* BAL component holder */
+    phhalHw_Nfc_Ic_DataParams_t sHal_Nfc_Ic;        /* HAL component holder for Nfc Ic's */
+    void *pHal;                                     /* HAL pointer */
+    uint8_t bHalBufferTx[TX_RX_BUFFER_SIZE];        /* HAL TX buffer */
+    uint8_t bHalBufferRx[TX_RX_BUFFER_SIZE];        /* HAL RX buffer */
+
+    phpalI14443p3a_Sw_DataParams_t spalI14443p3a;   /* PAL I14443-A component */
+    phpalI14443p4a_Sw_DataParams_t spalI14443p4a;   /* PAL ISO I14443-4A component */
+    phpalI14443p3b_Sw_DataParams_t spalI14443p3b;   /* PAL ISO I14443-B component */
+#ifdef NXPBUILD__PHPAL_FELICA_SW
+    phpalFelica_Sw_DataParams_t spalFelica;         /* PAL FeliCa component, Type F polling */
+#endif
+    phpalI14443p4_Sw_DataParams_t spalI14443p4;     /* PAL ISO I14443-4 component */
+    phpalMifare_Sw_DataParams_t spalMifare;         /* PAL MIFARE component */
+
+    phacDiscLoop_Sw_DataParams_t sDiscLoop;         /* Discovery loop component */
+    phalMfc_Sw_DataParams_t salMfc;                 /* MIFARE Classic parameter structure */
+
+    uint8_t bDataBuffer[DATA_BUFFER_LEN];           /* universal data buffer */
+    uint8_t aData[50];                              /* ATR response holder */
+
+    Platform_t platform;
+    SpiBus_t spi;               /* what sBalReader talks through */
+    uint8_t initialised;
+
+    /*
+     * Serialises access to the reader. Every Reader Library call runs with
+     * this held and the GIL released, so other Python threads (and other
+     * readers) keep running while we wait on SPI and RF traffic.
+     */
+    pthread_mutex_t lock;
+
+    uint8_t ident_sak;
+    uint8_t ident_fast_read;    /* active tag answered GET_VERSION as an NTAG21x / Ultralight EV1 */
+    uint8_t ident_version[PHAL_MFC_VERSION_LENGTH];
+    uint8_t ident_version_valid;
+    uint8_t ident_uid[UID_BUFFER_SIZE];     /* the active tag, set by select() and activate() */
+    uint8_t ident_uid_len;
+    uint8_t ident_atqa[PHAC_DISCLOOP_I3P3A_MAX_ATQA_LENGTH];
+
+    uint8_t session;            /* select() reuses the active tag while it stays in the field */
+    DiscoveryProfile_t profile;
+
+    uint8_t iso_dep_active;     /* active tag is in ISO14443-4, see transceive_apdu() */
+    uint8_t iso_dep_fsci;       /* frame sizes and FWI in force for it */
+    uint8_t iso_dep_fsdi;
+    uint8_t iso_dep_fwi;
+    uint8_t iso_dep_dri;        /* bit rates in force, PHPAL_I14443P4A_DATARATE_xxx, reader to tag */
+    uint8_t iso_dep_dsi;        /* and tag to reader */
+    uint8_t iso_dep_max_rate;   /* cap on what PPS asks for, see set_max_bitrate() */
+
+    PageCache_t cache;          /* pages of the active tag, see enable_cache() */
+    KeyCache_t keys;            /* MIFARE Classic keys, see set_classic_keys() */
+    ReaderStats_t stats;        /* see stats() */
+} nfc_data;
+
+/* The BAL is always the one embedded in a reader's nfc_data */
+#define NFC_DATA_OF_BAL(bal)        ((nfc_data *) ((char *) (bal) - offsetof(nfc_data, sBalReader)))
+
+typedef struct Mifare {
     PyObject_HEAD nfc_data data;
+
+    /* Background polling, see start_polling() */
+    Poller_t poller;
+    uint8_t pollerReady;
+    uint8_t pollLpcd;
+    PyObject *pollCallback;
+    pthread_t dispatchThread;
+    uint8_t dispatching;
+    volatile unsigned int dispatchGeneration;   /* bumped by stop_polling to retire the dispatcher */
+    struct Mifare *nextPolling; /* readers stop_polling runs for at exit, see start_polling() */
+
+    /* Asynchronous operations, see submit() */
+    Worker_t worker;
+    uint8_t workerReady;
 } Mifare;
 
 // TODO change all of these to use keyword/named args
 
+PyObject *Mifare_new(PyTypeObject * type, PyObject * args, PyObject * kwds);
+PyObject *Mifare_stop_all_polling(PyObject * module, PyObject * unused);
 PyObject *Mifare_init(Mifare * self, PyObject * args, PyObject * kwds);
-PyObject *Mifare_select(Mifare * self);
+void Mifare_dealloc(Mifare * self);
+PyObject *Mifare_select(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_select_all(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_activate(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_is_present(Mifare * self);
+PyObject *Mifare_begin_session(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_end_session(Mifare * self);
 PyObject *Mifare_read_block(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_read_range(Mifare * self, PyObject * args, PyObject * kwds);
 PyObject *Mifare_read_sign(Mifare * self);
 PyObject *Mifare_write_block(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_write_range(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_write_diff(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_read_ndef(Mifare * self);
+PyObject *Mifare_write_ndef(Mifare * self, PyObject * args, PyObject * kwds);
 PyObject *Mifare_clear_block(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_set_classic_keys(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_classic_authenticate(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_classic_read_block(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_classic_write_block(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_classic_read_sector(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_classic_key_stats(Mifare * self);
+PyObject *Mifare_transceive_apdu(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_transceive_apdus(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_get_iso_dep(Mifare * self);
+PyObject *Mifare_set_max_bitrate(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_configure_discovery(Mifare * self, PyObject * args, PyObject * kwds);
 PyObject *Mifare_get_version(Mifare * self);
+PyObject *Mifare_dump_into(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_restore_from(Mifare * self, PyObject * args, PyObject * kwds);
 PyObject *Mifare_get_identity(Mifare * self);
+PyObject *Mifare_enable_cache(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_cache_stats(Mifare * self);
+PyObject *Mifare_stats(Mifare * self);
+PyObject *Mifare_reset_stats(Mifare * self);
+PyObject *Mifare_start_polling(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_stop_polling(Mifare * self);
+PyObject *Mifare_polling_stats(Mifare * self);
+PyObject *Mifare_get_event(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_iternext(Mifare * self);
+PyObject *Mifare_event_fd(Mifare * self);
+PyObject *Mifare_submit(Mifare * self, PyObject * args, PyObject * kwds);
+PyObject *Mifare_completions(Mifare * self);
+PyObject *Mifare_async_fd(Mifare * self);
+PyObject *Mifare_execute(Mifare * self, PyObject * args, PyObject * kwds);
 
 extern PyObject *InitError;
 extern PyObject *SelectError;
@@ -0,0 +1,130 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+/*
+ * MIFARE Classic keys of a reader, and which of them opened which sector.
+ *
+ * Sectors are authenticated with the candidate keys in order. The key that
+ * worked is remembered per UID and sector in a small direct-mapped table, so
+ * the next visit costs a single authentication. On top of that the sector
+ * the active tag is authenticated for is tracked, so consecutive blocks of
+ * one sector skip authentication altogether. That is dropped whenever the
+ * tag is (re)activated or a Classic command fails, both of which end the
+ * Crypto1 session on the tag.
+ *
+ * Only the owning reader touches it, with its lock held.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define KEY_CACHE_KEY_SIZE          6
+#define KEY_CACHE_MAX_KEYS          16      /* candidates tried on a sector nothing is known about */
+#define KEY_CACHE_ENTRIES           64      /* must be a power of two */
+#define KEY_CACHE_MAX_UID           10
+#define KEY_CACHE_NO_SECTOR         -1
+
+typedef struct {
+    uint8_t type;                           /* PHHAL_HW_MFC_KEYA or PHHAL_HW_MFC_KEYB */
+    uint8_t key[KEY_CACHE_KEY_SIZE];
+} ClassicKey_t;
+
+typedef struct {
+    uint8_t uid[KEY_CACHE_MAX_UID];
+    uint8_t uidLen;                         /* 0 for an unused entry */
+    uint8_t sector;
+    ClassicKey_t key;
+} KeyCacheEntry_t;
+
+typedef struct {
+    ClassicKey_t keys[KEY_CACHE_MAX_KEYS];
+    uint8_t keyCount;
+    KeyCacheEntry_t entries[KEY_CACHE_ENTRIES];
+    int authSector;                         /* of the active tag, KEY_CACHE_NO_SECTOR if none */
+
+    /* Counters, in sector visits */
+    uint64_t sessionHits;                   /* already authenticated */
+    uint64_t hits;                          /* the remembered key worked */
+    uint64_t misses;                        /* candidates had to be tried */
+    uint64_t authentications;               /* MFAuthent commands sent */
+} KeyCache_t;
+
+/* Sector of a block: 32 sectors of 4 blocks, then (4K only) 8 of 16 */
+static inline uint8_t key_cache_sector(uint8_t block)
+{
+    return block < 128 ? block / 4 : 32 + (block - 128) / 16;
+}
+
+static inline uint8_t key_cache_first_block(uint8_t sector)
+{
+    return sector < 32 ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+static inline uint8_t key_cache_sector_blocks(uint8_t sector)
+{
+    return sector < 32 ? 4 : 16;
+}
+
+static inline int key_cache_is_trailer(uint8_t block)
+{
+    return block < 128 ? (block % 4) == 3 : (block % 16) == 15;
+}
+
+static inline KeyCacheEntry_t *key_cache_slot(KeyCache_t *cache, const uint8_t *uid, uint8_t uidLen, uint8_t sector)
+{
+    uint32_t hash = 2166136261u;    /* FNV-1a */
+    uint8_t i;
+
+    for (i = 0; i < uidLen; i++) {
+        hash = (hash ^ uid[i]) * 16777619u;
+    }
+    hash = (hash ^ sector) * 16777619u;
+
+    return &cache->entries[hash & (KEY_CACHE_ENTRIES - 1)];
+}
+
+/* The key that last opened this sector of this tag, NULL if none is known */
+static inline const ClassicKey_t *key_cache_find(KeyCache_t *cache, const uint8_t *uid, uint8_t uidLen, uint8_t sector)
+{
+    KeyCacheEntry_t *entry = key_cache_slot(cache, uid, uidLen, sector);
+
+    if (!uidLen || entry->uidLen != uidLen || entry->sector != sector || memcmp(entry->uid, uid, uidLen) != 0) {
+        return NULL;
+    }
+    return &entry->key;
+}
+
+/* Remember key for this sector of this tag, replacing whatever shared its slot */
+static inline void key_cache_store(KeyCache_t *cache, const uint8_t *uid, uint8_t uidLen, uint8_t sector,
+                                   const ClassicKey_t *key)
+{
+    KeyCacheEntry_t *entry = key_cache_slot(cache, uid, uidLen, sector);
+
+    if (!uidLen || uidLen > KEY_CACHE_MAX_UID) {
+        return;
+    }
+    memcpy(entry->uid, uid, uidLen);
+    entry->uidLen = uidLen;
+    entry->sector = sector;
+    entry->key = *key;
+}
+
+static inline int key_cache_same_key(const ClassicKey_t *a, const ClassicKey_t *b)
+{
+    return a->type == b->type && memcmp(a->key, b->key, KEY_CACHE_KEY_SIZE) == 0;
+}
+
+static inline void key_cache_forget(KeyCache_t *cache, const uint8_t *uid, uint8_t uidLen, uint8_t sector)
+{
+    if (key_cache_find(cache, uid, uidLen, sector) != NULL) {
+        key_cache_slot(cache, uid, uidLen, sector)->uidLen = 0;
+    }
+}
+
+/* Forget every remembered key, the candidates stay */
+static inline void key_cache_clear(KeyCache_t *cache)
+{
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->authSector = KEY_CACHE_NO_SECTOR;
+}
+
+#endif // KEY_CACHE_H
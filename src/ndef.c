@@ -0,0 +1,242 @@
+#include <string.h>
+
+#include "ndef.h"
+
+/* NFC Forum URI RTD, identifier code 0x00 is no prefix */
+static const char *const sUriPrefixes[] = {
+    "",
+    "http://www.",
+    "https://www.",
+    "http://",
+    "https://",
+    "tel:",
+    "mailto:",
+    "ftp://anonymous:anonymous@",
+    "ftp://ftp.",
+    "ftps://",
+    "sftp://",
+    "smb://",
+    "nfs://",
+    "ftp://",
+    "dav://",
+    "news:",
+    "telnet://",
+    "imap:",
+    "rtsp://",
+    "urn:",
+    "pop:",
+    "sip:",
+    "sips:",
+    "tftp:",
+    "btspp://",
+    "btl2cap://",
+    "btgoep://",
+    "tcpobex://",
+    "irdaobex://",
+    "file://",
+    "urn:epc:id:",
+    "urn:epc:tag:",
+    "urn:epc:pat:",
+    "urn:epc:raw:",
+    "urn:epc:",
+    "urn:nfc:",
+};
+
+#define URI_PREFIX_COUNT            (sizeof(sUriPrefixes) / sizeof(sUriPrefixes[0]))
+
+/*******************************************************************************
+** TLV
+*******************************************************************************/
+
+int Ndef_FindMessage(const uint8_t *area, size_t len, size_t *offset, size_t *length)
+{
+    size_t pos = 0;
+
+    for (;;) {
+        size_t valueLen;
+        size_t headerLen = 2;
+        uint8_t type;
+
+        if (pos >= len) {
+            *length = pos + 1;
+            return NDEF_END;
+        }
+
+        type = area[pos];
+        if (type == NDEF_TLV_NULL) {
+            pos++;
+            continue;
+        }
+        if (type == NDEF_TLV_TERMINATOR) {
+            return NDEF_NOT_FOUND;
+        }
+
+        if (pos + 2 > len) {
+            *length = pos + 2;
+            return NDEF_NEED_MORE;
+        }
+        valueLen = area[pos + 1];
+        if (valueLen == 0xFF) {
+            // three byte format, the length follows big endian
+            if (pos + 4 > len) {
+                *length = pos + 4;
+                return NDEF_NEED_MORE;
+            }
+            valueLen = ((size_t) area[pos + 2] << 8) | area[pos + 3];
+            headerLen = 4;
+        }
+
+        if (type == NDEF_TLV_MESSAGE) {
+            *offset = pos + headerLen;
+            if (*offset + valueLen > len) {
+                *length = *offset + valueLen;
+                return NDEF_NEED_MORE;
+            }
+            *length = valueLen;
+            return NDEF_OK;
+        }
+
+        pos += headerLen + valueLen;
+    }
+}
+
+size_t Ndef_TlvHeaderSize(size_t length)
+{
+    return length < 0xFF ? 2 : 4;
+}
+
+size_t Ndef_TlvHeader(uint8_t *out, uint8_t type, size_t length)
+{
+    out[0] = type;
+    if (length < 0xFF) {
+        out[1] = (uint8_t) length;
+        return 2;
+    }
+
+    out[1] = 0xFF;
+    out[2] = (uint8_t) (length >> 8);
+    out[3] = (uint8_t) length;
+    return 4;
+}
+
+/*******************************************************************************
+** Records
+*******************************************************************************/
+
+int Ndef_ParseRecord(const uint8_t *message, size_t len, NdefRecord_t *record)
+{
+    size_t pos;
+
+    if (len < 3) {
+        return NDEF_MALFORMED;
+    }
+
+    record->header = message[0];
+    record->typeLen = message[1];
+    record->idLen = 0;
+
+    if (record->header & NDEF_FLAG_SR) {
+        record->payloadLen = message[2];
+        pos = 3;
+    } else {
+        if (len < 6) {
+            return NDEF_MALFORMED;
+        }
+        record->payloadLen = ((uint32_t) message[2] << 24) | ((uint32_t) message[3] << 16) |
+            ((uint32_t) message[4] << 8) | message[5];
+        pos = 6;
+    }
+
+    if (record->header & NDEF_FLAG_IL) {
+        if (pos >= len) {
+            return NDEF_MALFORMED;
+        }
+        record->idLen = message[pos++];
+    }
+
+    // checked one by one, so a huge payload length cannot wrap around
+    if (record->payloadLen > len || pos + record->typeLen + record->idLen > len - record->payloadLen) {
+        return NDEF_MALFORMED;
+    }
+
+    record->type = &message[pos];
+    pos += record->typeLen;
+    record->id = &message[pos];
+    pos += record->idLen;
+    record->payload = &message[pos];
+    record->size = pos + record->payloadLen;
+
+    return NDEF_OK;
+}
+
+int Ndef_RecordHeader(uint8_t *out, size_t cap, uint8_t flags, uint8_t tnf,
+                      const uint8_t *type, uint8_t typeLen, const uint8_t *id, uint8_t idLen, uint32_t payloadLen)
+{
+    size_t pos;
+
+    flags &= ~(NDEF_FLAG_SR | NDEF_FLAG_IL | NDEF_TNF_MASK);
+    if (payloadLen < 0x100) {
+        flags |= NDEF_FLAG_SR;
+    }
+    if (idLen) {
+        flags |= NDEF_FLAG_IL;
+    }
+
+    if (cap < 2 + (payloadLen < 0x100 ? 1 : 4) + (idLen ? 1 : 0) + (size_t) typeLen + idLen) {
+        return -1;
+    }
+
+    out[0] = flags | (tnf & NDEF_TNF_MASK);
+    out[1] = typeLen;
+    if (flags & NDEF_FLAG_SR) {
+        out[2] = (uint8_t) payloadLen;
+        pos = 3;
+    } else {
+        out[2] = (uint8_t) (payloadLen >> 24);
+        out[3] = (uint8_t) (payloadLen >> 16);
+        out[4] = (uint8_t) (payloadLen >> 8);
+        out[5] = (uint8_t) payloadLen;
+        pos = 6;
+    }
+    if (idLen) {
+        out[pos++] = idLen;
+    }
+
+    if (typeLen) {
+        memcpy(&out[pos], type, typeLen);
+        pos += typeLen;
+    }
+    if (idLen) {
+        memcpy(&out[pos], id, idLen);
+        pos += idLen;
+    }
+
+    return (int) pos;
+}
+
+/*******************************************************************************
+** URI prefixes
+*******************************************************************************/
+
+const char *Ndef_UriPrefix(uint8_t code)
+{
+    return code < URI_PREFIX_COUNT ? sUriPrefixes[code] : NULL;
+}
+
+uint8_t Ndef_UriAbbreviate(const char *uri, size_t len, size_t *prefixLen)
+{
+    uint8_t best = 0;
+    uint8_t code;
+
+    *prefixLen = 0;
+    for (code = 1; code < URI_PREFIX_COUNT; code++) {
+        size_t prefix = strlen(sUriPrefixes[code]);
+
+        if (prefix > *prefixLen && prefix <= len && memcmp(uri, sUriPrefixes[code], prefix) == 0) {
+            best = code;
+            *prefixLen = prefix;
+        }
+    }
+
+    return best;
+}
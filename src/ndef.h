@@ -0,0 +1,96 @@
+#ifndef NDEF_H
+#define NDEF_H
+/*
+ * NDEF on Type 2 tags: the TLV blocks in user memory and the records of the
+ * message inside the NDEF TLV (NFC Forum T2T and NDEF 1.0).
+ *
+ * Parsing never copies, records point into the buffer they were found in.
+ * Encoding writes straight into the caller's buffer.
+ *
+ * Nothing in here knows about Python or the Reader Library.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NDEF_TLV_NULL               0x00
+#define NDEF_TLV_LOCK_CONTROL       0x01
+#define NDEF_TLV_MEMORY_CONTROL     0x02
+#define NDEF_TLV_MESSAGE            0x03
+#define NDEF_TLV_PROPRIETARY        0xFD
+#define NDEF_TLV_TERMINATOR         0xFE
+
+#define NDEF_CC_MAGIC               0xE1    /* first byte of the capability container, page 3 */
+
+#define NDEF_FLAG_MB                0x80    /* message begin */
+#define NDEF_FLAG_ME                0x40    /* message end */
+#define NDEF_FLAG_CF                0x20    /* chunked */
+#define NDEF_FLAG_SR                0x10    /* short record, 1 byte payload length */
+#define NDEF_FLAG_IL                0x08    /* ID length present */
+#define NDEF_TNF_MASK               0x07
+
+#define NDEF_TNF_EMPTY              0x00
+#define NDEF_TNF_WELL_KNOWN         0x01
+#define NDEF_TNF_MIME               0x02
+#define NDEF_TNF_URI                0x03
+#define NDEF_TNF_EXTERNAL           0x04
+#define NDEF_TNF_UNKNOWN            0x05
+#define NDEF_TNF_UNCHANGED          0x06
+
+#define NDEF_RTD_TEXT               'T'
+#define NDEF_RTD_URI                'U'
+#define NDEF_TEXT_UTF16             0x80    /* text record status byte */
+#define NDEF_TEXT_LANG_MASK         0x3F
+
+/* Return codes */
+#define NDEF_OK                     0
+#define NDEF_NEED_MORE              1       /* the buffer ends before the answer does */
+#define NDEF_NOT_FOUND              2
+#define NDEF_END                    3       /* the buffer ends between two TLVs */
+#define NDEF_MALFORMED              -1
+
+#define NDEF_MAX_HEADER_SIZE        (6 + 1 + 255 + 255)
+
+typedef struct {
+    uint8_t header;             /* NDEF_FLAG_xxx | TNF */
+    const uint8_t *type;
+    uint8_t typeLen;
+    const uint8_t *id;
+    uint8_t idLen;
+    const uint8_t *payload;
+    uint32_t payloadLen;
+    size_t size;                /* the whole record */
+} NdefRecord_t;
+
+/*
+ * Find the NDEF message in a TLV area (user memory from page 4 on).
+ * NDEF_OK sets offset and length of the message within area.
+ * NDEF_NEED_MORE if area ends inside a TLV, NDEF_END if it ends between two;
+ * both set length to how many bytes of area are needed to get any further.
+ * NDEF_NOT_FOUND if a terminator comes first.
+ */
+int Ndef_FindMessage(const uint8_t *area, size_t len, size_t *offset, size_t *length);
+
+/* Parse the record at the start of message. NDEF_OK or NDEF_MALFORMED. */
+int Ndef_ParseRecord(const uint8_t *message, size_t len, NdefRecord_t *record);
+
+/* URI record identifier code to prefix, NULL for reserved codes */
+const char *Ndef_UriPrefix(uint8_t code);
+
+/* Identifier code of the longest known prefix of uri, its length in prefixLen */
+uint8_t Ndef_UriAbbreviate(const char *uri, size_t len, size_t *prefixLen);
+
+/*
+ * Write a record header, type and ID included, for a payload of payloadLen
+ * bytes that the caller appends. SR and IL are worked out here. Returns the
+ * header size or -1 if it does not fit in cap.
+ */
+int Ndef_RecordHeader(uint8_t *out, size_t cap, uint8_t flags, uint8_t tnf,
+                      const uint8_t *type, uint8_t typeLen, const uint8_t *id, uint8_t idLen, uint32_t payloadLen);
+
+/* Size of the T and L fields of a TLV with a value of length bytes */
+size_t Ndef_TlvHeaderSize(size_t length);
+/* Write the T and L fields, returns their size */
+size_t Ndef_TlvHeader(uint8_t *out, uint8_t type, size_t length);
+
+#endif // NDEF_H
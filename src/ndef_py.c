@@ -0,0 +1,484 @@
+#include <string.h>
+#include "ndef_py.h"
+
+#define NDEF_ENCODE_BUFFER_SIZE     1024    /* 256 pages of 4 bytes, more than any Type 2 tag holds */
+
+/*******************************************************************************
+** Parsing
+*******************************************************************************/
+
+/* Decode the status byte, language and text of a Text record payload */
+static int text_fields(PyObject *dict, const uint8_t *payload, uint32_t len)
+{
+    PyObject *lang;
+    PyObject *text;
+    uint8_t langLen;
+    int ret;
+
+    if (len < 1 || (uint32_t) (payload[0] & NDEF_TEXT_LANG_MASK) + 1 > len) {
+        return 0;   // not decodable, the raw payload is still there
+    }
+    langLen = payload[0] & NDEF_TEXT_LANG_MASK;
+
+    lang = PyUnicode_DecodeASCII((const char *) &payload[1], langLen, "replace");
+    if (payload[0] & NDEF_TEXT_UTF16) {
+        const uint8_t *utf16 = &payload[1 + langLen];
+        Py_ssize_t utf16Len = len - 1 - langLen;
+        int byteorder = 1;  // big endian unless there is a BOM
+
+        if (utf16Len >= 2 && utf16[0] == 0xFF && utf16[1] == 0xFE) {
+            byteorder = -1;
+            utf16 += 2;
+            utf16Len -= 2;
+        } else if (utf16Len >= 2 && utf16[0] == 0xFE && utf16[1] == 0xFF) {
+            utf16 += 2;
+            utf16Len -= 2;
+        }
+        text = PyUnicode_DecodeUTF16((const char *) utf16, utf16Len, "replace", &byteorder);
+    } else {
+        text = PyUnicode_DecodeUTF8((const char *) &payload[1 + langLen], len - 1 - langLen, "replace");
+    }
+
+    ret = lang != NULL && text != NULL &&
+        PyDict_SetItemString(dict, "lang", lang) == 0 && PyDict_SetItemString(dict, "text", text) == 0 ? 0 : -1;
+    Py_XDECREF(lang);
+    Py_XDECREF(text);
+    return ret;
+}
+
+/* Expand the identifier code of a URI record payload */
+static int uri_fields(PyObject *dict, const uint8_t *payload, uint32_t len)
+{
+    const char *prefix = len ? Ndef_UriPrefix(payload[0]) : NULL;
+    PyObject *head;
+    PyObject *tail;
+    PyObject *uri = NULL;
+    int ret;
+
+    if (prefix == NULL) {
+        return 0;
+    }
+
+    head = PyUnicode_FromString(prefix);
+    tail = PyUnicode_DecodeUTF8((const char *) &payload[1], len - 1, "replace");
+    if (head != NULL && tail != NULL) {
+        uri = PyUnicode_Concat(head, tail);
+    }
+
+    ret = uri != NULL && PyDict_SetItemString(dict, "uri", uri) == 0 ? 0 : -1;
+    Py_XDECREF(head);
+    Py_XDECREF(tail);
+    Py_XDECREF(uri);
+    return ret;
+}
+
+static PyObject *record_dict(const NdefRecord_t *record, PyObject *view, const uint8_t *base)
+{
+    uint8_t tnf = record->header & NDEF_TNF_MASK;
+    Py_ssize_t start = record->payload - base;
+    PyObject *id;
+    PyObject *dict;
+
+    if (record->header & NDEF_FLAG_IL) {
+        id = PyBytes_FromStringAndSize((const char *) record->id, record->idLen);
+    } else {
+        Py_INCREF(Py_None);
+        id = Py_None;
+    }
+
+    // the payload is a view into the buffer the message was read into, no copy
+    dict = Py_BuildValue("{s:B, s:N, s:N, s:N}",
+                         "tnf",     tnf,
+                         "type",    PyUnicode_DecodeASCII((const char *) record->type, record->typeLen, "replace"),
+                         "id",      id,
+                         "payload", PySequence_GetSlice(view, start, start + record->payloadLen));
+    if (dict == NULL) {
+        return NULL;
+    }
+
+    if (tnf == NDEF_TNF_WELL_KNOWN && record->typeLen == 1) {
+        int ret = 0;
+
+        if (record->type[0] == NDEF_RTD_TEXT) {
+            ret = text_fields(dict, record->payload, record->payloadLen);
+        } else if (record->type[0] == NDEF_RTD_URI) {
+            ret = uri_fields(dict, record->payload, record->payloadLen);
+        }
+        if (ret < 0) {
+            Py_DECREF(dict);
+            return NULL;
+        }
+    }
+
+    return dict;
+}
+
+PyObject *Ndef_ToList(PyObject *owner, const uint8_t *base, size_t offset, size_t length, PyObject *error)
+{
+    const uint8_t *message = &base[offset];
+    PyObject *view;
+    PyObject *result;
+    size_t pos = 0;
+
+    view = PyMemoryView_FromObject(owner);
+    if (view == NULL) {
+        return NULL;
+    }
+    result = PyList_New(0);
+    if (result == NULL) {
+        Py_DECREF(view);
+        return NULL;
+    }
+
+    while (pos < length) {
+        NdefRecord_t record;
+        PyObject *dict;
+
+        if (Ndef_ParseRecord(&message[pos], length - pos, &record) != NDEF_OK) {
+            PyErr_Format(error, "Malformed NDEF record at byte %d of the message", (int) pos);
+            goto fail;
+        }
+
+        dict = record_dict(&record, view, base);
+        if (dict == NULL || PyList_Append(result, dict) < 0) {
+            Py_XDECREF(dict);
+            goto fail;
+        }
+        Py_DECREF(dict);
+
+        pos += record.size;
+        if (record.header & NDEF_FLAG_ME) {
+            break;
+        }
+    }
+
+    Py_DECREF(view);
+    return result;
+
+fail:
+    Py_DECREF(view);
+    Py_DECREF(result);
+    return NULL;
+}
+
+/*******************************************************************************
+** Encoding
+*******************************************************************************/
+
+/*
+ * Borrow the bytes of a str/unicode (as UTF-8) or bytes object. *owner holds
+ * the reference to release, NULL on error.
+ */
+static const char *utf8_bytes(PyObject *obj, Py_ssize_t *len, PyObject **owner)
+{
+    if (PyUnicode_Check(obj)) {
+        *owner = PyUnicode_AsUTF8String(obj);
+    } else if (PyBytes_Check(obj)) {
+        Py_INCREF(obj);
+        *owner = obj;
+    } else {
+        PyErr_Format(PyExc_TypeError, "Expected str or bytes, not %.100s", Py_TYPE(obj)->tp_name);
+        *owner = NULL;
+    }
+    if (*owner == NULL) {
+        return NULL;
+    }
+
+    *len = PyBytes_GET_SIZE(*owner);
+    return PyBytes_AS_STRING(*owner);
+}
+
+static int overflow(size_t cap)
+{
+    PyErr_Format(PyExc_OverflowError, "NDEF message does not fit in %d bytes", (int) cap);
+    return -1;
+}
+
+/*
+ * Encode one record at out[*pos]. Text and URI records are built from their
+ * fields, the payload of anything else is written as it is.
+ */
+static int encode_record(PyObject *dict, uint8_t flags, uint8_t *out, size_t cap, size_t *pos)
+{
+    PyObject *text = PyDict_GetItemString(dict, "text");
+    PyObject *uri = PyDict_GetItemString(dict, "uri");
+    PyObject *idObj = PyDict_GetItemString(dict, "id");
+    PyObject *idOwner = NULL;
+    PyObject *typeOwner = NULL;
+    PyObject *valueOwner = NULL;
+    Py_buffer payload = { NULL };
+    const char *id = NULL;
+    Py_ssize_t idLen = 0;
+    const char *type;
+    Py_ssize_t typeLen;
+    const char *value = NULL;
+    Py_ssize_t valueLen = 0;
+    uint8_t tnf;
+    uint8_t prefix[1 + NDEF_TEXT_LANG_MASK];    /* status byte and language, or the URI code */
+    size_t prefixLen = 0;
+    int header;
+    int ret = -1;
+
+    if (idObj != NULL && idObj != Py_None) {
+        id = utf8_bytes(idObj, &idLen, &idOwner);
+        if (id == NULL) {
+            goto done;
+        }
+        if (idLen > 255) {
+            PyErr_Format(PyExc_ValueError, "NDEF record IDs are at most 255 bytes");
+            goto done;
+        }
+    }
+
+    if (text != NULL) {
+        PyObject *langObj = PyDict_GetItemString(dict, "lang");
+        PyObject *langOwner = NULL;
+        const char *lang = "en";
+        Py_ssize_t langLen = 2;
+
+        if (langObj != NULL && langObj != Py_None) {
+            lang = utf8_bytes(langObj, &langLen, &langOwner);
+            if (lang == NULL) {
+                goto done;
+            }
+        }
+        if (langLen > NDEF_TEXT_LANG_MASK) {
+            Py_XDECREF(langOwner);
+            PyErr_Format(PyExc_ValueError, "Language codes are at most %d bytes", NDEF_TEXT_LANG_MASK);
+            goto done;
+        }
+        prefix[0] = (uint8_t) langLen;
+        memcpy(&prefix[1], lang, langLen);
+        prefixLen = 1 + langLen;
+        Py_XDECREF(langOwner);
+
+        value = utf8_bytes(text, &valueLen, &valueOwner);
+        tnf = NDEF_TNF_WELL_KNOWN;
+        type = "T";
+        typeLen = 1;
+    } else if (uri != NULL) {
+        size_t abbreviated;
+
+        value = utf8_bytes(uri, &valueLen, &valueOwner);
+        if (value != NULL) {
+            prefix[0] = Ndef_UriAbbreviate(value, valueLen, &abbreviated);
+            prefixLen = 1;
+            value += abbreviated;
+            valueLen -= abbreviated;
+        }
+        tnf = NDEF_TNF_WELL_KNOWN;
+        type = "U";
+        typeLen = 1;
+    } else {
+        PyObject *tnfObj = PyDict_GetItemString(dict, "tnf");
+        PyObject *typeObj = PyDict_GetItemString(dict, "type");
+        PyObject *payloadObj = PyDict_GetItemString(dict, "payload");
+        long tnfValue;
+
+        if (tnfObj == NULL || typeObj == NULL || payloadObj == NULL) {
+            PyErr_Format(PyExc_ValueError, "An NDEF record needs text, uri or tnf, type and payload");
+            goto done;
+        }
+        tnfValue = PyLong_AsLong(tnfObj);
+        if (tnfValue == -1 && PyErr_Occurred()) {
+            goto done;
+        }
+        if (tnfValue < 0 || tnfValue > NDEF_TNF_UNCHANGED) {
+            PyErr_Format(PyExc_ValueError, "Invalid TNF %ld", tnfValue);
+            goto done;
+        }
+        tnf = (uint8_t) tnfValue;
+
+        type = utf8_bytes(typeObj, &typeLen, &typeOwner);
+        if (type == NULL || PyObject_GetBuffer(payloadObj, &payload, PyBUF_SIMPLE) < 0) {
+            goto done;
+        }
+        value = payload.buf;
+        valueLen = payload.len;
+    }
+    if (value == NULL) {
+        goto done;
+    }
+    if (typeLen > 255) {
+        PyErr_Format(PyExc_ValueError, "NDEF record types are at most 255 bytes");
+        goto done;
+    }
+    if ((size_t) valueLen + prefixLen > 0xFFFFFFFF) {
+        overflow(cap);
+        goto done;
+    }
+
+    header = Ndef_RecordHeader(&out[*pos], cap - *pos, flags, tnf, (const uint8_t *) type, (uint8_t) typeLen,
+                               (const uint8_t *) id, (uint8_t) idLen, (uint32_t) (prefixLen + valueLen));
+    if (header < 0 || cap - *pos - header < prefixLen + valueLen) {
+        overflow(cap);
+        goto done;
+    }
+    *pos += header;
+    memcpy(&out[*pos], prefix, prefixLen);
+    *pos += prefixLen;
+    memcpy(&out[*pos], value, valueLen);
+    *pos += valueLen;
+    ret = 0;
+
+done:
+    if (payload.buf != NULL) {
+        PyBuffer_Release(&payload);
+    }
+    Py_XDECREF(idOwner);
+    Py_XDECREF(typeOwner);
+    Py_XDECREF(valueOwner);
+    return ret;
+}
+
+Py_ssize_t Ndef_Encode(PyObject *records, uint8_t *out, size_t cap)
+{
+    // the message goes after room for the longest TLV header, moved up at the end if that was too much
+    const size_t reserved = Ndef_TlvHeaderSize(0xFFFF);
+    PyObject *seq;
+    Py_ssize_t count;
+    Py_ssize_t i;
+    size_t pos = reserved;
+    size_t header;
+
+    if (cap < reserved + 1) {
+        return overflow(cap);
+    }
+
+    seq = PySequence_Fast(records, "NDEF records must be a sequence of dicts");
+    if (seq == NULL) {
+        return -1;
+    }
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    for (i = 0; i < count; i++) {
+        PyObject *dict = PySequence_Fast_GET_ITEM(seq, i);
+        uint8_t flags = (i == 0 ? NDEF_FLAG_MB : 0) | (i == count - 1 ? NDEF_FLAG_ME : 0);
+
+        if (!PyDict_Check(dict)) {
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_TypeError, "NDEF records must be dicts");
+            return -1;
+        }
+        if (encode_record(dict, flags, out, cap, &pos) < 0) {
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+    Py_DECREF(seq);
+
+    if (pos - reserved > 0xFFFE) {
+        return overflow(cap);
+    }
+    header = Ndef_TlvHeaderSize(pos - reserved);
+    if (header < reserved) {
+        memmove(&out[header], &out[reserved], pos - reserved);
+    }
+    Ndef_TlvHeader(out, NDEF_TLV_MESSAGE, pos - reserved);
+    pos -= reserved - header;
+
+    if (pos >= cap) {
+        return overflow(cap);
+    }
+    out[pos++] = NDEF_TLV_TERMINATOR;
+
+    return (Py_ssize_t) pos;
+}
+
+/*******************************************************************************
+** Module functions
+*******************************************************************************/
+
+PyObject *Ndef_parse(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *buffer;
+    PyObject *result = NULL;
+    Py_buffer view;
+    size_t offset = 0;
+    size_t length = 0;
+    int found;
+
+    static char *kwlist[] = { "buffer", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &buffer)) {
+        return NULL;
+    }
+    if (PyObject_GetBuffer(buffer, &view, PyBUF_SIMPLE) < 0) {
+        return NULL;
+    }
+
+    found = Ndef_FindMessage(view.buf, view.len, &offset, &length);
+    if (found == NDEF_OK) {
+        result = Ndef_ToList(buffer, view.buf, offset, length, PyExc_ValueError);
+    } else if (found == NDEF_NEED_MORE) {
+        PyErr_Format(PyExc_ValueError, "The NDEF TLV runs past the end of the buffer, %d bytes needed", (int) length);
+    } else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+
+    PyBuffer_Release(&view);
+    return result;
+}
+
+PyObject *Ndef_encode(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *records;
+    PyObject *buffer = Py_None;
+    Py_ssize_t len;
+
+    static char *kwlist[] = { "records", "buffer", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &records, &buffer)) {
+        return NULL;
+    }
+
+    if (buffer == Py_None) {
+        uint8_t out[NDEF_ENCODE_BUFFER_SIZE];
+
+        len = Ndef_Encode(records, out, sizeof(out));
+        if (len < 0) {
+            return NULL;
+        }
+        return PyBytes_FromStringAndSize((const char *) out, len);
+    } else {
+        Py_buffer view;
+
+        if (PyObject_GetBuffer(buffer, &view, PyBUF_WRITABLE) < 0) {
+            return NULL;
+        }
+        len = Ndef_Encode(records, view.buf, view.len);
+        PyBuffer_Release(&view);
+        if (len < 0) {
+            return NULL;
+        }
+        return Py_BuildValue("n", len);
+    }
+}
+
+static PyMethodDef Ndef_methods[] = {
+    {"ndef_parse", (PyCFunction) Ndef_parse, METH_VARARGS | METH_KEYWORDS, "Parse the NDEF message in a TLV area (user memory from page 4 on) into a list of record dicts, None if there is none. Payloads are memoryviews into buffer."}
+    ,
+    {"ndef_encode", (PyCFunction) Ndef_encode, METH_VARARGS | METH_KEYWORDS, "Encode record dicts as an NDEF TLV area. Returns bytes, or writes into buffer and returns the length."}
+    ,
+    {NULL}                      /* Sentinel */
+};
+
+int Ndef_AddToModule(PyObject *module)
+{
+    PyMethodDef *def;
+
+    for (def = Ndef_methods; def->ml_name != NULL; def++) {
+        PyObject *func = PyCFunction_NewEx(def, NULL, NULL);
+
+        if (func == NULL || PyModule_AddObject(module, def->ml_name, func) < 0) {
+            return -1;
+        }
+    }
+
+    PyModule_AddIntConstant(module, "TNF_EMPTY", NDEF_TNF_EMPTY);
+    PyModule_AddIntConstant(module, "TNF_WELL_KNOWN", NDEF_TNF_WELL_KNOWN);
+    PyModule_AddIntConstant(module, "TNF_MIME", NDEF_TNF_MIME);
+    PyModule_AddIntConstant(module, "TNF_URI", NDEF_TNF_URI);
+    PyModule_AddIntConstant(module, "TNF_EXTERNAL", NDEF_TNF_EXTERNAL);
+    PyModule_AddIntConstant(module, "TNF_UNKNOWN", NDEF_TNF_UNKNOWN);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef NDEF_PY_H
+#define NDEF_PY_H
+/*
+ * Python side of the NDEF support: records as dicts, and the module level
+ * ndef_parse/ndef_encode functions.
+ *
+ * A record is a dict with tnf, type (str), id (bytes or None) and payload.
+ * Text records also have text and lang, URI records uri. For encoding, a dict
+ * with text or uri is enough, anything else needs tnf, type and payload.
+ */
+
+#include <Python.h>
+#include "ndef.h"
+
+/*
+ * Records of the message at base[offset:offset + length]. base must be the
+ * buffer of owner, payloads are memoryviews into it. Malformed records raise
+ * error.
+ */
+PyObject *Ndef_ToList(PyObject *owner, const uint8_t *base, size_t offset, size_t length, PyObject *error);
+
+/*
+ * Encode records as an NDEF TLV followed by a terminator TLV. Returns the
+ * number of bytes written, or -1 with an exception set (OverflowError if it
+ * does not fit in cap).
+ */
+Py_ssize_t Ndef_Encode(PyObject *records, uint8_t *out, size_t cap);
+
+/* Add ndef_parse and ndef_encode to the extension module */
+int Ndef_AddToModule(PyObject *module);
+
+#endif // NDEF_PY_H
@@ -1,288 +1,366 @@
-#ifndef NXP_HELPERS_H
-#define NXP_HELPERS_H
-
-#include <Python.h>
-#include <stdio.h>
-
-#define TX_RX_BUFFER_SIZE           128 // 128 Byte buffer
-#define DATA_BUFFER_LEN             16  /* Buffer length */
-#define MFC_BLOCK_DATA_SIZE         4   /* Block Data size - 16 Bytes */
-#define PHAL_MFC_VERSION_LENGTH     0x08 // from src/phalMFC_Int.h
-
-/*******************************************************************************
-**   Global Variable Declaration
-*******************************************************************************/
-phbalReg_Stub_DataParams_t sBalReader;  /* BAL component holder */
-
-/*
- * HAL variables
- */
-phhalHw_Nfc_Ic_DataParams_t sHal_Nfc_Ic;        /* HAL component holder for Nfc Ic's */
-void *pHal;                     /* HAL pointer */
-uint8_t bHalBufferTx[TX_RX_BUFFER_SIZE];        /* HAL TX buffer */
-uint8_t bHalBufferRx[TX_RX_BUFFER_SIZE];        /* HAL RX buffer */
-
-/*
- * PAL variables
- */
-phpalI14443p3a_Sw_DataParams_t spalI14443p3a;   /* PAL I14443-A component */
-phpalI14443p4a_Sw_DataParams_t spalI14443p4a;   /* PAL ISO I14443-4A component */
-phpalI14443p3b_Sw_DataParams_t spalI14443p3b;   /* PAL ISO I14443-B component */
-phpalI14443p4_Sw_DataParams_t spalI14443p4;     /* PAL ISO I14443-4 component */
-phpalMifare_Sw_DataParams_t spalMifare; /* PAL MIFARE component */
-
-phacDiscLoop_Sw_DataParams_t sDiscLoop; /* Discovery loop component */
-phalMfc_Sw_DataParams_t salMfc; /* MIFARE Classic parameter structure */
-
-uint8_t bDataBuffer[DATA_BUFFER_LEN];   /* universal data buffer */
-
-/** General information bytes to be sent with ATR */
-const uint8_t GI[] = { 0x46, 0x66, 0x6D,
-    0x01, 0x01, 0x10, /*VERSION*/ 0x03, 0x02, 0x00, 0x01, /*WKS*/ 0x04, 0x01, 0xF1 /*LTO*/
-};
-
-static uint8_t aData[50];       /* ATR response holder */
-
-
-static phStatus_t LoadProfile(void)
-{
-    phStatus_t status = PH_ERR_SUCCESS;
-
-    sDiscLoop.pPal1443p3aDataParams = &spalI14443p3a;
-    sDiscLoop.pPal1443p3bDataParams = &spalI14443p3b;
-    sDiscLoop.pPal1443p4aDataParams = &spalI14443p4a;
-    sDiscLoop.pPal14443p4DataParams = &spalI14443p4;
-    sDiscLoop.pHalDataParams = &sHal_Nfc_Ic.sHal;
-
-    /*
-     * These lines are added just to SIGSEG fault when non 14443-3 card is detected
-     */
-    /*
-     * Assign the GI for Type A
-     */
-    sDiscLoop.sTypeATargetInfo.sTypeA_P2P.pGi = (uint8_t *) GI;
-    sDiscLoop.sTypeATargetInfo.sTypeA_P2P.bGiLength = sizeof(GI);
-    /*
-     * Assign the GI for Type F
-     */
-    sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.pGi = (uint8_t *) GI;
-    sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.bGiLength = sizeof(GI);
-    /*
-     * Assign ATR response for Type A
-     */
-    sDiscLoop.sTypeATargetInfo.sTypeA_P2P.pAtrRes = aData;
-    /*
-     * Assign ATR response for Type F
-     */
-    sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.pAtrRes = aData;
-    /*
-     * Assign ATS buffer for Type A
-     */
-    sDiscLoop.sTypeATargetInfo.sTypeA_I3P4.pAts = aData;
-    /*
-     ******************************************************************************************** */
-
-    /*
-     * Passive Bailout bitmap configuration
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_BAIL_OUT, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Passive poll bitmap configuration. Poll for only Type A Tags.
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_PAS_POLL_TECH_CFG, PHAC_DISCLOOP_POS_BIT_MASK_A);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Turn OFF Passive Listen.
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_PAS_LIS_TECH_CFG, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Turn OFF active listen.
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_ACT_LIS_TECH_CFG, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Turn OFF Active Poll
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_ACT_POLL_TECH_CFG, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Disable LPCD feature.
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_ENABLE_LPCD, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * reset collision Pending
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_COLLISION_PENDING, PH_OFF);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * whether anti-collision is supported or not.
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_ANTI_COLL, PH_ON);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Device limit for Type A
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_TYPEA_DEVICE_LIMIT, PH_ON);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Discovery loop Operation mode
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_OPE_MODE, RD_LIB_MODE_NFC);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Bailout on Type A detect
-     */
-    status = phacDiscLoop_SetConfig(&sDiscLoop, PHAC_DISCLOOP_CONFIG_BAIL_OUT, PHAC_DISCLOOP_POS_BIT_MASK_A);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Return Status
-     */
-    return status;
-}
-
-
-phStatus_t NfcRdLibInit(void)
-{
-    phStatus_t status;
-
-    /*
-     * Initialize the Reader BAL (Bus Abstraction Layer) component
-     */
-    status = phbalReg_Stub_Init(&sBalReader, sizeof(phbalReg_Stub_DataParams_t));
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the OSAL Events.
-     */
-    status = phOsal_Event_Init();
-    PH_CHECK_SUCCESS(status);
-
-    // Start interrupt thread
-    Set_Interrupt();
-
-    /*
-     * Set HAL type in BAL
-     */
-#ifdef NXPBUILD__PHHAL_HW_PN5180
-    status = phbalReg_SetConfig(&sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_PN5180);
-#endif
-#ifdef NXPBUILD__PHHAL_HW_RC523
-    status = phbalReg_SetConfig(&sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_RC523);
-#endif
-#ifdef NXPBUILD__PHHAL_HW_RC663
-    status = phbalReg_SetConfig(&sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_RC663);
-#endif
-    PH_CHECK_SUCCESS(status);
-
-    status = phbalReg_SetPort(&sBalReader, (uint8_t *) SPI_CONFIG);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Open BAL
-     */
-    status = phbalReg_OpenPort(&sBalReader);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the Reader HAL (Hardware Abstraction Layer) component
-     */
-    status = phhalHw_Nfc_IC_Init(&sHal_Nfc_Ic,
-                                 sizeof(phhalHw_Nfc_Ic_DataParams_t),
-                                 &sBalReader,
-                                 0, bHalBufferTx, sizeof(bHalBufferTx), bHalBufferRx, sizeof(bHalBufferRx));
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Set the parameter to use the SPI interface
-     */
-    sHal_Nfc_Ic.sHal.bBalConnectionType = PHHAL_HW_BAL_CONNECTION_SPI;
-
-    Configure_Device(&sHal_Nfc_Ic);
-
-    /*
-     * Set the generic pointer
-     */
-    pHal = &sHal_Nfc_Ic.sHal;
-
-    /*
-     * Initializing specific objects for the communication with MIFARE (R) Classic cards. The MIFARE (R) Classic card
-     * is compliant of ISO 14443-3 and ISO 14443-4
-     */
-
-    /*
-     * Initialize the I14443-A PAL layer
-     */
-    status = phpalI14443p3a_Sw_Init(&spalI14443p3a, sizeof(phpalI14443p3a_Sw_DataParams_t), &sHal_Nfc_Ic.sHal);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the I14443-A PAL component
-     */
-    status = phpalI14443p4a_Sw_Init(&spalI14443p4a, sizeof(phpalI14443p4a_Sw_DataParams_t), &sHal_Nfc_Ic.sHal);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the I14443-4 PAL component
-     */
-    status = phpalI14443p4_Sw_Init(&spalI14443p4, sizeof(phpalI14443p4_Sw_DataParams_t), &sHal_Nfc_Ic.sHal);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the I14443-B PAL component
-     */
-    status = phpalI14443p3b_Sw_Init(&spalI14443p3b, sizeof(phpalI14443p3b_Sw_DataParams_t), &sHal_Nfc_Ic.sHal);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the MIFARE PAL component
-     */
-    status = phpalMifare_Sw_Init(&spalMifare, sizeof(phpalMifare_Sw_DataParams_t), &sHal_Nfc_Ic.sHal, NULL);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Initialize the discover component
-     */
-    status = phacDiscLoop_Sw_Init(&sDiscLoop, sizeof(phacDiscLoop_Sw_DataParams_t), &sHal_Nfc_Ic.sHal);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Load profile for Discovery loop
-     */
-    status = LoadProfile();
-    PH_CHECK_SUCCESS(status);
-
-    status = phalMfc_Sw_Init(&salMfc, sizeof(phalMfc_Sw_DataParams_t), &spalMifare, NULL);
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Read the version of the reader IC
-     */
-#if defined NXPBUILD__PHHAL_HW_RC523
-    status = phhalHw_Rc523_ReadRegister(&sHal_Nfc_Ic.sHal, PHHAL_HW_RC523_REG_VERSION, &bDataBuffer[0]);
-#endif
-#if defined NXPBUILD__PHHAL_HW_RC663
-    status = phhalHw_Rc663_ReadRegister(&sHal_Nfc_Ic.sHal, PHHAL_HW_RC663_REG_VERSION, &bDataBuffer[0]);
-#endif
-    PH_CHECK_SUCCESS(status);
-
-    /*
-     * Return Success
-     */
-    return PH_ERR_SUCCESS;
-}
-
-#endif
+#ifndef NXP_HELPERS_H
+#define NXP_HELPERS_H
+
+#include <Python.h>
+#include <stdio.h>
+
+#ifdef NXPPY_SIMULATOR
+#include "sim_bal.h"
+#endif
+
+#define MFC_BLOCK_DATA_SIZE         4   /* Block Data size - 16 Bytes */
+
+#define MFUL_PAGE_SIZE              4   /* Type 2 tag page size */
+#define MFUL_READ_PAGES             4   /* Pages returned by one READ command */
+#define MFUL_FAST_READ_MAX_PAGES    15  /* Largest FAST_READ answer that fits the PN512 FIFO */
+#define MFUL_MAX_PAGES              256 /* Page addresses are a single byte */
+#define NDEF_CC_PAGE                3   /* Capability container */
+#define NDEF_DATA_PAGE              4   /* First page of the NDEF data area */
+
+
+/*******************************************************************************
+**   Global Variable Declaration
+*******************************************************************************/
+
+/*
+ * The Reader Library's Linux platform code still links against a single HAL
+ * pointer. Each reader has its own in nfc_data, this one just tracks the most
+ * recently initialised.
+ */
+void *pHal;
+
+/** General information bytes to be sent with ATR */
+const uint8_t GI[] = { 0x46, 0x66, 0x6D,
+    0x01, 0x01, 0x10, /*VERSION*/ 0x03, 0x02, 0x00, 0x01, /*WKS*/ 0x04, 0x01, 0xF1 /*LTO*/
+};
+
+/* The OSAL event group is process wide, set up by the first reader */
+static pthread_once_t sOsalOnce = PTHREAD_ONCE_INIT;
+static phStatus_t sOsalStatus;
+
+static void osal_init(void)
+{
+    sOsalStatus = phOsal_Event_Init();
+}
+
+/*
+ * Every HAL waits for its PN512 on the one RF event of that group, so one
+ * reader's IRQ could wake, or be taken by, another reader's wait. RF is
+ * therefore serialized across readers: sRfLock is held along with the reader
+ * lock, and only the reader holding it gets its IRQs through. Readers still
+ * run side by side apart from the time they spend talking to their PN512.
+ */
+static pthread_mutex_t sRfLock = PTHREAD_MUTEX_INITIALIZER;
+static nfc_data *volatile sRfOwner;
+
+static void reader_lock(nfc_data *nfc)
+{
+    pthread_mutex_lock(&nfc->lock);
+    pthread_mutex_lock(&sRfLock);
+    sRfOwner = nfc;
+}
+
+static void reader_unlock(nfc_data *nfc)
+{
+    sRfOwner = NULL;
+    pthread_mutex_unlock(&sRfLock);
+    pthread_mutex_unlock(&nfc->lock);
+}
+
+#ifndef NXPPY_SIMULATOR
+/* Runs on the reader's IRQ thread, see Platform_StartIrq */
+static void reader_irq(void *ctx)
+{
+    phhalHw_Rc523_DataParams_t *hal = &((nfc_data *) ctx)->sHal_Nfc_Ic.sHal;
+
+    // nothing of this reader waits on the RF event unless it holds sRfLock
+    if (sRfOwner == ctx && hal->pRFISRCallback != NULL) {
+        hal->pRFISRCallback(hal);
+    }
+}
+#endif
+
+/*
+ * Configure the discovery loop from nfc->profile. Only changes settings, so
+ * it can run again on a reader that is up, see configure_discovery().
+ */
+static phStatus_t LoadProfile(nfc_data *nfc)
+{
+    phStatus_t status = PH_ERR_SUCCESS;
+
+    nfc->sDiscLoop.pPal1443p3aDataParams = &nfc->spalI14443p3a;
+    nfc->sDiscLoop.pPal1443p3bDataParams = &nfc->spalI14443p3b;
+#ifdef NXPBUILD__PHPAL_FELICA_SW
+    nfc->sDiscLoop.pPalFelicaDataParams = &nfc->spalFelica;
+#endif
+    nfc->sDiscLoop.pPal1443p4aDataParams = &nfc->spalI14443p4a;
+    nfc->sDiscLoop.pPal14443p4DataParams = &nfc->spalI14443p4;
+    nfc->sDiscLoop.pHalDataParams = &nfc->sHal_Nfc_Ic.sHal;
+
+    /*
+     * These lines are added just to SIGSEG fault when non 14443-3 card is detected
+     */
+    /*
+     * Assign the GI for Type A
+     */
+    nfc->sDiscLoop.sTypeATargetInfo.sTypeA_P2P.pGi = (uint8_t *) GI;
+    nfc->sDiscLoop.sTypeATargetInfo.sTypeA_P2P.bGiLength = sizeof(GI);
+    /*
+     * Assign the GI for Type F
+     */
+    nfc->sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.pGi = (uint8_t *) GI;
+    nfc->sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.bGiLength = sizeof(GI);
+    /*
+     * Assign ATR response for Type A
+     */
+    nfc->sDiscLoop.sTypeATargetInfo.sTypeA_P2P.pAtrRes = nfc->aData;
+    /*
+     * Assign ATR response for Type F
+     */
+    nfc->sDiscLoop.sTypeFTargetInfo.sTypeF_P2P.pAtrRes = nfc->aData;
+    /*
+     * Assign ATS buffer for Type A
+     */
+    nfc->sDiscLoop.sTypeATargetInfo.sTypeA_I3P4.pAts = nfc->aData;
+    /*
+     ******************************************************************************************** */
+
+    /*
+     * Passive Bailout bitmap configuration
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_BAIL_OUT, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Passive poll bitmap configuration, Type A only unless the profile says otherwise.
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_PAS_POLL_TECH_CFG, nfc->profile.tech);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Guard times between field on and the first poll command of each technology
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_GTA_VALUE_US, nfc->profile.guardAUs);
+    PH_CHECK_SUCCESS(status);
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_GTB_VALUE_US, nfc->profile.guardBUs);
+    PH_CHECK_SUCCESS(status);
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_GTF_VALUE_US, nfc->profile.guardFUs);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Turn OFF Passive Listen.
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_PAS_LIS_TECH_CFG, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Turn OFF active listen.
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_ACT_LIS_TECH_CFG, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Turn OFF Active Poll
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_ACT_POLL_TECH_CFG, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Disable LPCD feature. The RC523 HAL has none, low-power polling is done
+     * in software instead (see lpcd_probe in Mifare.c).
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_ENABLE_LPCD, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * reset collision Pending
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_COLLISION_PENDING, PH_OFF);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * whether anti-collision is supported or not.
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_ANTI_COLL, PH_ON);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Device limit for Type A
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_TYPEA_DEVICE_LIMIT, nfc->profile.deviceLimit);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Ask ISO14443-4 tags for the largest frames the HAL buffers take
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_TYPEA_I3P4_FSDI, ISO_DEP_FSDI);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Discovery loop Operation mode
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_OPE_MODE, nfc->profile.mode);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Bailout on detecting these, Type A by default
+     */
+    status = phacDiscLoop_SetConfig(&nfc->sDiscLoop, PHAC_DISCLOOP_CONFIG_BAIL_OUT, nfc->profile.bailOut);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Return Status
+     */
+    return status;
+}
+
+
+phStatus_t NfcRdLibInit(nfc_data *nfc)
+{
+    phStatus_t status;
+
+    /*
+     * Initialize the Reader BAL (Bus Abstraction Layer) component
+     */
+    status = phbalReg_Stub_Init(&nfc->sBalReader, sizeof(phbalReg_Stub_DataParams_t));
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the OSAL Events.
+     */
+    pthread_once(&sOsalOnce, osal_init);
+    status = sOsalStatus;
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Set HAL type in BAL
+     */
+#ifdef NXPBUILD__PHHAL_HW_PN5180
+    status = phbalReg_SetConfig(&nfc->sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_PN5180);
+#endif
+#ifdef NXPBUILD__PHHAL_HW_RC523
+    status = phbalReg_SetConfig(&nfc->sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_RC523);
+#endif
+#ifdef NXPBUILD__PHHAL_HW_RC663
+    status = phbalReg_SetConfig(&nfc->sBalReader, PHBAL_REG_CONFIG_HAL_HW_TYPE, PHBAL_REG_HAL_HW_RC663);
+#endif
+    PH_CHECK_SUCCESS(status);
+
+    status = phbalReg_SetPort(&nfc->sBalReader, (uint8_t *) nfc->platform.spiDevice);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Open BAL
+     */
+    status = phbalReg_OpenPort(&nfc->sBalReader);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the Reader HAL (Hardware Abstraction Layer) component
+     */
+    status = phhalHw_Nfc_IC_Init(&nfc->sHal_Nfc_Ic,
+                                 sizeof(phhalHw_Nfc_Ic_DataParams_t),
+                                 &nfc->sBalReader,
+                                 0, nfc->bHalBufferTx, sizeof(nfc->bHalBufferTx), nfc->bHalBufferRx, sizeof(nfc->bHalBufferRx));
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Set the parameter to use the SPI interface
+     */
+    nfc->sHal_Nfc_Ic.sHal.bBalConnectionType = PHHAL_HW_BAL_CONNECTION_SPI;
+
+#ifndef NXPPY_SIMULATOR
+    Configure_Device(&nfc->sHal_Nfc_Ic);
+#endif
+
+    /*
+     * Set the generic pointer
+     */
+    nfc->pHal = &nfc->sHal_Nfc_Ic.sHal;
+    pHal = nfc->pHal;
+
+    // Start interrupt thread
+#ifdef NXPPY_SIMULATOR
+    SimBal_Set_Interrupt(nfc->platform.spiDevice, nfc->pHal);
+#else
+    if (Platform_StartIrq(&nfc->platform, reader_irq, nfc) != 0) {
+        return PH_ADD_COMPCODE(PH_ERR_RESOURCE_ERROR, PH_COMP_BAL);
+    }
+#endif
+
+    /*
+     * Initializing specific objects for the communication with MIFARE (R) Classic cards. The MIFARE (R) Classic card
+     * is compliant of ISO 14443-3 and ISO 14443-4
+     */
+
+    /*
+     * Initialize the I14443-A PAL layer
+     */
+    status = phpalI14443p3a_Sw_Init(&nfc->spalI14443p3a, sizeof(phpalI14443p3a_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the I14443-A PAL component
+     */
+    status = phpalI14443p4a_Sw_Init(&nfc->spalI14443p4a, sizeof(phpalI14443p4a_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the I14443-4 PAL component
+     */
+    status = phpalI14443p4_Sw_Init(&nfc->spalI14443p4, sizeof(phpalI14443p4_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the I14443-B PAL component
+     */
+    status = phpalI14443p3b_Sw_Init(&nfc->spalI14443p3b, sizeof(phpalI14443p3b_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+
+#ifdef NXPBUILD__PHPAL_FELICA_SW
+    /*
+     * Initialize the FeliCa PAL component
+     */
+    status = phpalFelica_Sw_Init(&nfc->spalFelica, sizeof(phpalFelica_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+#endif
+
+    /*
+     * Initialize the MIFARE PAL component
+     */
+    status = phpalMifare_Sw_Init(&nfc->spalMifare, sizeof(phpalMifare_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal, NULL);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Initialize the discover component
+     */
+    status = phacDiscLoop_Sw_Init(&nfc->sDiscLoop, sizeof(phacDiscLoop_Sw_DataParams_t), &nfc->sHal_Nfc_Ic.sHal);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Load profile for Discovery loop
+     */
+    status = LoadProfile(nfc);
+    PH_CHECK_SUCCESS(status);
+
+    status = phalMfc_Sw_Init(&nfc->salMfc, sizeof(phalMfc_Sw_DataParams_t), &nfc->spalMifare, NULL);
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Read the version of the reader IC
+     */
+#if defined NXPBUILD__PHHAL_HW_RC523
+    status = phhalHw_Rc523_ReadRegister(&nfc->sHal_Nfc_Ic.sHal, PHHAL_HW_RC523_REG_VERSION, &nfc->bDataBuffer[0]);
+#endif
+#if defined NXPBUILD__PHHAL_HW_RC663
+    status = phhalHw_Rc663_ReadRegister(&nfc->sHal_Nfc_Ic.sHal, PHHAL_HW_RC663_REG_VERSION, &nfc->bDataBuffer[0]);
+#endif
+    PH_CHECK_SUCCESS(status);
+
+    /*
+     * Return Success
+     */
+    return PH_ERR_SUCCESS;
+}
+
+#endif
@@ -1,5 +1,10 @@
 #include <Python.h>
 #include "Mifare.h"
+#include "ndef_py.h"
+
+#ifdef NXPPY_SIMULATOR
+#include "sim_bal.h"
+#endif
 
 PyObject *InitError;
 PyObject *SelectError;
@@ -10,13 +15,20 @@ PyObject *WriteError;
  * ########################################################### # Python Extension definitions
  * ###########################################################
  */
+PyMethodDef nxppy_methods[] = {
+    {"_stop_all_polling", (PyCFunction) Mifare_stop_all_polling, METH_NOARGS, "Stop the pollers of every reader, run at exit."}
+    ,
+    {NULL, NULL}
+    ,
+};
+
 #if PY_MAJOR_VERSION >= 3
 static struct PyModuleDef moduledef = {
     PyModuleDef_HEAD_INIT,
     "nxppy._mifare",
     NULL,
     0,
-    NULL,
+    nxppy_methods,
     NULL,
     NULL,
     NULL,
@@ -29,17 +41,12 @@ PyObject *PyInit__mifare(void)
 #else
 #define INITERROR return
 
-PyMethodDef nxppy_methods[] = {
-    {NULL, NULL}
-    ,
-};
-
 void init_mifare(void)
 #endif
 {
     PyObject *module;
+    PyObject *errorAttributes;
 
-    MifareType.tp_new = PyType_GenericNew;
     if (PyType_Ready(&MifareType) < 0) {
         INITERROR;
     }
@@ -56,21 +63,63 @@ void init_mifare(void)
     Py_INCREF(&MifareType);
     PyModule_AddObject(module, "Mifare", (PyObject *) & MifareType);
 
-    InitError = PyErr_NewException("nxppy._mifare.InitError", NULL, NULL);
+    // status, component and code are set on errors raised by the Reader Library
+    errorAttributes = Py_BuildValue("{s:O, s:O, s:O}", "status", Py_None, "component", Py_None, "code", Py_None);
+    if (errorAttributes == NULL)
+        INITERROR;
+
+    InitError = PyErr_NewException("nxppy._mifare.InitError", NULL, errorAttributes);
     Py_INCREF(InitError);
     PyModule_AddObject(module, "InitError", InitError);
 
-    SelectError = PyErr_NewException("nxppy._mifare.SelectError", NULL, NULL);
+    SelectError = PyErr_NewException("nxppy._mifare.SelectError", NULL, errorAttributes);
     Py_INCREF(SelectError);
     PyModule_AddObject(module, "SelectError", SelectError);
 
-    ReadError = PyErr_NewException("nxppy._mifare.ReadError", NULL, NULL);
+    ReadError = PyErr_NewException("nxppy._mifare.ReadError", NULL, errorAttributes);
     Py_INCREF(ReadError);
     PyModule_AddObject(module, "ReadError", ReadError);
 
-    WriteError = PyErr_NewException("nxppy._mifare.WriteError", NULL, NULL);
+    WriteError = PyErr_NewException("nxppy._mifare.WriteError", NULL, errorAttributes);
     Py_INCREF(WriteError);
     PyModule_AddObject(module, "WriteError", WriteError);
+    Py_DECREF(errorAttributes);
+
+    // the code attribute of the errors seen most often
+    PyModule_AddIntConstant(module, "ERR_IO_TIMEOUT", PH_ERR_IO_TIMEOUT);
+    PyModule_AddIntConstant(module, "ERR_INTEGRITY", PH_ERR_INTEGRITY_ERROR);
+    PyModule_AddIntConstant(module, "ERR_COLLISION", PH_ERR_COLLISION_ERROR);
+    PyModule_AddIntConstant(module, "ERR_PROTOCOL", PH_ERR_PROTOCOL_ERROR);
+    PyModule_AddIntConstant(module, "ERR_AUTH", PH_ERR_AUTH_ERROR);
+    PyModule_AddIntConstant(module, "ERR_NO_TAG", PHAC_DISCLOOP_NO_TECH_DETECTED);
+
+    PyModule_AddIntConstant(module, "OP_SELECT", OP_SELECT);
+    PyModule_AddIntConstant(module, "OP_READ", OP_READ);
+    PyModule_AddIntConstant(module, "OP_WRITE", OP_WRITE);
+    PyModule_AddIntConstant(module, "OP_GET_VERSION", OP_GET_VERSION);
+
+    PyModule_AddIntConstant(module, "KEY_A", PHHAL_HW_MFC_KEYA);
+    PyModule_AddIntConstant(module, "KEY_B", PHHAL_HW_MFC_KEYB);
+
+    PyModule_AddIntConstant(module, "TECH_A", TECH_A);
+    PyModule_AddIntConstant(module, "TECH_B", TECH_B);
+    PyModule_AddIntConstant(module, "TECH_F", TECH_F);
+    PyModule_AddIntConstant(module, "TECH_V", TECH_V);
+    PyModule_AddIntConstant(module, "MODE_NFC", RD_LIB_MODE_NFC);
+    PyModule_AddIntConstant(module, "MODE_EMVCO", RD_LIB_MODE_EMVCO);
+
+    if (Ndef_AddToModule(module) < 0) {
+        INITERROR;
+    }
+
+#ifdef NXPPY_SIMULATOR
+    PyModule_AddIntConstant(module, "SIMULATOR", 1);
+    if (SimBal_AddToModule(module) < 0) {
+        INITERROR;
+    }
+#else
+    PyModule_AddIntConstant(module, "SIMULATOR", 0);
+#endif
 
 #if PY_MAJOR_VERSION >= 3
     return module;
@@ -0,0 +1,102 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+/*
+ * Read-through cache of Type 2 tag pages, attached to a reader.
+ *
+ * Holds the pages of one tag, identified by its UID. Pages are filled by
+ * whatever reads them (single READs, FAST_READ ranges, dumps) and a page is
+ * dropped as soon as anything is written to it, whether or not the write
+ * succeeded. The whole cache is dropped whenever the tag may have left the
+ * field: the RF field was reset, a presence check failed or another tag was
+ * activated.
+ *
+ * Only the owning reader touches it, with its lock held.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define PAGE_CACHE_PAGE_SIZE        4
+#define PAGE_CACHE_MAX_PAGES        256     /* Page addresses are a single byte */
+#define PAGE_CACHE_MAX_UID          10
+
+typedef struct {
+    uint8_t enabled;
+    uint8_t uid[PAGE_CACHE_MAX_UID];        /* tag the pages belong to */
+    uint8_t uidLen;                         /* 0 while the cache holds nothing */
+    uint8_t valid[PAGE_CACHE_MAX_PAGES / 8];
+    uint8_t data[PAGE_CACHE_MAX_PAGES * PAGE_CACHE_PAGE_SIZE];
+
+    /* Counters, in pages */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} PageCache_t;
+
+static inline void page_cache_drop(PageCache_t *cache)
+{
+    cache->uidLen = 0;
+    memset(cache->valid, 0, sizeof(cache->valid));
+}
+
+/* Make uid the tag the cache is for, dropping what it held for any other tag */
+static inline void page_cache_bind(PageCache_t *cache, const uint8_t *uid, uint8_t uidLen)
+{
+    if (uidLen > PAGE_CACHE_MAX_UID) {
+        uidLen = 0;
+    }
+    if (cache->uidLen == uidLen && memcmp(cache->uid, uid, uidLen) == 0) {
+        return;
+    }
+
+    page_cache_drop(cache);
+    memcpy(cache->uid, uid, uidLen);
+    cache->uidLen = uidLen;
+}
+
+/* Nonzero if the cache may serve reads for the tag with this UID */
+static inline int page_cache_usable(const PageCache_t *cache, const uint8_t *uid, uint8_t uidLen)
+{
+    return cache->enabled && uidLen && cache->uidLen == uidLen && memcmp(cache->uid, uid, uidLen) == 0;
+}
+
+static inline int page_cache_has(const PageCache_t *cache, uint16_t page)
+{
+    return page < PAGE_CACHE_MAX_PAGES && (cache->valid[page / 8] & (1 << (page % 8)));
+}
+
+/* Copy count pages starting at page into the cache */
+static inline void page_cache_fill(PageCache_t *cache, uint16_t page, const uint8_t *data, uint16_t count)
+{
+    uint16_t i;
+
+    if (!cache->enabled || !cache->uidLen) {
+        return;
+    }
+
+    for (i = 0; i < count && page + i < PAGE_CACHE_MAX_PAGES; i++) {
+        memcpy(&cache->data[(page + i) * PAGE_CACHE_PAGE_SIZE], &data[i * PAGE_CACHE_PAGE_SIZE], PAGE_CACHE_PAGE_SIZE);
+        cache->valid[(page + i) / 8] |= 1 << ((page + i) % 8);
+    }
+}
+
+static inline void page_cache_invalidate(PageCache_t *cache, uint16_t page)
+{
+    if (page_cache_has(cache, page)) {
+        cache->valid[page / 8] &= ~(1 << (page % 8));
+        cache->invalidations++;
+    }
+}
+
+static inline uint16_t page_cache_count(const PageCache_t *cache)
+{
+    uint16_t count = 0;
+    uint16_t page;
+
+    for (page = 0; page < PAGE_CACHE_MAX_PAGES; page++) {
+        count += page_cache_has(cache, page) ? 1 : 0;
+    }
+    return count;
+}
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,429 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "platform.h"
+
+#define GPIO_PATH                   "/sys/class/gpio"
+#define RESET_PULSE_US              1000
+#define OSCILLATOR_STARTUP_US       5000
+#define MAX_EDGE_LATENCY_NS         1000000000ULL   /* older than this, the timestamp is on another clock */
+
+/*******************************************************************************
+** sysfs GPIO
+*******************************************************************************/
+
+static int gpio_write(int gpio, const char *attribute, const char *value)
+{
+    char path[PLATFORM_MAX_PATH];
+    ssize_t written;
+    int fd;
+
+    if (gpio < 0) {
+        snprintf(path, sizeof(path), GPIO_PATH "/%s", attribute);
+    } else {
+        snprintf(path, sizeof(path), GPIO_PATH "/gpio%d/%s", gpio, attribute);
+    }
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    written = write(fd, value, strlen(value));
+    close(fd);
+
+    return written == (ssize_t) strlen(value) ? 0 : -1;
+}
+
+static int gpio_export(int gpio, const char *direction, const char *edge)
+{
+    char number[16];
+    int attempt;
+
+    snprintf(number, sizeof(number), "%d", gpio);
+    if (gpio_write(-1, "export", number) != 0 && errno != EBUSY) {
+        return -1;
+    }
+
+    // udev needs a moment to hand the new files over to the gpio group
+    for (attempt = 0; gpio_write(gpio, "direction", direction) != 0; attempt++) {
+        if (attempt == 20) {
+            return -1;
+        }
+        usleep(10000);
+    }
+
+    return edge != NULL ? gpio_write(gpio, "edge", edge) : 0;
+}
+
+static int gpio_open_value(int gpio)
+{
+    char path[PLATFORM_MAX_PATH];
+
+    snprintf(path, sizeof(path), GPIO_PATH "/gpio%d/value", gpio);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+/*******************************************************************************
+** GPIO character device
+*******************************************************************************/
+
+/* Returns a line event fd for rising edges of gpio, or -1 with errno set */
+static int gpiochip_request_edges(int gpio)
+{
+    struct gpioevent_request request;
+    int chip;
+    int ret;
+
+    chip = open(PLATFORM_GPIO_CHIP, O_RDONLY | O_CLOEXEC);
+    if (chip < 0) {
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = gpio;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(request.consumer_label, "nxppy irq", sizeof(request.consumer_label) - 1);
+
+    ret = ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &request);
+    close(chip);
+
+    return ret < 0 ? -1 : request.fd;
+}
+
+/*
+ * Nanoseconds from a kernel event timestamp to now. Kernels before 5.7 stamp
+ * line events with CLOCK_REALTIME, later ones with CLOCK_MONOTONIC. Returns
+ * 0 if neither gives a sensible answer.
+ */
+static uint64_t edge_latency(uint64_t timestampNs)
+{
+    static const clockid_t clocks[] = { CLOCK_MONOTONIC, CLOCK_REALTIME };
+    struct timespec now;
+    uint64_t nowNs;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+        clock_gettime(clocks[i], &now);
+        nowNs = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+        if (timestampNs <= nowNs && nowNs - timestampNs < MAX_EDGE_LATENCY_NS) {
+            return nowNs - timestampNs;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+** Reader platform
+*******************************************************************************/
+
+void Platform_Init(Platform_t *platform)
+{
+    memset(platform, 0, sizeof(*platform));
+    platform->irqFd = -1;
+    platform->raiseFd = -1;
+    platform->stopFd = -1;
+    platform->epollFd = -1;
+    pthread_mutex_init(&platform->statsLock, NULL);
+}
+
+void Platform_Destroy(Platform_t *platform)
+{
+    // an IRQ thread that would not stop still takes the lock
+    if (Platform_Close(platform) == 0) {
+        pthread_mutex_destroy(&platform->statsLock);
+    }
+}
+
+int Platform_Open(Platform_t *platform, const char *spiDevice, int resetGpio, int irqGpio)
+{
+    if (Platform_Close(platform) != 0) {
+        return -1;
+    }
+    platform->resetGpio = resetGpio;
+    platform->irqGpio = irqGpio;
+
+    if (strlen(spiDevice) >= sizeof(platform->spiDevice)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(platform->spiDevice, spiDevice);
+
+    if (resetGpio >= 0 && gpio_export(resetGpio, "high", NULL) != 0) {
+        return -1;
+    }
+
+    platform->irqFd = gpiochip_request_edges(irqGpio);
+    if (platform->irqFd >= 0) {
+        platform->irqSource = PLATFORM_IRQ_CHARDEV;
+    } else {
+        // kernels without the character device, or a line sysfs already holds
+        if (gpio_export(irqGpio, "in", "rising") != 0) {
+            return -1;
+        }
+        platform->irqFd = gpio_open_value(irqGpio);
+        if (platform->irqFd < 0) {
+            return -1;
+        }
+        platform->irqSource = PLATFORM_IRQ_SYSFS;
+    }
+
+    platform->stopFd = eventfd(0, EFD_CLOEXEC);
+    if (platform->stopFd < 0) {
+        Platform_Close(platform);
+        return -1;
+    }
+
+    return 0;
+}
+
+int Platform_OpenStandIn(Platform_t *platform)
+{
+    int fds[2];
+
+    if (Platform_Close(platform) != 0) {
+        return -1;
+    }
+    platform->resetGpio = -1;
+    platform->irqGpio = -1;
+
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    platform->irqFd = fds[0];
+    platform->raiseFd = fds[1];
+    platform->irqSource = PLATFORM_IRQ_PIPE;
+
+    platform->stopFd = eventfd(0, EFD_CLOEXEC);
+    if (platform->stopFd < 0) {
+        Platform_Close(platform);
+        return -1;
+    }
+
+    return 0;
+}
+
+int Platform_Close(Platform_t *platform)
+{
+    if (Platform_StopIrq(platform) != 0) {
+        return -1;
+    }
+
+    if (platform->irqFd >= 0) {
+        close(platform->irqFd);
+        platform->irqFd = -1;
+    }
+    if (platform->raiseFd >= 0) {
+        close(platform->raiseFd);
+        platform->raiseFd = -1;
+    }
+    if (platform->stopFd >= 0) {
+        close(platform->stopFd);
+        platform->stopFd = -1;
+    }
+    platform->irqSource = PLATFORM_IRQ_NONE;
+    return 0;
+}
+
+int Platform_RaiseIrq(Platform_t *platform)
+{
+    uint64_t now = reader_stats_now();
+
+    if (platform->irqSource != PLATFORM_IRQ_PIPE) {
+        errno = EINVAL;
+        return -1;
+    }
+    return write(platform->raiseFd, &now, sizeof(now)) == sizeof(now) ? 0 : -1;
+}
+
+int Platform_Reset(Platform_t *platform)
+{
+    if (platform->resetGpio < 0) {
+        return 0;
+    }
+
+    if (gpio_write(platform->resetGpio, "value", "0") != 0) {
+        return -1;
+    }
+    usleep(RESET_PULSE_US);
+    if (gpio_write(platform->resetGpio, "value", "1") != 0) {
+        return -1;
+    }
+    usleep(OSCILLATOR_STARTUP_US);
+
+    return 0;
+}
+
+/*
+ * Take one edge off the IRQ fd. Returns how long ago it happened in ns, 0 if
+ * the source has no timestamps, or -1 if the fd failed.
+ */
+static int64_t irq_take_edge(Platform_t *platform)
+{
+    struct gpioevent_data event;
+    uint64_t raised;
+    char value;
+
+    switch (platform->irqSource) {
+    case PLATFORM_IRQ_CHARDEV:
+        if (read(platform->irqFd, &event, sizeof(event)) != sizeof(event)) {
+            return -1;
+        }
+        return (int64_t) edge_latency(event.timestamp);
+
+    case PLATFORM_IRQ_PIPE:
+        if (read(platform->irqFd, &raised, sizeof(raised)) != sizeof(raised)) {
+            return -1;
+        }
+        return (int64_t) (reader_stats_now() - raised);
+
+    default:
+        // sysfs: reading the value acknowledges the edge
+        return pread(platform->irqFd, &value, 1, 0) < 0 ? -1 : 0;
+    }
+}
+
+static void *irq_thread(void *arg)
+{
+    Platform_t *platform = arg;
+    struct epoll_event events[2];
+    int count;
+    int i;
+    char value;
+
+    // sysfs reports the current level once before the first edge
+    if (platform->irqSource == PLATFORM_IRQ_SYSFS && pread(platform->irqFd, &value, 1, 0) < 0) {
+        return NULL;
+    }
+
+    for (;;) {
+        count = epoll_wait(platform->epollFd, events, 2, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (i = 0; i < count; i++) {
+            int64_t latency;
+
+            if (events[i].data.fd == platform->stopFd) {
+                return NULL;
+            }
+
+            latency = irq_take_edge(platform);
+            if (latency < 0) {
+                return NULL;
+            }
+            if (latency > 0) {
+                pthread_mutex_lock(&platform->statsLock);
+                reader_stats_add(&platform->irqStats, (uint64_t) latency, 0);
+                pthread_mutex_unlock(&platform->statsLock);
+            }
+            platform->irqHandler(platform->irqContext);
+        }
+    }
+
+    return NULL;
+}
+
+int Platform_StartIrq(Platform_t *platform, void (*handler)(void *ctx), void *ctx)
+{
+    struct epoll_event event;
+    int ret;
+
+    if (platform->irqRunning) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (platform->irqSource == PLATFORM_IRQ_NONE) {
+        errno = EBADF;
+        return -1;
+    }
+
+    platform->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (platform->epollFd < 0) {
+        return -1;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = platform->irqSource == PLATFORM_IRQ_SYSFS ? EPOLLPRI | EPOLLERR : EPOLLIN;
+    event.data.fd = platform->irqFd;
+    if (epoll_ctl(platform->epollFd, EPOLL_CTL_ADD, platform->irqFd, &event) < 0) {
+        goto fail;
+    }
+    event.events = EPOLLIN;
+    event.data.fd = platform->stopFd;
+    if (epoll_ctl(platform->epollFd, EPOLL_CTL_ADD, platform->stopFd, &event) < 0) {
+        goto fail;
+    }
+
+    platform->irqHandler = handler;
+    platform->irqContext = ctx;
+
+    ret = pthread_create(&platform->irqThread, NULL, irq_thread, platform);
+    if (ret != 0) {
+        errno = ret;
+        goto fail;
+    }
+
+    platform->irqRunning = 1;
+    return 0;
+
+fail:
+    ret = errno;
+    close(platform->epollFd);
+    platform->epollFd = -1;
+    errno = ret;
+    return -1;
+}
+
+int Platform_StopIrq(Platform_t *platform)
+{
+    uint64_t one = 1;
+    uint64_t count;
+    int ret;
+
+    if (!platform->irqRunning) {
+        return 0;
+    }
+
+    // a thread that was not told to stop, or not joined, may still be in epoll_wait on these fds
+    if (write(platform->stopFd, &one, sizeof(one)) != sizeof(one)) {
+        return -1;
+    }
+    ret = pthread_join(platform->irqThread, NULL);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    if (read(platform->stopFd, &count, sizeof(count)) < 0) {
+    }
+
+    close(platform->epollFd);
+    platform->epollFd = -1;
+    platform->irqRunning = 0;
+    return 0;
+}
+
+void Platform_GetIrqStats(Platform_t *platform, ReaderOpStats_t *stats)
+{
+    pthread_mutex_lock(&platform->statsLock);
+    *stats = platform->irqStats;
+    pthread_mutex_unlock(&platform->statsLock);
+}
+
+void Platform_ResetIrqStats(Platform_t *platform)
+{
+    pthread_mutex_lock(&platform->statsLock);
+    memset(&platform->irqStats, 0, sizeof(platform->irqStats));
+    pthread_mutex_unlock(&platform->statsLock);
+}
@@ -0,0 +1,86 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+/*
+ * Per reader GPIO handling: the reset line and the IRQ line of one PN512.
+ *
+ * Stands in for the Reader Library's Set_Interface_Link, Reset_reader_device
+ * and Set_Interrupt, which only know about a single reader on fixed pins.
+ *
+ * The IRQ line is taken as rising edge events from the GPIO character
+ * device, timestamped by the kernel, with the sysfs interface as a fallback
+ * for kernels that lack it. The IRQ thread sleeps in epoll until an edge (or
+ * Platform_StopIrq) comes, then runs the handler, which wakes whatever RF
+ * operation waits on the chip. The reset line always goes through sysfs.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "reader_stats.h"
+
+#define PLATFORM_MAX_PATH           64
+
+/* EXPLORE-NFC wiring, BCM numbering */
+#define PLATFORM_DEFAULT_SPI        "/dev/spidev0.0"
+#define PLATFORM_DEFAULT_RESET_GPIO 7
+#define PLATFORM_DEFAULT_IRQ_GPIO   23
+#define PLATFORM_GPIO_CHIP          "/dev/gpiochip0"    /* BCM numbers are its line offsets */
+
+/* Where IRQ edges come from */
+#define PLATFORM_IRQ_NONE           0
+#define PLATFORM_IRQ_CHARDEV        1   /* line events of the GPIO character device */
+#define PLATFORM_IRQ_SYSFS          2   /* sysfs value file, no timestamps */
+#define PLATFORM_IRQ_PIPE           3   /* stand-in, see Platform_OpenStandIn */
+
+typedef struct {
+    char spiDevice[PLATFORM_MAX_PATH];
+    int resetGpio;              /* -1 if the reset line is not connected */
+    int irqGpio;
+
+    int irqSource;              /* PLATFORM_IRQ_xxx */
+    int irqFd;                  /* line event fd, sysfs value file or read end of the stand-in pipe */
+    int raiseFd;                /* write end of the stand-in pipe */
+    int stopFd;                 /* eventfd that stops the IRQ thread */
+    int epollFd;
+    pthread_t irqThread;
+    int irqRunning;
+
+    /* Called on the IRQ thread on every rising edge */
+    void (*irqHandler)(void *ctx);
+    void *irqContext;
+
+    /* Edge to handler latency, where the edge carries a timestamp */
+    pthread_mutex_t statsLock;
+    ReaderOpStats_t irqStats;
+} Platform_t;
+
+void Platform_Init(Platform_t *platform);
+void Platform_Destroy(Platform_t *platform);
+
+/* Returns 0 on success, -1 with errno set */
+int Platform_Open(Platform_t *platform, const char *spiDevice, int resetGpio, int irqGpio);
+/* Returns -1 with errno set, and closes nothing, if the IRQ thread could not be stopped */
+int Platform_Close(Platform_t *platform);
+
+/*
+ * Take the IRQ line from a pipe instead of a GPIO, so the IRQ path can run
+ * without a PN512. Platform_RaiseIrq then makes a rising edge, stamped with
+ * the time it was raised. Returns 0 on success, -1 with errno set.
+ */
+int Platform_OpenStandIn(Platform_t *platform);
+int Platform_RaiseIrq(Platform_t *platform);
+
+/* Pulse the reset line and wait for the oscillator to start */
+int Platform_Reset(Platform_t *platform);
+
+int Platform_StartIrq(Platform_t *platform, void (*handler)(void *ctx), void *ctx);
+/*
+ * Returns 0 once the IRQ thread is gone. If it cannot be stopped or joined,
+ * returns -1 with errno set and leaves everything it uses open.
+ */
+int Platform_StopIrq(Platform_t *platform);
+
+void Platform_GetIrqStats(Platform_t *platform, ReaderOpStats_t *stats);
+void Platform_ResetIrqStats(Platform_t *platform);
+
+#endif // PLATFORM_H
@@ -0,0 +1,446 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "poller.h"
+
+#define QUEUE_MASK                  (POLLER_QUEUE_SIZE - 1)
+#define UID_MASK                    (POLLER_UID_SLOTS - 1)
+
+uint64_t Poller_Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void timespec_add_us(struct timespec *ts, uint32_t us)
+{
+    ts->tv_sec += us / 1000000;
+    ts->tv_nsec += (long) (us % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/*******************************************************************************
+** Event queue
+*******************************************************************************/
+
+static void poller_push(Poller_t *poller, uint8_t type, const PollerTag_t *tag, uint64_t timestampNs)
+{
+    uint32_t head = poller->head;
+    uint32_t tail = __atomic_load_n(&poller->tail, __ATOMIC_ACQUIRE);
+    uint64_t one = 1;
+    PollerEvent_t *event;
+
+    if (head - tail >= POLLER_QUEUE_SIZE) {
+        poller->dropped++;
+        return;
+    }
+
+    event = &poller->queue[head & QUEUE_MASK];
+    event->type = type;
+    event->tag = *tag;
+    event->timestampNs = timestampNs;
+
+    __atomic_store_n(&poller->head, head + 1, __ATOMIC_RELEASE);
+    poller->events++;
+
+    if (write(poller->eventFd, &one, sizeof(one)) < 0) {
+        /* only fails if the counter would overflow, someone is already awake */
+    }
+}
+
+int Poller_Pop(Poller_t *poller, PollerEvent_t *event)
+{
+    uint32_t tail = poller->tail;
+    uint32_t head = __atomic_load_n(&poller->head, __ATOMIC_ACQUIRE);
+
+    if (tail == head) {
+        return 0;
+    }
+
+    *event = poller->queue[tail & QUEUE_MASK];
+    __atomic_store_n(&poller->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int queue_empty(Poller_t *poller)
+{
+    return __atomic_load_n(&poller->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&poller->tail, __ATOMIC_ACQUIRE);
+}
+
+int Poller_Wait(Poller_t *poller, int timeoutMs)
+{
+    struct pollfd pfd;
+    uint64_t count;
+
+    if (!queue_empty(poller)) {
+        return 1;
+    }
+    if (!poller->running) {
+        return 0;
+    }
+
+    pfd.fd = poller->eventFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) > 0) {
+        /* non-blocking, another waiter may have drained it first */
+        if (read(poller->eventFd, &count, sizeof(count)) < 0) {
+            count = 0;
+        }
+    }
+
+    return !queue_empty(poller);
+}
+
+/*******************************************************************************
+** Present UIDs
+*******************************************************************************/
+
+static int same_tag(const PollerTag_t *a, const PollerTag_t *b)
+{
+    return a->uidLen == b->uidLen && memcmp(a->uid, b->uid, a->uidLen) == 0;
+}
+
+/* FNV-1a */
+static unsigned int uid_hash(const PollerTag_t *tag)
+{
+    uint32_t hash = 2166136261u;
+    uint8_t i;
+
+    for (i = 0; i < tag->uidLen; i++) {
+        hash = (hash ^ tag->uid[i]) * 16777619u;
+    }
+    return hash & UID_MASK;
+}
+
+/* Slot holding the UID of tag, or the empty slot it would go in */
+static unsigned int uid_find(Poller_t *poller, const PollerTag_t *tag)
+{
+    unsigned int slot = uid_hash(tag);
+
+    while (poller->uids[slot].used && !same_tag(&poller->uids[slot].tag, tag)) {
+        slot = (slot + 1) & UID_MASK;
+    }
+    return slot;
+}
+
+/*
+ * Report a UID gone and empty its slot, moving later entries of the same
+ * probe sequence back so lookups never stop early at the hole.
+ */
+static void uid_depart(Poller_t *poller, unsigned int hole, uint64_t now)
+{
+    PollerTag_t tag = poller->uids[hole].tag;
+    unsigned int slot = hole;
+
+    for (;;) {
+        unsigned int home;
+
+        slot = (slot + 1) & UID_MASK;
+        if (!poller->uids[slot].used) {
+            break;
+        }
+        // an entry may fill the hole unless its home lies between the hole and where it is now
+        home = uid_hash(&poller->uids[slot].tag);
+        if (((slot - home) & UID_MASK) >= ((slot - hole) & UID_MASK)) {
+            poller->uids[hole] = poller->uids[slot];
+            hole = slot;
+        }
+    }
+    poller->uids[hole].used = 0;
+    poller->uidCount--;
+
+    poller_push(poller, POLLER_EVENT_DEPARTURE, &tag, now);
+}
+
+/*
+ * Feed one scan result through the filter, tag NULL for an empty field.
+ * Departures go out before the arrival that may have caused them. Returns
+ * the number of events queued.
+ */
+static int uid_update(Poller_t *poller, const PollerTag_t *tag, uint64_t now)
+{
+    uint64_t events = poller->events + poller->dropped;
+    PollerUid_t *entry;
+    unsigned int slot;
+
+    // a departure can move a later entry back into slot, so look at it again
+    for (slot = 0; slot < POLLER_UID_SLOTS; ) {
+        entry = &poller->uids[slot];
+        if (entry->used && (tag == NULL || !same_tag(&entry->tag, tag)) && now - entry->lastSeenNs >= poller->holdNs) {
+            uid_depart(poller, slot, now);
+        } else {
+            slot++;
+        }
+    }
+
+    if (tag != NULL) {
+        slot = uid_find(poller, tag);
+        entry = &poller->uids[slot];
+        if (entry->used) {
+            entry->lastSeenNs = now;
+            if (poller->rearmNs && now - entry->lastReportNs >= poller->rearmNs) {
+                entry->lastReportNs = now;
+                poller_push(poller, POLLER_EVENT_REPRESENT, tag, now);
+            } else {
+                poller->suppressed++;
+            }
+        } else {
+            if (poller->uidCount >= poller->maxUids) {
+                unsigned int oldest = POLLER_UID_SLOTS;
+
+                for (slot = 0; slot < POLLER_UID_SLOTS; slot++) {
+                    if (poller->uids[slot].used && (oldest == POLLER_UID_SLOTS ||
+                                                    poller->uids[slot].lastSeenNs < poller->uids[oldest].lastSeenNs)) {
+                        oldest = slot;
+                    }
+                }
+                uid_depart(poller, oldest, now);
+                poller->evicted++;
+
+                slot = uid_find(poller, tag);
+                entry = &poller->uids[slot];
+            }
+
+            entry->tag = *tag;
+            entry->lastSeenNs = now;
+            entry->lastReportNs = now;
+            entry->used = 1;
+            poller->uidCount++;
+            poller_push(poller, POLLER_EVENT_ARRIVAL, tag, now);
+        }
+    }
+
+    return (int) (poller->events + poller->dropped - events);
+}
+
+/*******************************************************************************
+** Poller thread
+*******************************************************************************/
+
+/*
+ * Full scan, turning what it finds into events. Returns nonzero if anything
+ * changed. changeSeenNs is when the change was first noticed.
+ */
+static int poller_scan(Poller_t *poller, uint64_t changeSeenNs)
+{
+    PollerTag_t tag;
+    uint64_t start = Poller_Now();
+    int found = poller->scan(poller->scanContext, &tag);
+    uint64_t now = Poller_Now();
+    int changed;
+
+    poller->scans++;
+    poller->scanNs += now - start;
+    if (found < 0) {
+        // a failed scan says nothing about whether the tag is still there
+        poller->scanErrors++;
+        return 0;
+    }
+
+    changed = uid_update(poller, found ? &tag : NULL, now) != 0;
+    if (changed) {
+        poller->lastDetectionNs = now - (changeSeenNs ? changeSeenNs : start);
+    }
+
+    return changed;
+}
+
+/* Returns nonzero once enough probes in a row disagree with the last scan */
+static int poller_probe(Poller_t *poller)
+{
+    uint64_t start = Poller_Now();
+    int answered = poller->probe(poller->scanContext) != 0;
+
+    poller->probes++;
+    poller->probeNs += Poller_Now() - start;
+
+    if (answered == (poller->uidCount != 0)) {
+        poller->lpcdCount = 0;
+        return 0;
+    }
+    if (poller->lpcdCount++ == 0) {
+        poller->changeSeenNs = start;
+    }
+    if (poller->lpcdCount < poller->lpcdThreshold) {
+        return 0;
+    }
+
+    poller->lpcdCount = 0;
+    return 1;
+}
+
+/*
+ * A probe only says whether anything answers, not what. While a UID is
+ * tracked that says nothing about a second tag joining it (with maxUids above
+ * 1) or about a held tag being due for its re-present, so those take a full
+ * scan even though the probe agreed with the last one.
+ */
+static int poller_scan_due(Poller_t *poller, uint64_t now)
+{
+    unsigned int slot;
+
+    if (poller->uidCount == 0) {
+        return 0;
+    }
+    if (poller->maxUids > 1) {
+        return 1;
+    }
+    for (slot = 0; poller->rearmNs && slot < POLLER_UID_SLOTS; slot++) {
+        if (poller->uids[slot].used && now - poller->uids[slot].lastReportNs >= poller->rearmNs) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *poller_thread(void *arg)
+{
+    Poller_t *poller = arg;
+    struct timespec due;
+
+    clock_gettime(CLOCK_MONOTONIC, &due);
+
+    while (poller->running) {
+        uint64_t now;
+
+        if (poller->probe == NULL) {
+            poller_scan(poller, 0);
+        } else if (poller_probe(poller)) {
+            poller->wakeups++;
+            if (!poller_scan(poller, poller->changeSeenNs)) {
+                poller->falseWakeups++;
+            }
+        } else if (poller->lpcdCount == 0 && poller_scan_due(poller, Poller_Now())) {
+            poller_scan(poller, 0);
+        }
+
+        // scan at a fixed rate, but never try to catch up on missed slots
+        now = Poller_Now();
+        timespec_add_us(&due, poller->intervalUs);
+        if ((uint64_t) due.tv_sec * 1000000000ULL + due.tv_nsec < now) {
+            clock_gettime(CLOCK_MONOTONIC, &due);
+        }
+
+        pthread_mutex_lock(&poller->lock);
+        while (poller->running && pthread_cond_timedwait(&poller->wake, &poller->lock, &due) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&poller->lock);
+    }
+
+    return NULL;
+}
+
+int Poller_Init(Poller_t *poller)
+{
+    pthread_condattr_t attr;
+
+    memset(poller, 0, sizeof(*poller));
+
+    poller->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (poller->eventFd < 0) {
+        return -1;
+    }
+
+    poller->maxUids = 1;
+
+    pthread_mutex_init(&poller->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&poller->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    return 0;
+}
+
+void Poller_Destroy(Poller_t *poller)
+{
+    Poller_Stop(poller);
+
+    pthread_cond_destroy(&poller->wake);
+    pthread_mutex_destroy(&poller->lock);
+    close(poller->eventFd);
+    poller->eventFd = -1;
+}
+
+int Poller_Start(Poller_t *poller, uint32_t intervalUs, PollerScan_t scan, void *ctx)
+{
+    int ret;
+
+    if (poller->started) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    poller->intervalUs = intervalUs;
+    poller->scan = scan;
+    poller->scanContext = ctx;
+    memset(poller->uids, 0, sizeof(poller->uids));
+    poller->uidCount = 0;
+    poller->lpcdCount = 0;
+    poller->running = 1;
+
+    ret = pthread_create(&poller->thread, NULL, poller_thread, poller);
+    if (ret != 0) {
+        poller->running = 0;
+        errno = ret;
+        return -1;
+    }
+
+    poller->started = 1;
+    return 0;
+}
+
+void Poller_SetLpcd(Poller_t *poller, PollerProbe_t probe, uint8_t threshold)
+{
+    poller->probe = probe;
+    poller->lpcdThreshold = threshold ? threshold : 1;
+}
+
+int Poller_SetFilter(Poller_t *poller, uint32_t holdUs, uint32_t rearmUs, unsigned int maxUids)
+{
+    if (maxUids < 1 || maxUids > POLLER_MAX_UIDS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    poller->holdNs = (uint64_t) holdUs * 1000;
+    poller->rearmNs = (uint64_t) rearmUs * 1000;
+    poller->maxUids = maxUids;
+    return 0;
+}
+
+void Poller_Stop(Poller_t *poller)
+{
+    uint64_t one = 1;
+
+    if (!poller->started) {
+        return;
+    }
+
+    pthread_mutex_lock(&poller->lock);
+    poller->running = 0;
+    pthread_cond_broadcast(&poller->wake);
+    pthread_mutex_unlock(&poller->lock);
+
+    pthread_join(poller->thread, NULL);
+    poller->started = 0;
+
+    // wake up anyone blocked in Poller_Wait
+    if (write(poller->eventFd, &one, sizeof(one)) < 0) {
+    }
+}
+
+int Poller_IsRunning(Poller_t *poller)
+{
+    return poller->running;
+}
@@ -0,0 +1,138 @@
+#ifndef POLLER_H
+#define POLLER_H
+/*
+ * Background tag polling.
+ *
+ * A pthread runs a scan function every intervalUs and turns changes in what
+ * it sees into arrival/departure events. Events go through a bounded
+ * single-producer/single-consumer ring: the poller thread is the only
+ * producer and consumers must be serialised by the caller (nxppy pops with
+ * the GIL held). An eventfd is signalled on every push so consumers can sleep
+ * in poll() instead of spinning.
+ *
+ * In LPCD (low-power card detection) mode a cheap probe runs every intervalUs
+ * instead, and the full scan only runs once lpcdThreshold probes in a row
+ * disagree with what the last scan saw. A probe cannot tell tags apart, so
+ * while a UID is tracked a full scan still runs every cycle with maxUids above
+ * 1, and whenever a held UID is due to be re-presented.
+ *
+ * The UIDs considered present are kept in a small open-addressed hash table,
+ * which debounces the scan stream (see Poller_SetFilter): a UID departs once
+ * it has not been seen for holdUs, a UID held on the reader is reported again
+ * every rearmUs, and at most maxUids are tracked at once. Repeats in between
+ * cost a lookup and never reach the queue.
+ *
+ * Nothing in here knows about Python or the Reader Library.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define POLLER_QUEUE_SIZE           64      /* must be a power of two */
+#define POLLER_MAX_UID_LENGTH       10
+#define POLLER_UID_SLOTS            64      /* must be a power of two */
+#define POLLER_MAX_UIDS             (POLLER_UID_SLOTS / 2)  /* keeps probe sequences short */
+
+#define POLLER_EVENT_ARRIVAL        1
+#define POLLER_EVENT_DEPARTURE      2
+#define POLLER_EVENT_REPRESENT      3       /* still there after rearmUs */
+
+typedef struct {
+    uint8_t uid[POLLER_MAX_UID_LENGTH];
+    uint8_t uidLen;
+    uint8_t atqa[2];
+    uint8_t sak;
+} PollerTag_t;
+
+typedef struct {
+    PollerTag_t tag;
+    uint64_t lastSeenNs;
+    uint64_t lastReportNs;      /* arrival or last re-present */
+    uint8_t used;
+} PollerUid_t;
+
+typedef struct {
+    uint8_t type;               /* POLLER_EVENT_xxx */
+    PollerTag_t tag;
+    uint64_t timestampNs;       /* CLOCK_MONOTONIC */
+} PollerEvent_t;
+
+/* One discovery cycle. Returns 1 and fills tag if a tag is in the field, 0 if the field is empty, -1 on error. */
+typedef int (*PollerScan_t)(void *ctx, PollerTag_t *tag);
+
+/* LPCD probe. Returns nonzero if anything at all answered. */
+typedef int (*PollerProbe_t)(void *ctx);
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;       /* protects running, only used to sleep between scans */
+    pthread_cond_t wake;
+    volatile int running;
+    int started;
+
+    uint32_t intervalUs;
+    PollerScan_t scan;
+    PollerProbe_t probe;        /* NULL unless in LPCD mode */
+    void *scanContext;
+    uint8_t lpcdThreshold;
+    uint8_t lpcdCount;          /* consecutive probes disagreeing with uidCount */
+    uint64_t changeSeenNs;      /* when the first of those probes started */
+
+    PollerEvent_t queue[POLLER_QUEUE_SIZE];
+    uint32_t head;              /* next slot to fill, written by the poller thread only */
+    uint32_t tail;              /* next slot to drain, written by the consumer only */
+    int eventFd;
+
+    /* UIDs in the field, poller thread only */
+    PollerUid_t uids[POLLER_UID_SLOTS];
+    unsigned int uidCount;
+    uint64_t holdNs;
+    uint64_t rearmNs;
+    unsigned int maxUids;
+
+    /* Counters */
+    uint64_t scans;
+    uint64_t scanErrors;
+    uint64_t scanNs;            /* time spent in full scans */
+    uint64_t probes;
+    uint64_t probeNs;           /* time spent in LPCD probes */
+    uint64_t wakeups;           /* full scans triggered by probes */
+    uint64_t falseWakeups;      /* ... that did not change anything */
+    uint64_t lastDetectionNs;   /* from the start of the cycle that noticed a change to its event */
+    uint64_t events;
+    uint64_t dropped;           /* events lost because the queue was full */
+    uint64_t suppressed;        /* sightings of a present UID that made no event */
+    uint64_t evicted;           /* UIDs departed early to make room for another */
+} Poller_t;
+
+/* Returns 0 on success, -1 with errno set */
+int Poller_Init(Poller_t *poller);
+void Poller_Destroy(Poller_t *poller);
+
+int Poller_Start(Poller_t *poller, uint32_t intervalUs, PollerScan_t scan, void *ctx);
+
+/* Call before Poller_Start, probe NULL turns LPCD mode off */
+void Poller_SetLpcd(Poller_t *poller, PollerProbe_t probe, uint8_t threshold);
+
+/*
+ * Call before Poller_Start. holdUs 0 departs a UID on the first scan without
+ * it, rearmUs 0 never reports a held UID again. Returns 0, or -1 with errno
+ * set if maxUids is not between 1 and POLLER_MAX_UIDS.
+ */
+int Poller_SetFilter(Poller_t *poller, uint32_t holdUs, uint32_t rearmUs, unsigned int maxUids);
+
+void Poller_Stop(Poller_t *poller);
+int Poller_IsRunning(Poller_t *poller);
+
+/* Returns 1 and fills event if one was queued, 0 if the queue is empty */
+int Poller_Pop(Poller_t *poller, PollerEvent_t *event);
+
+/*
+ * Sleep until an event is queued, the poller stops or timeoutMs passes
+ * (-1 waits forever). Returns 1 if an event may be available, 0 otherwise.
+ */
+int Poller_Wait(Poller_t *poller, int timeoutMs);
+
+uint64_t Poller_Now(void);
+
+#endif // POLLER_H
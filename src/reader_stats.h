@@ -0,0 +1,91 @@
+#ifndef READER_STATS_H
+#define READER_STATS_H
+/*
+ * Latency histograms and error counters of one reader.
+ *
+ * Recording an operation is a clock read, a count-leading-zeros and a few
+ * increments, so it stays on all the time. Latencies go into log2 buckets:
+ * bucket 0 holds everything under 2^10 ns (about 1 us), bucket i the range
+ * [2^(i+9), 2^(i+10)) ns and the last bucket everything from about 4 s up.
+ *
+ * Only the owning reader touches it, with its lock held.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define READER_STATS_BUCKETS        24
+#define READER_STATS_FIRST_SHIFT    10      /* bucket 0 ends at 2^10 ns */
+
+typedef enum {
+    READER_OP_SELECT,
+    READER_OP_READ,
+    READER_OP_WRITE,
+    READER_OP_GET_VERSION,
+    READER_OP_READ_SIGN,
+    READER_OP_AUTH,             /* MIFARE Classic MFAuthent */
+    READER_OP_APDU,             /* ISO14443-4 command and answer, chaining included */
+    READER_OP_COUNT
+} ReaderOp_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t buckets[READER_STATS_BUCKETS];
+} ReaderOpStats_t;
+
+typedef struct {
+    ReaderOpStats_t ops[READER_OP_COUNT];
+
+    uint64_t rfTimeouts;
+    uint64_t crcErrors;         /* CRC and parity */
+    uint64_t collisions;
+    uint64_t discoveryLoops;    /* phacDiscLoop_Run calls, polling included */
+} ReaderStats_t;
+
+static inline uint64_t reader_stats_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline unsigned int reader_stats_bucket(uint64_t ns)
+{
+    unsigned int bucket;
+
+    if (ns < (1ULL << READER_STATS_FIRST_SHIFT)) {
+        return 0;
+    }
+    bucket = 63 - __builtin_clzll(ns) - (READER_STATS_FIRST_SHIFT - 1);
+    return bucket < READER_STATS_BUCKETS ? bucket : READER_STATS_BUCKETS - 1;
+}
+
+/* Account for one operation that took ns */
+static inline void reader_stats_add(ReaderOpStats_t *s, uint64_t ns, int failed)
+{
+    s->count++;
+    s->errors += failed ? 1 : 0;
+    s->totalNs += ns;
+    if (ns > s->maxNs) {
+        s->maxNs = ns;
+    }
+    s->buckets[reader_stats_bucket(ns)]++;
+}
+
+/* Account for an operation that started at startNs (reader_stats_now) and just finished */
+static inline void reader_stats_record(ReaderStats_t *stats, ReaderOp_t op, uint64_t startNs, int failed)
+{
+    reader_stats_add(&stats->ops[op], reader_stats_now() - startNs, failed);
+}
+
+static inline void reader_stats_reset(ReaderStats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // READER_STATS_H
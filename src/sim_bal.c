@@ -0,0 +1,542 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "Mifare.h"
+#include "sim_bal.h"
+
+/*
+ * One simulated PN512 per SPI device name, so several Mifare instances can
+ * each talk to their own chip. Chips are never freed, a reader that is
+ * created again on the same port finds its tags where it left them.
+ */
+typedef struct {
+    char port[PLATFORM_MAX_PATH];
+    SimPn512_t chip;
+    phbalReg_Stub_DataParams_t *bal;    /* BAL bound to this port by SetPort */
+    void *hal;                          /* HAL whose ISR the IRQ line drives */
+} SimReader_t;
+
+static SimReader_t sSimReaders[SIM_MAX_READERS];
+static pthread_mutex_t sSimReadersLock = PTHREAD_MUTEX_INITIALIZER;
+
+static SimReader_t *find_reader(const char *port, int create)
+{
+    SimReader_t *reader = NULL;
+    int i;
+
+    if (port == NULL) {
+        port = PLATFORM_DEFAULT_SPI;
+    }
+
+    pthread_mutex_lock(&sSimReadersLock);
+    for (i = 0; i < SIM_MAX_READERS; i++) {
+        if (sSimReaders[i].port[0] == '\0') {
+            if (create && strlen(port) < sizeof(sSimReaders[i].port)) {
+                reader = &sSimReaders[i];
+                strcpy(reader->port, port);
+                SimPn512_Init(&reader->chip);
+            }
+            break;
+        }
+        if (strcmp(sSimReaders[i].port, port) == 0) {
+            reader = &sSimReaders[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sSimReadersLock);
+
+    return reader;
+}
+
+static SimReader_t *find_bal(phbalReg_Stub_DataParams_t * pDataParams)
+{
+    int i;
+
+    for (i = 0; i < SIM_MAX_READERS && sSimReaders[i].port[0] != '\0'; i++) {
+        if (sSimReaders[i].bal == pDataParams) {
+            return &sSimReaders[i];
+        }
+    }
+    return NULL;
+}
+
+SimPn512_t *SimBal_GetChip(const char *port)
+{
+    SimReader_t *reader = find_reader(port, 1);
+
+    return reader != NULL ? &reader->chip : NULL;
+}
+
+/*******************************************************************************
+** BAL
+*******************************************************************************/
+
+phStatus_t phbalReg_Stub_Init(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wSizeOfDataParams)
+{
+    if (sizeof(phbalReg_Stub_DataParams_t) != wSizeOfDataParams) {
+        return PH_ADD_COMPCODE(PH_ERR_INVALID_DATA_PARAMS, PH_COMP_BAL);
+    }
+    pDataParams->wId = PH_COMP_BAL | PHBAL_REG_STUB_ID;
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_GetPortList(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wPortBufSize,
+                                     uint8_t * pPortNames, uint16_t * pNumOfPorts)
+{
+    const char *port = PLATFORM_DEFAULT_SPI;
+
+    if (wPortBufSize < strlen(port) + 1) {
+        return PH_ADD_COMPCODE(PH_ERR_BUFFER_OVERFLOW, PH_COMP_BAL);
+    }
+    strcpy((char *) pPortNames, port);
+    *pNumOfPorts = 1;
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_SetPort(phbalReg_Stub_DataParams_t * pDataParams, uint8_t * pPortName)
+{
+    SimReader_t *reader;
+    int i;
+
+    // a BAL moving to another port gives up the old one
+    for (i = 0; i < SIM_MAX_READERS; i++) {
+        if (sSimReaders[i].bal == pDataParams) {
+            sSimReaders[i].bal = NULL;
+        }
+    }
+
+    reader = find_reader((const char *) pPortName, 1);
+    if (reader == NULL) {
+        return PH_ADD_COMPCODE(PH_ERR_INVALID_PARAMETER, PH_COMP_BAL);
+    }
+    reader->bal = pDataParams;
+    return PH_ERR_SUCCESS;
+}
+
+static int sim_spi_backend(void *ctx, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count)
+{
+    SimPn512_SpiMessage(ctx, tx, rx, lens, count);
+    return 0;
+}
+
+phStatus_t phbalReg_Stub_OpenPort(phbalReg_Stub_DataParams_t * pDataParams)
+{
+    SimReader_t *reader = find_bal(pDataParams);
+
+    if (reader == NULL) {
+        return PH_ADD_COMPCODE(PH_ERR_USE_CONDITION, PH_COMP_BAL);
+    }
+    SpiBus_Attach(&NFC_DATA_OF_BAL(pDataParams)->spi, sim_spi_backend, &reader->chip);
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_ClosePort(phbalReg_Stub_DataParams_t * pDataParams)
+{
+    SimReader_t *reader = find_bal(pDataParams);
+
+    SpiBus_Close(&NFC_DATA_OF_BAL(pDataParams)->spi);
+
+    // a later reader may have taken the port over, only let go of our own
+    if (reader != NULL) {
+        SimPn512_SetIrqHandler(&reader->chip, NULL, NULL);
+        reader->hal = NULL;
+        reader->bal = NULL;
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_Exchange(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wOption,
+                                  uint8_t * pTxBuffer, uint16_t wTxLength, uint16_t wRxBufSize,
+                                  uint8_t * pRxBuffer, uint16_t * pRxLength)
+{
+    SimReader_t *reader = find_bal(pDataParams);
+
+    if (reader == NULL) {
+        return PH_ADD_COMPCODE(PH_ERR_USE_CONDITION, PH_COMP_BAL);
+    }
+    if (wRxBufSize < wTxLength) {
+        return PH_ADD_COMPCODE(PH_ERR_BUFFER_OVERFLOW, PH_COMP_BAL);
+    }
+
+    if (SpiBus_Exchange(&NFC_DATA_OF_BAL(pDataParams)->spi, pTxBuffer, pRxBuffer, wTxLength) != 0) {
+        return PH_ADD_COMPCODE(PH_ERR_INTERFACE_ERROR, PH_COMP_BAL);
+    }
+
+    if (pRxLength != NULL) {
+        *pRxLength = wTxLength;
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_SetConfig(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wConfig, uint16_t wValue)
+{
+    if (wConfig == PHBAL_REG_CONFIG_HAL_HW_TYPE) {
+        pDataParams->bHalType = (uint8_t) wValue;
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_GetConfig(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wConfig, uint16_t * pValue)
+{
+    if (wConfig != PHBAL_REG_CONFIG_HAL_HW_TYPE) {
+        return PH_ADD_COMPCODE(PH_ERR_UNSUPPORTED_PARAMETER, PH_COMP_BAL);
+    }
+    *pValue = pDataParams->bHalType;
+    return PH_ERR_SUCCESS;
+}
+
+/*******************************************************************************
+** Platform hooks
+*******************************************************************************/
+
+static void SimBal_IrqHandler(void *ctx)
+{
+    phhalHw_Rc523_DataParams_t *hal = ((SimReader_t *) ctx)->hal;
+
+    /* Same path the GPIO interrupt thread takes on real hardware */
+    if (hal != NULL && hal->pRFISRCallback != NULL) {
+        hal->pRFISRCallback(hal);
+    }
+}
+
+int SimBal_Set_Interface_Link(const char *port)
+{
+    return find_reader(port, 1) != NULL ? 0 : -1;
+}
+
+void SimBal_Reset_reader_device(const char *port)
+{
+    SimReader_t *reader = find_reader(port, 1);
+
+    if (reader != NULL) {
+        SimPn512_Reset(&reader->chip);
+    }
+}
+
+void SimBal_Set_Interrupt(const char *port, void *hal)
+{
+    SimReader_t *reader = find_reader(port, 1);
+
+    if (reader != NULL) {
+        reader->hal = hal;
+        SimPn512_SetIrqHandler(&reader->chip, SimBal_IrqHandler, reader);
+    }
+}
+
+/*******************************************************************************
+** Python interface
+*******************************************************************************/
+
+static SimPn512_t *sim_chip(const char *port)
+{
+    SimPn512_t *chip = SimBal_GetChip(port);
+
+    if (chip == NULL) {
+        PyErr_Format(PyExc_ValueError, "No room for another simulated reader");
+    }
+    return chip;
+}
+
+PyObject *Simulator_add_tag(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    uint8_t type;
+    Py_buffer uid = { NULL };
+    int slot;
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "type", "uid", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b|z*z", kwlist, &type, &uid, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        if (uid.buf != NULL) {
+            PyBuffer_Release(&uid);
+        }
+        return NULL;
+    }
+
+    slot = SimPn512_AddTag(chip, type, uid.buf, (uint8_t) uid.len);
+    if (uid.buf != NULL) {
+        PyBuffer_Release(&uid);
+    }
+    if (slot < 0) {
+        return PyErr_Format(PyExc_ValueError, "Unable to add tag: unknown type, bad UID length or field full");
+    }
+    return Py_BuildValue("i", slot);
+}
+
+PyObject *Simulator_remove_tag(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    PyObject *slot = Py_None;
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "slot", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Oz", kwlist, &slot, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        return NULL;
+    }
+
+    if (slot == Py_None) {
+        SimPn512_RemoveAllTags(chip);
+    } else if (SimPn512_RemoveTag(chip, (int) PyLong_AsLong(slot)) != 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_Format(PyExc_ValueError, "No tag in that slot");
+        }
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *Simulator_set_latency(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    unsigned int latencyUs;
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "us", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "I|z", kwlist, &latencyUs, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        return NULL;
+    }
+
+    SimPn512_SetLatency(chip, latencyUs);
+    Py_RETURN_NONE;
+}
+
+PyObject *Simulator_inject_fault(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    uint8_t kind;
+    unsigned int count = 1;
+    unsigned int skip = 0;
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "kind", "count", "skip", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "b|IIz", kwlist, &kind, &count, &skip, &port)) {
+        return NULL;
+    }
+    if (kind > SIM_FAULT_NAK) {
+        return PyErr_Format(PyExc_ValueError, "Unknown fault kind %d", kind);
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        return NULL;
+    }
+
+    SimPn512_InjectFault(chip, kind, count, skip);
+    Py_RETURN_NONE;
+}
+
+PyObject *Simulator_read_memory(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    int slot;
+    int len;
+    uint8_t buffer[SIM_MAX_TAG_MEMORY];
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "slot", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|z", kwlist, &slot, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        return NULL;
+    }
+
+    len = SimPn512_ReadMemory(chip, slot, buffer, sizeof(buffer));
+    if (len < 0) {
+        return PyErr_Format(PyExc_ValueError, "No tag in slot %d", slot);
+    }
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("y#", buffer, len);
+#else
+    return Py_BuildValue("s#", buffer, len);
+#endif
+}
+
+PyObject *Simulator_write_memory(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    int slot;
+    unsigned short offset;
+    Py_buffer data;
+    int len;
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "slot", "offset", "data", "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iHs*|z", kwlist, &slot, &offset, &data, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        PyBuffer_Release(&data);
+        return NULL;
+    }
+
+    len = SimPn512_WriteMemory(chip, slot, offset, data.buf, (uint16_t) data.len);
+    PyBuffer_Release(&data);
+    if (len < 0) {
+        return PyErr_Format(PyExc_ValueError, "No tag in slot %d or write beyond its memory", slot);
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *Simulator_stats(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    const char *port = NULL;
+    SimPn512_t *chip;
+
+    static char *kwlist[] = { "port", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", kwlist, &port)) {
+        return NULL;
+    }
+    chip = sim_chip(port);
+    if (chip == NULL) {
+        return NULL;
+    }
+
+    return Py_BuildValue("{s:I, s:I, s:I}",
+                         "spi_transfers", chip->spiTransfers,
+                         "spi_messages", chip->spiMessages,
+                         "rf_transactions", chip->rfTransactions);
+}
+
+static void benchmark_irq(void *ctx)
+{
+    uint64_t one = 1;
+
+    // what the HAL ISR does on hardware: wake the RF operation waiting on the chip
+    if (write(*(int *) ctx, &one, sizeof(one)) < 0) {
+    }
+}
+
+PyObject *Simulator_irq_benchmark(PyObject * self, PyObject * args, PyObject * kwds)
+{
+    unsigned int edges = 1000;
+    Platform_t *platform;
+    int *wakeFd;
+    ReaderOpStats_t handler;
+    ReaderOpStats_t wakeup;
+    uint64_t count;
+    int error = 0;
+    unsigned int i;
+
+    static char *kwlist[] = { "edges", NULL };
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", kwlist, &edges)) {
+        return NULL;
+    }
+    if (edges == 0) {
+        return PyErr_Format(PyExc_ValueError, "edges must be at least 1");
+    }
+
+    // on the heap, so they can be left to an IRQ thread that will not stop
+    platform = malloc(sizeof(*platform));
+    wakeFd = malloc(sizeof(*wakeFd));
+    if (platform == NULL || wakeFd == NULL) {
+        free(platform);
+        free(wakeFd);
+        return PyErr_NoMemory();
+    }
+
+    memset(&wakeup, 0, sizeof(wakeup));
+    Platform_Init(platform);
+    *wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (*wakeFd < 0 || Platform_OpenStandIn(platform) != 0 ||
+        Platform_StartIrq(platform, benchmark_irq, wakeFd) != 0) {
+        error = errno;
+    }
+
+    // raise an edge, sleep on the eventfd like an RF operation, repeat
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 0; !error && i < edges; i++) {
+        uint64_t started = reader_stats_now();
+
+        if (Platform_RaiseIrq(platform) != 0 || read(*wakeFd, &count, sizeof(count)) != sizeof(count)) {
+            error = errno;
+            break;
+        }
+        reader_stats_add(&wakeup, reader_stats_now() - started, 0);
+    }
+    Py_END_ALLOW_THREADS
+
+    Platform_GetIrqStats(platform, &handler);
+    if (Platform_StopIrq(platform) != 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Platform_Destroy(platform);
+    free(platform);
+    if (*wakeFd >= 0) {
+        close(*wakeFd);
+    }
+    free(wakeFd);
+    if (error) {
+        errno = error;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    return Py_BuildValue("{s:K, s:K, s:K, s:K, s:K}",
+                         "edges", (unsigned long long) handler.count,
+                         "handler_mean_ns", (unsigned long long) (handler.totalNs / edges),
+                         "handler_max_ns", (unsigned long long) handler.maxNs,
+                         "wakeup_mean_ns", (unsigned long long) (wakeup.totalNs / edges),
+                         "wakeup_max_ns", (unsigned long long) wakeup.maxNs);
+}
+
+static PyMethodDef Simulator_methods[] = {
+    {"sim_add_tag", (PyCFunction) Simulator_add_tag, METH_VARARGS | METH_KEYWORDS, "Place a virtual tag in the simulated field. Returns its slot."}
+    ,
+    {"sim_remove_tag", (PyCFunction) Simulator_remove_tag, METH_VARARGS | METH_KEYWORDS, "Remove a virtual tag from the field, or all of them."}
+    ,
+    {"sim_set_latency", (PyCFunction) Simulator_set_latency, METH_VARARGS | METH_KEYWORDS, "Set the latency added to every RF transaction in microseconds."}
+    ,
+    {"sim_inject_fault", (PyCFunction) Simulator_inject_fault, METH_VARARGS | METH_KEYWORDS, "Fault the next count RF transactions after skipping skip."}
+    ,
+    {"sim_read_memory", (PyCFunction) Simulator_read_memory, METH_VARARGS | METH_KEYWORDS, "Read the whole memory of a virtual tag."}
+    ,
+    {"sim_write_memory", (PyCFunction) Simulator_write_memory, METH_VARARGS | METH_KEYWORDS, "Overwrite part of a virtual tag's memory."}
+    ,
+    {"sim_stats", (PyCFunction) Simulator_stats, METH_VARARGS | METH_KEYWORDS, "SPI transfer, SPI message and RF transaction counters of a simulated reader."}
+    ,
+    {"sim_irq_benchmark", (PyCFunction) Simulator_irq_benchmark, METH_VARARGS | METH_KEYWORDS, "Time IRQ edges from a pipe stand-in to the IRQ handler and to a thread woken by it."}
+    ,
+    {NULL}                      /* Sentinel */
+};
+
+int SimBal_AddToModule(PyObject *module)
+{
+    PyMethodDef *def;
+
+    for (def = Simulator_methods; def->ml_name != NULL; def++) {
+        PyObject *func = PyCFunction_NewEx(def, NULL, NULL);
+
+        if (func == NULL || PyModule_AddObject(module, def->ml_name, func) < 0) {
+            return -1;
+        }
+    }
+
+    PyModule_AddIntConstant(module, "SIM_NTAG213", SIM_TAG_NTAG213);
+    PyModule_AddIntConstant(module, "SIM_NTAG215", SIM_TAG_NTAG215);
+    PyModule_AddIntConstant(module, "SIM_NTAG216", SIM_TAG_NTAG216);
+    PyModule_AddIntConstant(module, "SIM_ULTRALIGHT", SIM_TAG_ULTRALIGHT);
+    PyModule_AddIntConstant(module, "SIM_CLASSIC_1K", SIM_TAG_CLASSIC_1K);
+    PyModule_AddIntConstant(module, "SIM_TYPE4", SIM_TAG_TYPE4);
+
+    PyModule_AddIntConstant(module, "SIM_FAULT_NONE", SIM_FAULT_NONE);
+    PyModule_AddIntConstant(module, "SIM_FAULT_TIMEOUT", SIM_FAULT_TIMEOUT);
+    PyModule_AddIntConstant(module, "SIM_FAULT_CRC", SIM_FAULT_CRC);
+    PyModule_AddIntConstant(module, "SIM_FAULT_PARITY", SIM_FAULT_PARITY);
+    PyModule_AddIntConstant(module, "SIM_FAULT_COLLISION", SIM_FAULT_COLLISION);
+    PyModule_AddIntConstant(module, "SIM_FAULT_NAK", SIM_FAULT_NAK);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SIM_BAL_H
+#define SIM_BAL_H
+/*
+ * Software BAL for the NXPPY_SIMULATOR build.
+ *
+ * Replaces the spidev based phbalReg_Stub from the Reader Library with one that
+ * talks to the in-process PN512 model, and stands in for the GPIO based
+ * platform hooks (interface link, reset line, IRQ thread).
+ */
+
+#include <Python.h>
+#include "sim_pn512.h"
+#include "platform.h"
+
+#define SIM_MAX_READERS             4
+
+/*
+ * Every hook takes the SPI device name the reader was created with, NULL
+ * meaning the default one. Each name gets its own simulated PN512.
+ */
+int SimBal_Set_Interface_Link(const char *port);
+void SimBal_Reset_reader_device(const char *port);
+/* Route the chip's IRQ line to hal's ISR until the port is closed */
+void SimBal_Set_Interrupt(const char *port, void *hal);
+
+/* The chip behind port, created on first use. NULL once all slots are taken. */
+SimPn512_t *SimBal_GetChip(const char *port);
+
+/* Add the sim_* functions and SIM_* constants to the extension module */
+int SimBal_AddToModule(PyObject *module);
+
+#endif // SIM_BAL_H
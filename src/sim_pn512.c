@@ -0,0 +1,1304 @@
+#include <string.h>
+#include <time.h>
+#include "sim_pn512.h"
+
+/*
+ * PN512 registers used by the model
+ */
+#define REG_COMMAND                 0x01
+#define REG_COMIEN                  0x02
+#define REG_DIVIEN                  0x03
+#define REG_COMIRQ                  0x04
+#define REG_DIVIRQ                  0x05
+#define REG_ERROR                   0x06
+#define REG_STATUS1                 0x07
+#define REG_STATUS2                 0x08
+#define REG_FIFODATA                0x09
+#define REG_FIFOLEVEL               0x0A
+#define REG_WATERLEVEL              0x0B
+#define REG_CONTROL                 0x0C
+#define REG_BITFRAMING              0x0D
+#define REG_COLL                    0x0E
+#define REG_MODE                    0x11
+#define REG_TXMODE                  0x12
+#define REG_RXMODE                  0x13
+#define REG_TXCONTROL               0x14
+#define REG_CRCRESULT_MSB           0x21
+#define REG_CRCRESULT_LSB           0x22
+#define REG_TMODE                   0x2A
+#define REG_VERSION                 0x37
+
+#define CMD_IDLE                    0x00
+#define CMD_CALCCRC                 0x03
+#define CMD_TRANSMIT                0x04
+#define CMD_NOCMDCHANGE             0x07
+#define CMD_RECEIVE                 0x08
+#define CMD_TRANSCEIVE              0x0C
+#define CMD_MFAUTHENT               0x0E
+#define CMD_SOFTRESET               0x0F
+#define CMD_MASK                    0x0F
+
+#define IRQ_TX                      0x40
+#define IRQ_RX                      0x20
+#define IRQ_IDLE                    0x10
+#define IRQ_HIALERT                 0x08
+#define IRQ_LOALERT                 0x04
+#define IRQ_ERR                     0x02
+#define IRQ_TIMER                   0x01
+#define DIVIRQ_CRC                  0x04
+
+#define ERR_BUFFEROVFL              0x10
+#define ERR_COLL                    0x08
+#define ERR_CRC                     0x04
+#define ERR_PARITY                  0x02
+
+#define BIT_STARTSEND               0x80
+#define BIT_TSTARTNOW               0x40
+#define BIT_TSTOPNOW                0x80
+#define BIT_CRCEN                   0x80
+#define BIT_MFCRYPTO1ON             0x08
+#define BIT_COLLPOSNOTVALID         0x20
+
+#define PN512_VERSION               0x82
+
+/*
+ * ISO14443-3A tag states
+ */
+#define TAG_POWER_OFF               0
+#define TAG_IDLE                    1
+#define TAG_READY                   2
+#define TAG_ACTIVE                  3
+#define TAG_HALT                    4
+#define TAG_AUTHENTICATED           5
+#define TAG_PROTOCOL                6   /* ISO14443-4, after RATS */
+
+/* Type 2 / MIFARE command set */
+#define T2_ACK                      0x0A
+#define T2_NAK                      0x00
+#define CMD_REQA                    0x26
+#define CMD_WUPA                    0x52
+#define CMD_HLTA                    0x50
+#define CMD_SEL_CL1                 0x93
+#define CMD_READ                    0x30
+#define CMD_WRITE                   0xA2
+#define CMD_COMPAT_WRITE            0xA0
+#define CMD_GET_VERSION             0x60
+#define CMD_FAST_READ               0x3A
+#define CMD_READ_SIG                0x3C
+#define CMD_READ_CNT                0x39
+#define CMD_PWD_AUTH                0x1B
+
+/* ISO14443-4 */
+#define T4_RATS                     0xE0
+#define T4_PCB_I                    0x02    /* bit 0 is the block number */
+#define T4_PCB_R                    0xA2
+#define T4_PCB_DESELECT             0xC2
+#define T4_PCB_CHAINING             0x10
+#define T4_PCB_NAK                  0x10
+#define T4_PCB_CID_NAD              0x0C
+#define T4_PPSS                     0xD0    /* bits 0-3 are the CID */
+#define T4_PPS0_PPS1                0x11    /* PPS1 follows */
+#define T4_FSCI                     5       /* FSC 64, a frame that fits the FIFO */
+#define T4_TA                       0x77    /* 212, 424 and 848 kbit/s, each direction on its own */
+
+typedef struct {
+    uint8_t data[SIM_MAX_FRAME + 2];
+    uint16_t bits;
+    uint8_t crc;                /* frame carries a CRC_A on air */
+} SimFrame_t;
+
+static const uint8_t sResetValues[64] = {
+    [REG_COMMAND] = 0x20, [REG_COMIEN] = 0x80, [REG_COMIRQ] = 0x14, [REG_WATERLEVEL] = 0x08,
+    [REG_CONTROL] = 0x10, [REG_COLL] = 0x80, [REG_MODE] = 0x3B, [REG_TXCONTROL] = 0x80,
+    [0x16] = 0x10, [0x17] = 0x84, [0x18] = 0x84, [0x19] = 0x4D, [0x24] = 0x26, [0x26] = 0x48,
+    [0x27] = 0x88, [0x28] = 0x20, [0x29] = 0x20, [REG_VERSION] = PN512_VERSION
+};
+
+static uint16_t sim_crc_a(const uint8_t *data, uint16_t len, uint16_t preset)
+{
+    uint16_t crc = preset;
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        uint8_t b = data[i] ^ (uint8_t) (crc & 0xFF);
+        b ^= (uint8_t) (b << 4);
+        crc = (crc >> 8) ^ ((uint16_t) b << 8) ^ ((uint16_t) b << 3) ^ (b >> 4);
+    }
+    return crc;
+}
+
+static void frame_set(SimFrame_t *frame, const uint8_t *data, uint16_t len, uint8_t crc)
+{
+    memcpy(frame->data, data, len);
+    frame->bits = len * 8;
+    frame->crc = crc;
+}
+
+static void frame_ack(SimFrame_t *frame, uint8_t ack)
+{
+    frame->data[0] = ack;
+    frame->bits = 4;
+    frame->crc = 0;
+}
+
+/*******************************************************************************
+** Virtual tags
+*******************************************************************************/
+
+static uint8_t tag_pages(SimTag_t *tag)
+{
+    return (uint8_t) (tag->memLen / tag->pageSize);
+}
+
+static void tag_to_idle(SimTag_t *tag)
+{
+    tag->state = tag->fromHalt ? TAG_HALT : TAG_IDLE;
+    tag->pendingWrite = -1;
+    tag->authSector = -1;
+    tag->rateToTag = 0;
+    tag->rateFromTag = 0;
+}
+
+/* Fill the 5 byte CLn field (4 UID bytes + BCC) for the given cascade level */
+static uint8_t tag_cascade_field(SimTag_t *tag, uint8_t level, uint8_t *field)
+{
+    uint8_t last = 0;
+
+    if (tag->uidLen == 4) {
+        memcpy(field, tag->uid, 4);
+        last = 1;
+    } else if (level == 0) {
+        field[0] = 0x88;
+        memcpy(&field[1], tag->uid, 3);
+    } else {
+        memcpy(field, &tag->uid[3], 4);
+        last = 1;
+    }
+    field[4] = field[0] ^ field[1] ^ field[2] ^ field[3];
+    return last;
+}
+
+static int tag_t2_write_page(SimTag_t *tag, uint8_t page, const uint8_t *data)
+{
+    uint8_t *dst;
+
+    if (page < 2 || page >= tag_pages(tag)) {
+        return -1;
+    }
+    dst = &tag->mem[page * 4];
+
+    if (page == 2) {
+        /* Serial number and internal bytes are read only, lock bits are OTP */
+        dst[2] |= data[2];
+        dst[3] |= data[3];
+    } else if (page == 3) {
+        /* Capability container is OTP */
+        dst[0] |= data[0];
+        dst[1] |= data[1];
+        dst[2] |= data[2];
+        dst[3] |= data[3];
+    } else {
+        memcpy(dst, data, 4);
+    }
+    return 0;
+}
+
+static void tag_t2_frame(SimTag_t *tag, const uint8_t *rx, uint16_t len, SimFrame_t *resp)
+{
+    uint8_t pages = tag_pages(tag);
+    uint8_t isNtag = tag->type != SIM_TAG_ULTRALIGHT;
+    uint8_t buffer[SIM_MAX_FRAME];
+    uint16_t i;
+
+    if (tag->pendingWrite >= 0) {
+        /* Second frame of COMPATIBILITY_WRITE: 16 bytes, only the first 4 are used */
+        if (len == 16 && tag_t2_write_page(tag, (uint8_t) tag->pendingWrite, rx) == 0) {
+            frame_ack(resp, T2_ACK);
+        } else {
+            frame_ack(resp, T2_NAK);
+        }
+        tag->pendingWrite = -1;
+        return;
+    }
+
+    switch (rx[0]) {
+    case CMD_READ:
+        if (len != 2 || rx[1] >= pages) {
+            break;
+        }
+        for (i = 0; i < 16; i++) {
+            buffer[i] = tag->mem[((rx[1] + i / 4) % pages) * 4 + i % 4];
+        }
+        frame_set(resp, buffer, 16, 1);
+        return;
+
+    case CMD_FAST_READ:
+        if (!isNtag || len != 3 || rx[2] < rx[1] || rx[2] >= pages) {
+            break;
+        }
+        i = (rx[2] - rx[1] + 1) * 4;
+        /* Longer answers overflow the reader FIFO anyway */
+        frame_set(resp, &tag->mem[rx[1] * 4], i > SIM_MAX_FRAME ? SIM_MAX_FRAME : i, 1);
+        return;
+
+    case CMD_WRITE:
+        if (len != 6 || tag_t2_write_page(tag, rx[1], &rx[2]) != 0) {
+            break;
+        }
+        frame_ack(resp, T2_ACK);
+        return;
+
+    case CMD_COMPAT_WRITE:
+        if (len != 2 || rx[1] < 2 || rx[1] >= pages) {
+            break;
+        }
+        tag->pendingWrite = rx[1];
+        frame_ack(resp, T2_ACK);
+        return;
+
+    case CMD_GET_VERSION:
+        if (!tag->hasVersion) {
+            tag_to_idle(tag);
+            return;
+        }
+        frame_set(resp, tag->version, sizeof(tag->version), 1);
+        return;
+
+    case CMD_READ_SIG:
+        if (!isNtag) {
+            tag_to_idle(tag);
+            return;
+        }
+        frame_set(resp, tag->signature, sizeof(tag->signature), 1);
+        return;
+
+    case CMD_READ_CNT:
+        if (!isNtag || len != 2 || rx[1] != 0x02) {
+            break;
+        }
+        memset(buffer, 0, 3);
+        frame_set(resp, buffer, 3, 1);
+        return;
+
+    case CMD_PWD_AUTH:
+        if (!isNtag || len != 5 || memcmp(&rx[1], &tag->mem[(pages - 2) * 4], 4) != 0) {
+            break;
+        }
+        frame_set(resp, &tag->mem[(pages - 1) * 4], 2, 1);
+        return;
+    }
+
+    frame_ack(resp, T2_NAK);
+    tag_to_idle(tag);
+}
+
+static void tag_classic_frame(SimTag_t *tag, const uint8_t *rx, uint16_t len, SimFrame_t *resp)
+{
+    uint8_t blocks = tag_pages(tag);
+    uint8_t buffer[16];
+
+    if (tag->pendingWrite >= 0) {
+        if (len == 16) {
+            memcpy(&tag->mem[tag->pendingWrite * 16], rx, 16);
+            frame_ack(resp, T2_ACK);
+        } else {
+            frame_ack(resp, T2_NAK);
+        }
+        tag->pendingWrite = -1;
+        return;
+    }
+
+    if (len == 2 && rx[1] < blocks && tag->state == TAG_AUTHENTICATED && rx[1] / 4 == tag->authSector) {
+        switch (rx[0]) {
+        case CMD_READ:
+            memcpy(buffer, &tag->mem[rx[1] * 16], 16);
+            if (rx[1] % 4 == 3) {
+                /* Key A is never readable */
+                memset(buffer, 0, 6);
+            }
+            frame_set(resp, buffer, 16, 1);
+            return;
+
+        case CMD_COMPAT_WRITE:
+            if (rx[1] == 0) {
+                break;
+            }
+            tag->pendingWrite = rx[1];
+            frame_ack(resp, T2_ACK);
+            return;
+        }
+    }
+
+    frame_ack(resp, 0x04);
+    tag_to_idle(tag);
+}
+
+/* Answer the complete command APDU. mem is a single file for READ/UPDATE BINARY. */
+static void tag_t4_apdu(SimTag_t *tag)
+{
+    const uint8_t *c = tag->command;
+    uint16_t len = tag->commandLen;
+    uint16_t offset = len >= 4 ? (c[2] << 8) | c[3] : 0;
+    uint16_t n = 0;
+    uint16_t sw = 0x9000;
+
+    tag->answerLen = 0;
+    if (len < 4 || c[0] != 0x00) {
+        sw = 0x6E00;
+    } else if (c[1] == 0xA4) {
+        /* SELECT: every application exists */
+    } else if (c[1] == 0xB0 && len == 5) {
+        n = c[4] ? c[4] : 256;
+        if (offset + n > tag->memLen) {
+            n = 0;
+            sw = 0x6B00;
+        }
+        memcpy(tag->answer, &tag->mem[offset], n);
+    } else if (c[1] == 0xD6 && len >= 5 && len == 5 + c[4]) {
+        if (offset + c[4] > tag->memLen) {
+            sw = 0x6B00;
+        } else {
+            memcpy(&tag->mem[offset], &c[5], c[4]);
+        }
+    } else {
+        sw = 0x6D00;
+    }
+
+    tag->answer[n] = sw >> 8;
+    tag->answer[n + 1] = sw & 0xFF;
+    tag->answerLen = n + 2;
+    tag->answerPos = 0;
+}
+
+/* Send the answer block starting at pos, chained if more follows */
+static void tag_t4_send(SimTag_t *tag, uint16_t pos, uint8_t blockNumber, SimFrame_t *resp)
+{
+    /* PCB and CRC within FSD, and within the FIFO since the model has no refill */
+    uint16_t max = (tag->fsd < SIM_FIFO_SIZE + 2 ? tag->fsd : SIM_FIFO_SIZE + 2) - 3;
+    uint16_t chunk = tag->answerLen - pos;
+
+    if (chunk > max) {
+        chunk = max;
+    }
+    resp->data[0] = T4_PCB_I | blockNumber | (pos + chunk < tag->answerLen ? T4_PCB_CHAINING : 0);
+    memcpy(&resp->data[1], &tag->answer[pos], chunk);
+    resp->bits = (chunk + 1) * 8;
+    resp->crc = 1;
+
+    tag->lastPos = pos;
+    tag->answerPos = pos + chunk;
+}
+
+static void tag_t4_frame(SimTag_t *tag, const uint8_t *rx, uint16_t len, SimFrame_t *resp)
+{
+    static const uint16_t fsdSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+    uint8_t pcb = rx[0];
+
+    if (tag->state == TAG_ACTIVE) {
+        if (len == 2 && rx[0] == T4_RATS) {
+            /* TB: FWI 8 and no SFGT, TC: no CID or NAD */
+            static const uint8_t ats[] = { 0x05, 0x70 | T4_FSCI, T4_TA, 0x80, 0x00 };
+
+            tag->fsd = fsdSizes[(rx[1] >> 4) < 8 ? rx[1] >> 4 : 8];
+            tag->commandLen = 0;
+            tag->answerLen = 0;
+            tag->ppsAllowed = 1;
+            tag->state = TAG_PROTOCOL;
+            frame_set(resp, ats, sizeof(ats), 1);
+            return;
+        }
+        tag_to_idle(tag);
+        return;
+    }
+
+    if (len < 1 || (pcb & T4_PCB_CID_NAD)) {
+        return;
+    }
+
+    if (pcb == T4_PPSS && tag->ppsAllowed) {
+        /* PPS1 is DSI in bits 2-3 and DRI in bits 0-1, both must be in TA */
+        uint8_t dsi = len == 3 ? (rx[2] >> 2) & 0x03 : 0;
+        uint8_t dri = len == 3 ? rx[2] & 0x03 : 0;
+
+        if ((len == 2 && rx[1] == 0x01) ||
+            (len == 3 && rx[1] == T4_PPS0_PPS1 && !(rx[2] & 0xF0) &&
+             (!dsi || (T4_TA & (0x08 << dsi))) && (!dri || (T4_TA & (0x01 << (dri - 1)))))) {
+            /* The answer still goes out at the old rates */
+            frame_set(resp, &pcb, 1, 1);
+            tag->rateToTag = dri;
+            tag->rateFromTag = dsi;
+        }
+        tag->ppsAllowed = 0;
+        return;
+    }
+    tag->ppsAllowed = 0;
+
+    if ((pcb & 0xE2) == T4_PCB_I) {
+        if (tag->commandLen + len - 1 > SIM_MAX_APDU) {
+            tag->commandLen = 0;
+            return;
+        }
+        memcpy(&tag->command[tag->commandLen], &rx[1], len - 1);
+        tag->commandLen += len - 1;
+
+        if (pcb & T4_PCB_CHAINING) {
+            resp->data[0] = T4_PCB_R | (pcb & 0x01);
+            resp->bits = 8;
+            resp->crc = 1;
+            return;
+        }
+        tag_t4_apdu(tag);
+        tag->commandLen = 0;
+        tag_t4_send(tag, 0, pcb & 0x01, resp);
+    } else if ((pcb & 0xE6) == T4_PCB_R) {
+        /* ACK: the next block of a chained answer, NAK: the last one again */
+        if (!(pcb & T4_PCB_NAK) && tag->answerPos < tag->answerLen) {
+            tag_t4_send(tag, tag->answerPos, pcb & 0x01, resp);
+        } else {
+            tag_t4_send(tag, tag->lastPos, pcb & 0x01, resp);
+        }
+    } else if (pcb == T4_PCB_DESELECT) {
+        frame_set(resp, &pcb, 1, 1);
+        tag->state = TAG_HALT;
+        tag->rateToTag = 0;
+        tag->rateFromTag = 0;
+    }
+}
+
+/*
+ * Run one received frame through a tag's ISO14443-3A state machine.
+ * resp->bits is left at 0 when the tag stays silent.
+ */
+static void tag_frame(SimTag_t *tag, const uint8_t *rx, uint16_t len, uint16_t bits, SimFrame_t *resp)
+{
+    uint8_t field[5];
+    uint8_t last;
+
+    resp->bits = 0;
+
+    /* Short frames: REQA / WUPA */
+    if (bits == 7) {
+        uint8_t cmd = rx[0] & 0x7F;
+
+        if ((cmd == CMD_REQA && tag->state == TAG_IDLE) ||
+            (cmd == CMD_WUPA && (tag->state == TAG_IDLE || tag->state == TAG_HALT))) {
+            tag->fromHalt = tag->state == TAG_HALT;
+            tag->state = TAG_READY;
+            tag->cascadeLevel = 0;
+            frame_set(resp, tag->atqa, 2, 0);
+        } else if (cmd == CMD_REQA || cmd == CMD_WUPA) {
+            if (tag->state != TAG_HALT) {
+                tag_to_idle(tag);
+            }
+        }
+        return;
+    }
+
+    if (tag->state == TAG_READY) {
+        if (len < 2 || rx[0] != CMD_SEL_CL1 + 2 * tag->cascadeLevel) {
+            tag_to_idle(tag);
+            return;
+        }
+        last = tag_cascade_field(tag, tag->cascadeLevel, field);
+
+        if (rx[1] == 0x70) {
+            /* SELECT */
+            if (len != 7 || memcmp(&rx[2], field, 5) != 0) {
+                tag_to_idle(tag);
+                return;
+            }
+            resp->data[0] = last ? tag->sak : 0x04;
+            resp->bits = 8;
+            resp->crc = 1;
+            if (last) {
+                tag->state = TAG_ACTIVE;
+            } else {
+                tag->cascadeLevel++;
+            }
+        } else {
+            /* ANTICOLLISION: answer with the bits of CLn the reader doesn't know yet */
+            uint16_t known = ((rx[1] >> 4) - 2) * 8 + (rx[1] & 0x0F);
+            uint16_t i;
+
+            if (rx[1] < 0x20 || known >= 40 || bits < 16 + known) {
+                return;
+            }
+            for (i = 0; i < known; i++) {
+                if (((rx[2 + i / 8] >> (i % 8)) & 1) != ((field[i / 8] >> (i % 8)) & 1)) {
+                    return;
+                }
+            }
+            memset(resp->data, 0, 5);
+            for (i = known; i < 40; i++) {
+                uint16_t j = i - known;
+                resp->data[j / 8] |= ((field[i / 8] >> (i % 8)) & 1) << (j % 8);
+            }
+            resp->bits = 40 - known;
+            resp->crc = 0;
+        }
+        return;
+    }
+
+    if (tag->state != TAG_ACTIVE && tag->state != TAG_AUTHENTICATED && tag->state != TAG_PROTOCOL) {
+        return;
+    }
+
+    if (len == 2 && rx[0] == CMD_HLTA && rx[1] == 0x00 && tag->pendingWrite < 0) {
+        tag->state = TAG_HALT;
+        tag->authSector = -1;
+        tag->rateToTag = 0;
+        tag->rateFromTag = 0;
+        return;
+    }
+
+    if (tag->type == SIM_TAG_TYPE4) {
+        tag_t4_frame(tag, rx, len, resp);
+    } else if (tag->type == SIM_TAG_CLASSIC_1K) {
+        tag_classic_frame(tag, rx, len, resp);
+    } else {
+        tag_t2_frame(tag, rx, len, resp);
+    }
+}
+
+static void tag_setup(SimTag_t *tag, uint8_t type, const uint8_t *uid, uint8_t uidLen)
+{
+    static const uint8_t trailer[16] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    };
+    uint16_t pages = 0;
+    uint8_t cc = 0;
+    uint8_t sizeCode = 0;
+    uint16_t i;
+
+    memset(tag, 0, sizeof(*tag));
+    tag->type = type;
+    tag->uidLen = uidLen;
+    memcpy(tag->uid, uid, uidLen);
+    tag->pendingWrite = -1;
+    tag->authSector = -1;
+    tag->state = TAG_POWER_OFF;
+
+    for (i = 0; i < sizeof(tag->signature); i++) {
+        tag->signature[i] = uid[i % uidLen] ^ (uint8_t) (i * 0x1D);
+    }
+
+    if (type == SIM_TAG_CLASSIC_1K) {
+        tag->atqa[0] = 0x04;
+        tag->sak = 0x08;
+        tag->pageSize = 16;
+        tag->memLen = 1024;
+
+        memcpy(tag->mem, uid, 4);
+        tag->mem[4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+        tag->mem[5] = tag->sak;
+        tag->mem[6] = tag->atqa[0];
+        tag->mem[7] = tag->atqa[1];
+        for (i = 0; i < 16; i++) {
+            memcpy(&tag->mem[(i * 4 + 3) * 16], trailer, 16);
+        }
+        return;
+    }
+
+    if (type == SIM_TAG_TYPE4) {
+        tag->atqa[0] = 0x44;
+        tag->atqa[1] = 0x03;
+        tag->sak = 0x20;
+        tag->pageSize = 16;
+        tag->memLen = SIM_MAX_TAG_MEMORY;
+        return;
+    }
+
+    switch (type) {
+    case SIM_TAG_NTAG213:
+        pages = 45;
+        cc = 0x12;
+        sizeCode = 0x0F;
+        break;
+    case SIM_TAG_NTAG215:
+        pages = 135;
+        cc = 0x3E;
+        sizeCode = 0x11;
+        break;
+    case SIM_TAG_NTAG216:
+        pages = 231;
+        cc = 0x6D;
+        sizeCode = 0x13;
+        break;
+    case SIM_TAG_ULTRALIGHT:
+        pages = 16;
+        cc = 0x06;
+        break;
+    }
+
+    tag->atqa[0] = 0x44;
+    tag->sak = 0x00;
+    tag->pageSize = 4;
+    tag->memLen = pages * 4;
+
+    tag->mem[0] = uid[0];
+    tag->mem[1] = uid[1];
+    tag->mem[2] = uid[2];
+    tag->mem[3] = 0x88 ^ uid[0] ^ uid[1] ^ uid[2];
+    memcpy(&tag->mem[4], &uid[3], 4);
+    tag->mem[8] = uid[3] ^ uid[4] ^ uid[5] ^ uid[6];
+    tag->mem[9] = 0x48;
+    tag->mem[12] = 0xE1;
+    tag->mem[13] = 0x10;
+    tag->mem[14] = cc;
+
+    if (sizeCode) {
+        static const uint8_t version[8] = { 0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x00, 0x03 };
+
+        memcpy(tag->version, version, sizeof(version));
+        tag->version[6] = sizeCode;
+        tag->hasVersion = 1;
+
+        /* Dynamic lock, CFG0, CFG1, PWD, PACK */
+        tag->mem[(pages - 5) * 4 + 3] = 0xBD;
+        tag->mem[(pages - 4) * 4 + 0] = 0x04;
+        tag->mem[(pages - 4) * 4 + 3] = 0xFF;
+        tag->mem[(pages - 3) * 4 + 1] = 0x05;
+        memset(&tag->mem[(pages - 2) * 4], 0xFF, 4);
+    }
+}
+
+/*******************************************************************************
+** Reader IC
+*******************************************************************************/
+
+static void chip_update_status(SimPn512_t *chip)
+{
+    uint8_t status = chip->regs[REG_STATUS1] & 0x60;   /* CRCOk, CRCReady */
+    uint8_t water = chip->regs[REG_WATERLEVEL] & 0x3F;
+
+    if (chip->fifoLevel <= water) {
+        status |= 0x01;
+    }
+    if (SIM_FIFO_SIZE - chip->fifoLevel <= water) {
+        status |= 0x02;
+    }
+    if (chip->fieldOn) {
+        status |= 0x04;
+    }
+    if ((chip->regs[REG_COMIRQ] & chip->regs[REG_COMIEN] & 0x7F) ||
+        (chip->regs[REG_DIVIRQ] & chip->regs[REG_DIVIEN] & 0x1F)) {
+        status |= 0x10;
+    }
+    chip->regs[REG_STATUS1] = status;
+}
+
+/* Recompute the IRQ line; returns 1 on a rising edge */
+static int chip_update_irq(SimPn512_t *chip)
+{
+    uint8_t previous = chip->irqLine;
+
+    chip_update_status(chip);
+    chip->irqLine = (chip->regs[REG_STATUS1] & 0x10) ? 1 : 0;
+    return chip->irqLine && !previous;
+}
+
+static void chip_set_field(SimPn512_t *chip, uint8_t on)
+{
+    int i;
+
+    if (on == chip->fieldOn) {
+        return;
+    }
+    chip->fieldOn = on;
+
+    for (i = 0; i < SIM_MAX_TAGS; i++) {
+        SimTag_t *tag = &chip->tags[i];
+
+        if (!tag->type) {
+            continue;
+        }
+        tag->fromHalt = 0;
+        tag_to_idle(tag);
+        if (!on) {
+            tag->state = TAG_POWER_OFF;
+        }
+    }
+}
+
+static void chip_soft_reset(SimPn512_t *chip)
+{
+    memcpy(chip->regs, sResetValues, sizeof(chip->regs));
+    chip->fifoLevel = 0;
+    chip_set_field(chip, 0);
+}
+
+static void chip_delay(SimPn512_t *chip)
+{
+    struct timespec ts;
+
+    if (!chip->latencyUs) {
+        return;
+    }
+    ts.tv_sec = chip->latencyUs / 1000000;
+    ts.tv_nsec = (long) (chip->latencyUs % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+}
+
+static uint8_t chip_take_fault(SimPn512_t *chip)
+{
+    if (!chip->faultCount) {
+        return SIM_FAULT_NONE;
+    }
+    if (chip->faultSkip) {
+        chip->faultSkip--;
+        return SIM_FAULT_NONE;
+    }
+    chip->faultCount--;
+    return chip->faultKind;
+}
+
+/* Move a received frame into the FIFO, honouring RxAlign */
+static void chip_receive(SimPn512_t *chip, const SimFrame_t *frame, uint8_t errors)
+{
+    uint8_t rxAlign = (chip->regs[REG_BITFRAMING] >> 4) & 0x07;
+    uint8_t out[SIM_MAX_FRAME + 3];
+    uint16_t totalBits = rxAlign + frame->bits;
+    uint16_t bytes = (totalBits + 7) / 8;
+    uint16_t i;
+
+    memset(out, 0, sizeof(out));
+    for (i = 0; i < frame->bits; i++) {
+        uint16_t p = rxAlign + i;
+        out[p / 8] |= ((frame->data[i / 8] >> (i % 8)) & 1) << (p % 8);
+    }
+
+    if (bytes > SIM_FIFO_SIZE - chip->fifoLevel) {
+        bytes = SIM_FIFO_SIZE - chip->fifoLevel;
+        errors |= ERR_BUFFEROVFL;
+    }
+    memcpy(&chip->fifo[chip->fifoLevel], out, bytes);
+    chip->fifoLevel += bytes;
+
+    chip->regs[REG_CONTROL] = (chip->regs[REG_CONTROL] & ~0x07) | (totalBits % 8);
+    chip->regs[REG_ERROR] |= errors;
+    chip->regs[REG_COMIRQ] |= IRQ_RX;
+    if (errors) {
+        chip->regs[REG_COMIRQ] |= IRQ_ERR;
+    }
+}
+
+/* Send the FIFO contents over the air and collect the answer of every tag in the field */
+static void chip_transceive(SimPn512_t *chip, uint8_t expectAnswer)
+{
+    uint8_t rx[SIM_MAX_FRAME];
+    uint16_t len = chip->fifoLevel;
+    uint8_t txLastBits = chip->regs[REG_BITFRAMING] & 0x07;
+    uint8_t txRate = (chip->regs[REG_TXMODE] >> 4) & 0x07;
+    uint8_t rxRate = (chip->regs[REG_RXMODE] >> 4) & 0x07;
+    uint8_t typeA = !(chip->regs[REG_TXMODE] & 0x03);     /* TxFraming, the model has no B or FeliCa tags */
+    uint16_t bits = txLastBits ? (len - 1) * 8 + txLastBits : len * 8;
+    SimFrame_t answer;
+    SimFrame_t combined;
+    int responders = 0;
+    int collision = -1;
+    uint8_t errors = 0;
+    uint8_t fault;
+    int i;
+
+    memcpy(rx, chip->fifo, len);
+    chip->fifoLevel = 0;
+    chip->regs[REG_ERROR] = 0;
+    chip->regs[REG_COLL] |= BIT_COLLPOSNOTVALID;
+    chip->rfTransactions++;
+    chip_delay(chip);
+
+    chip->regs[REG_COMIRQ] |= IRQ_TX;
+
+    /* Strip a CRC the host appended itself when the CRC coprocessor is disabled */
+    if (!(chip->regs[REG_TXMODE] & BIT_CRCEN) && !txLastBits && len >= 3 &&
+        !(rx[0] >= CMD_SEL_CL1 && rx[0] <= CMD_SEL_CL1 + 4 && rx[1] != 0x70)) {
+        uint16_t crc = sim_crc_a(rx, len - 2, 0x6363);
+
+        if (rx[len - 2] == (crc & 0xFF) && rx[len - 1] == (crc >> 8)) {
+            len -= 2;
+            bits -= 16;
+        }
+    }
+
+    combined.bits = 0;
+    for (i = 0; chip->fieldOn && typeA && len && i < SIM_MAX_TAGS; i++) {
+        uint8_t rateFromTag = chip->tags[i].rateFromTag;
+        uint16_t b;
+
+        /* A tag only hears frames sent at its bit rate, and answers at its own */
+        if (!chip->tags[i].type || chip->tags[i].state == TAG_POWER_OFF || chip->tags[i].rateToTag != txRate) {
+            continue;
+        }
+        tag_frame(&chip->tags[i], rx, len, bits, &answer);
+        if (!answer.bits || rateFromTag != rxRate) {
+            continue;
+        }
+
+        if (!responders++) {
+            combined = answer;
+            continue;
+        }
+
+        /* Several tags answering at once: find the first bit where they disagree */
+        if (answer.bits < combined.bits) {
+            combined.bits = answer.bits;
+        }
+        for (b = 0; b < combined.bits; b++) {
+            if (((answer.data[b / 8] ^ combined.data[b / 8]) >> (b % 8)) & 1) {
+                if (collision < 0 || b < collision) {
+                    collision = b;
+                }
+                break;
+            }
+        }
+    }
+
+    fault = chip_take_fault(chip);
+    if (fault == SIM_FAULT_TIMEOUT) {
+        combined.bits = 0;
+    } else if (fault == SIM_FAULT_NAK) {
+        frame_ack(&combined, T2_NAK);
+    } else if (fault == SIM_FAULT_COLLISION && combined.bits) {
+        collision = 0;
+    } else if (fault == SIM_FAULT_CRC) {
+        errors |= ERR_CRC;
+    } else if (fault == SIM_FAULT_PARITY) {
+        errors |= ERR_PARITY;
+    }
+
+    if (!expectAnswer || !combined.bits) {
+        chip->regs[REG_COMIRQ] |= IRQ_TIMER;
+        return;
+    }
+
+    if (collision >= 0) {
+        uint8_t rxAlign = (chip->regs[REG_BITFRAMING] >> 4) & 0x07;
+
+        /* Received bits are valid up to and including the collision, which reads as 1 */
+        combined.data[collision / 8] |= 1 << (collision % 8);
+        combined.bits = collision + 1;
+        combined.crc = 0;
+        chip->regs[REG_COLL] = (chip->regs[REG_COLL] & 0x80) | ((rxAlign + collision + 1) & 0x1F);
+        errors |= ERR_COLL;
+    }
+
+    if (combined.crc) {
+        uint16_t bytes = combined.bits / 8;
+
+        if (!(chip->regs[REG_RXMODE] & BIT_CRCEN)) {
+            uint16_t crc = sim_crc_a(combined.data, bytes, 0x6363);
+
+            combined.data[bytes] = crc & 0xFF;
+            combined.data[bytes + 1] = crc >> 8;
+            combined.bits += 16;
+        }
+    } else if ((chip->regs[REG_RXMODE] & BIT_CRCEN) && !(combined.bits % 8) && !(errors & ERR_COLL)) {
+        errors |= ERR_CRC;
+    }
+
+    chip_receive(chip, &combined, errors);
+}
+
+static void chip_mfauthent(SimPn512_t *chip)
+{
+    int i;
+
+    chip->regs[REG_ERROR] = 0;
+    chip->rfTransactions++;
+    chip_delay(chip);
+
+    for (i = 0; chip->fifoLevel >= 12 && i < SIM_MAX_TAGS; i++) {
+        SimTag_t *tag = &chip->tags[i];
+        uint8_t *fifo = chip->fifo;
+        uint8_t block = fifo[1];
+        uint8_t *key;
+
+        if (tag->type != SIM_TAG_CLASSIC_1K ||
+            (tag->state != TAG_ACTIVE && tag->state != TAG_AUTHENTICATED) ||
+            block >= tag_pages(tag) || memcmp(&fifo[8], &tag->uid[tag->uidLen - 4], 4) != 0) {
+            continue;
+        }
+
+        key = &tag->mem[((block / 4) * 4 + 3) * 16 + (fifo[0] == 0x61 ? 10 : 0)];
+        if (memcmp(key, &fifo[2], 6) != 0) {
+            tag_to_idle(tag);
+            break;
+        }
+
+        tag->state = TAG_AUTHENTICATED;
+        tag->authSector = block / 4;
+        chip->fifoLevel = 0;
+        chip->regs[REG_STATUS2] |= BIT_MFCRYPTO1ON;
+        chip->regs[REG_COMMAND] &= ~CMD_MASK;
+        chip->regs[REG_COMIRQ] |= IRQ_IDLE;
+        return;
+    }
+
+    chip->fifoLevel = 0;
+    chip->regs[REG_COMIRQ] |= IRQ_TIMER;
+}
+
+static void chip_command(SimPn512_t *chip, uint8_t value)
+{
+    uint8_t cmd = value & CMD_MASK;
+    uint16_t crc;
+    uint16_t preset;
+
+    if (cmd == CMD_NOCMDCHANGE) {
+        chip->regs[REG_COMMAND] = (chip->regs[REG_COMMAND] & CMD_MASK) | (value & 0x30);
+        return;
+    }
+    chip->regs[REG_COMMAND] = value & 0x3F;
+
+    switch (cmd) {
+    case CMD_SOFTRESET:
+        chip_soft_reset(chip);
+        chip->regs[REG_COMMAND] = 0x20;
+        break;
+
+    case CMD_CALCCRC:
+        switch (chip->regs[REG_MODE] & 0x03) {
+        case 0:
+            preset = 0x0000;
+            break;
+        case 1:
+            preset = 0x6363;
+            break;
+        case 2:
+            preset = 0xA671;
+            break;
+        default:
+            preset = 0xFFFF;
+            break;
+        }
+        crc = sim_crc_a(chip->fifo, chip->fifoLevel, preset);
+        chip->fifoLevel = 0;
+        chip->regs[REG_CRCRESULT_MSB] = crc >> 8;
+        chip->regs[REG_CRCRESULT_LSB] = crc & 0xFF;
+        chip->regs[REG_STATUS1] |= 0x20;
+        chip->regs[REG_DIVIRQ] |= DIVIRQ_CRC;
+        break;
+
+    case CMD_TRANSMIT:
+        chip_transceive(chip, 0);
+        chip->regs[REG_COMIRQ] &= ~IRQ_TIMER;
+        chip->regs[REG_COMIRQ] |= IRQ_IDLE;
+        chip->regs[REG_COMMAND] &= ~CMD_MASK;
+        break;
+
+    case CMD_RECEIVE:
+        /* Nothing is transmitted so nothing will answer */
+        chip->regs[REG_COMIRQ] |= IRQ_TIMER;
+        break;
+
+    case CMD_TRANSCEIVE:
+        if (chip->regs[REG_BITFRAMING] & BIT_STARTSEND) {
+            chip_transceive(chip, 1);
+        }
+        break;
+
+    case CMD_MFAUTHENT:
+        chip_mfauthent(chip);
+        break;
+
+    case CMD_IDLE:
+        break;
+
+    default:
+        /* Commands without an RF side effect complete immediately */
+        chip->regs[REG_COMIRQ] |= IRQ_IDLE;
+        chip->regs[REG_COMMAND] &= ~CMD_MASK;
+        break;
+    }
+}
+
+static uint8_t chip_read(SimPn512_t *chip, uint8_t reg)
+{
+    uint8_t value;
+
+    switch (reg) {
+    case REG_FIFODATA:
+        if (!chip->fifoLevel) {
+            return 0;
+        }
+        value = chip->fifo[0];
+        memmove(chip->fifo, &chip->fifo[1], --chip->fifoLevel);
+        return value;
+
+    case REG_FIFOLEVEL:
+        return chip->fifoLevel;
+
+    case REG_STATUS1:
+        chip_update_status(chip);
+        return chip->regs[REG_STATUS1];
+
+    default:
+        return chip->regs[reg];
+    }
+}
+
+static void chip_write(SimPn512_t *chip, uint8_t reg, uint8_t value)
+{
+    switch (reg) {
+    case REG_COMMAND:
+        chip_command(chip, value);
+        break;
+
+    case REG_COMIRQ:
+    case REG_DIVIRQ:
+        if (value & 0x80) {
+            chip->regs[reg] |= value & 0x7F;
+        } else {
+            chip->regs[reg] &= ~value;
+        }
+        break;
+
+    case REG_FIFODATA:
+        if (chip->fifoLevel < SIM_FIFO_SIZE) {
+            chip->fifo[chip->fifoLevel++] = value;
+        } else {
+            chip->regs[REG_ERROR] |= ERR_BUFFEROVFL;
+        }
+        break;
+
+    case REG_FIFOLEVEL:
+        if (value & 0x80) {
+            chip->fifoLevel = 0;
+            chip->regs[REG_ERROR] &= ~ERR_BUFFEROVFL;
+        }
+        break;
+
+    case REG_CONTROL:
+        chip->regs[REG_CONTROL] = (chip->regs[REG_CONTROL] & 0x07) | (value & 0x30);
+        if (value & BIT_TSTARTNOW) {
+            /* Timers run infinitely fast in the model */
+            chip->regs[REG_COMIRQ] |= IRQ_TIMER;
+        }
+        break;
+
+    case REG_BITFRAMING:
+        chip->regs[REG_BITFRAMING] = value;
+        if ((value & BIT_STARTSEND) && (chip->regs[REG_COMMAND] & CMD_MASK) == CMD_TRANSCEIVE) {
+            chip_transceive(chip, 1);
+        }
+        break;
+
+    case REG_STATUS2:
+        chip->regs[REG_STATUS2] = (chip->regs[REG_STATUS2] & ~0xC8) | (value & 0xC8);
+        break;
+
+    case REG_TXCONTROL:
+        chip->regs[REG_TXCONTROL] = value;
+        chip_set_field(chip, (value & 0x03) ? 1 : 0);
+        break;
+
+    case REG_ERROR:
+    case REG_STATUS1:
+    case REG_VERSION:
+        break;
+
+    default:
+        chip->regs[reg] = value;
+        break;
+    }
+}
+
+/*******************************************************************************
+** Public interface
+*******************************************************************************/
+
+void SimPn512_Init(SimPn512_t *chip)
+{
+    memset(chip, 0, sizeof(*chip));
+    pthread_mutex_init(&chip->lock, NULL);
+    chip_soft_reset(chip);
+}
+
+void SimPn512_Reset(SimPn512_t *chip)
+{
+    pthread_mutex_lock(&chip->lock);
+    chip_soft_reset(chip);
+    chip->irqLine = 0;
+    chip->faultCount = 0;
+    chip->faultSkip = 0;
+    chip->latencyUs = 0;
+    pthread_mutex_unlock(&chip->lock);
+}
+
+void SimPn512_Spi(SimPn512_t *chip, const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+    uint16_t i;
+    int edge = 0;
+
+    if (!len) {
+        return;
+    }
+
+    pthread_mutex_lock(&chip->lock);
+    chip->spiTransfers++;
+
+    rx[0] = 0x00;
+    if (tx[0] & 0x80) {
+        /* Read: every byte clocks out the register addressed by the previous one */
+        for (i = 1; i < len; i++) {
+            rx[i] = chip_read(chip, (tx[i - 1] >> 1) & 0x3F);
+        }
+    } else {
+        /* Write: every data byte goes to the addressed register (FIFO bursts) */
+        for (i = 1; i < len; i++) {
+            rx[i] = 0x00;
+            chip_write(chip, (tx[0] >> 1) & 0x3F, tx[i]);
+        }
+    }
+    edge = chip_update_irq(chip);
+    pthread_mutex_unlock(&chip->lock);
+
+    if (edge && chip->irqHandler) {
+        chip->irqHandler(chip->irqContext);
+    }
+}
+
+void SimPn512_SpiMessage(SimPn512_t *chip, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count)
+{
+    unsigned int offset = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&chip->lock);
+    chip->spiMessages++;
+    pthread_mutex_unlock(&chip->lock);
+
+    for (i = 0; i < count; i++) {
+        SimPn512_Spi(chip, &tx[offset], &rx[offset], lens[i]);
+        offset += lens[i];
+    }
+}
+
+void SimPn512_SetIrqHandler(SimPn512_t *chip, void (*handler)(void *ctx), void *ctx)
+{
+    pthread_mutex_lock(&chip->lock);
+    chip->irqHandler = handler;
+    chip->irqContext = ctx;
+    pthread_mutex_unlock(&chip->lock);
+}
+
+void SimPn512_SetLatency(SimPn512_t *chip, uint32_t latencyUs)
+{
+    pthread_mutex_lock(&chip->lock);
+    chip->latencyUs = latencyUs;
+    pthread_mutex_unlock(&chip->lock);
+}
+
+void SimPn512_InjectFault(SimPn512_t *chip, uint8_t kind, uint32_t count, uint32_t skip)
+{
+    pthread_mutex_lock(&chip->lock);
+    chip->faultKind = kind;
+    chip->faultCount = kind == SIM_FAULT_NONE ? 0 : count;
+    chip->faultSkip = skip;
+    pthread_mutex_unlock(&chip->lock);
+}
+
+int SimPn512_AddTag(SimPn512_t *chip, uint8_t type, const uint8_t *uid, uint8_t uidLen)
+{
+    uint8_t generated[7];
+    uint8_t expected = type == SIM_TAG_CLASSIC_1K ? 4 : 7;
+    int slot;
+
+    if (type < SIM_TAG_NTAG213 || type > SIM_TAG_TYPE4) {
+        return -1;
+    }
+    if (uid != NULL && uidLen != expected) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&chip->lock);
+    for (slot = 0; slot < SIM_MAX_TAGS; slot++) {
+        if (!chip->tags[slot].type) {
+            break;
+        }
+    }
+    if (slot == SIM_MAX_TAGS) {
+        pthread_mutex_unlock(&chip->lock);
+        return -1;
+    }
+
+    if (uid == NULL) {
+        uint32_t n = ++chip->uidCounter * 2654435761u;
+
+        /* NXP manufacturer code for 7 byte UIDs, never a cascade tag for 4 byte ones */
+        generated[0] = expected == 7 ? 0x04 : (uint8_t) (0x10 | (n & 0x0F));
+        generated[1] = (uint8_t) (n >> 24);
+        generated[2] = (uint8_t) (n >> 16);
+        generated[3] = (uint8_t) (n >> 8);
+        generated[4] = (uint8_t) n;
+        generated[5] = (uint8_t) chip->uidCounter;
+        generated[6] = (uint8_t) (chip->uidCounter >> 8);
+        uid = generated;
+    }
+
+    tag_setup(&chip->tags[slot], type, uid, expected);
+    if (chip->fieldOn) {
+        chip->tags[slot].state = TAG_IDLE;
+    }
+    pthread_mutex_unlock(&chip->lock);
+    return slot;
+}
+
+int SimPn512_RemoveTag(SimPn512_t *chip, int slot)
+{
+    if (slot < 0 || slot >= SIM_MAX_TAGS) {
+        return -1;
+    }
+    pthread_mutex_lock(&chip->lock);
+    if (!chip->tags[slot].type) {
+        pthread_mutex_unlock(&chip->lock);
+        return -1;
+    }
+    chip->tags[slot].type = 0;
+    pthread_mutex_unlock(&chip->lock);
+    return 0;
+}
+
+void SimPn512_RemoveAllTags(SimPn512_t *chip)
+{
+    int i;
+
+    pthread_mutex_lock(&chip->lock);
+    for (i = 0; i < SIM_MAX_TAGS; i++) {
+        chip->tags[i].type = 0;
+    }
+    pthread_mutex_unlock(&chip->lock);
+}
+
+int SimPn512_ReadMemory(SimPn512_t *chip, int slot, uint8_t *buffer, uint16_t bufferLen)
+{
+    int len;
+
+    if (slot < 0 || slot >= SIM_MAX_TAGS) {
+        return -1;
+    }
+    pthread_mutex_lock(&chip->lock);
+    if (!chip->tags[slot].type) {
+        pthread_mutex_unlock(&chip->lock);
+        return -1;
+    }
+    len = chip->tags[slot].memLen < bufferLen ? chip->tags[slot].memLen : bufferLen;
+    memcpy(buffer, chip->tags[slot].mem, len);
+    pthread_mutex_unlock(&chip->lock);
+    return len;
+}
+
+int SimPn512_WriteMemory(SimPn512_t *chip, int slot, uint16_t offset, const uint8_t *data, uint16_t dataLen)
+{
+    if (slot < 0 || slot >= SIM_MAX_TAGS) {
+        return -1;
+    }
+    pthread_mutex_lock(&chip->lock);
+    if (!chip->tags[slot].type || offset + dataLen > chip->tags[slot].memLen) {
+        pthread_mutex_unlock(&chip->lock);
+        return -1;
+    }
+    memcpy(&chip->tags[slot].mem[offset], data, dataLen);
+    pthread_mutex_unlock(&chip->lock);
+    return dataLen;
+}
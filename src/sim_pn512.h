@@ -0,0 +1,120 @@
+#ifndef SIM_PN512_H
+#define SIM_PN512_H
+/*
+ * Software model of a PN512 reader IC and the ISO14443-3A tags in its field,
+ * plus an ISO14443-4 card for APDU traffic.
+ *
+ * The model speaks the PN512 SPI register protocol (address byte followed by
+ * data, MSB set for reads) so it can sit directly underneath the NXP Reader
+ * Library HAL in place of /dev/spidev. It has no dependency on Python or the
+ * Reader Library so it can be driven from anywhere.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SIM_FIFO_SIZE               64
+#define SIM_MAX_TAGS                8
+#define SIM_MAX_TAG_MEMORY          1024
+#define SIM_MAX_UID_LENGTH          10
+#define SIM_MAX_FRAME               256
+#define SIM_MAX_APDU                264     /* short APDUs: 5 header bytes, 255 data, Le */
+
+/* Virtual tag types */
+#define SIM_TAG_NTAG213             1
+#define SIM_TAG_NTAG215             2
+#define SIM_TAG_NTAG216             3
+#define SIM_TAG_ULTRALIGHT          4
+#define SIM_TAG_CLASSIC_1K          5
+#define SIM_TAG_TYPE4               6   /* ISO14443-4 card, mem is one binary file */
+
+/* Faults that can be injected into RF transactions */
+#define SIM_FAULT_NONE              0
+#define SIM_FAULT_TIMEOUT           1   /* tag does not answer */
+#define SIM_FAULT_CRC               2   /* answer received with a CRC error */
+#define SIM_FAULT_PARITY            3   /* answer received with a parity error */
+#define SIM_FAULT_COLLISION         4   /* answer received with a bit collision */
+#define SIM_FAULT_NAK               5   /* tag answers with a NAK */
+
+typedef struct {
+    uint8_t type;               /* SIM_TAG_xxx, 0 for an empty slot */
+    uint8_t uid[SIM_MAX_UID_LENGTH];
+    uint8_t uidLen;
+    uint8_t atqa[2];
+    uint8_t sak;
+    uint8_t version[8];         /* GET_VERSION response, empty for tags without one */
+    uint8_t hasVersion;
+    uint8_t signature[32];      /* READ_SIG response */
+
+    uint8_t state;              /* ISO14443-3A state machine */
+    uint8_t fromHalt;           /* return to HALT instead of IDLE on errors */
+    uint8_t cascadeLevel;       /* 0..2 during anticollision */
+    int16_t pendingWrite;       /* page/block awaiting the second COMPATIBILITY_WRITE frame */
+    int16_t authSector;         /* MIFARE Classic sector currently authenticated */
+
+    uint16_t pageSize;          /* 4 for Type 2 tags, 16 for MIFARE Classic */
+    uint16_t memLen;
+    uint8_t mem[SIM_MAX_TAG_MEMORY];
+
+    /* ISO14443-4 */
+    uint16_t fsd;               /* reader frame size, from RATS */
+    uint8_t command[SIM_MAX_APDU];
+    uint16_t commandLen;        /* received so far, chained blocks included */
+    uint8_t answer[SIM_MAX_APDU];
+    uint16_t answerLen;
+    uint16_t answerPos;         /* next chained block starts here */
+    uint16_t lastPos;           /* block sent last, for retransmission */
+    uint8_t ppsAllowed;         /* only the first block after the ATS may be a PPS */
+    uint8_t rateToTag;          /* bit rates the tag is at, 0 = 106 kbit/s .. 3 = 848 kbit/s */
+    uint8_t rateFromTag;
+} SimTag_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+
+    uint8_t regs[64];
+    uint8_t fifo[SIM_FIFO_SIZE];
+    uint8_t fifoLevel;
+    uint8_t irqLine;            /* current level of the (active high) IRQ output */
+
+    SimTag_t tags[SIM_MAX_TAGS];
+    uint8_t fieldOn;
+
+    uint32_t latencyUs;         /* added to every RF transaction */
+    uint8_t faultKind;
+    uint32_t faultSkip;         /* transactions to let through before faulting */
+    uint32_t faultCount;        /* transactions to fault */
+    uint32_t uidCounter;
+
+    /* Counters */
+    uint32_t spiTransfers;
+    uint32_t spiMessages;       /* SimPn512_SpiMessage calls, spidev ioctls on hardware */
+    uint32_t rfTransactions;
+
+    /* Called (without the lock held) on every rising edge of the IRQ line */
+    void (*irqHandler)(void *ctx);
+    void *irqContext;
+} SimPn512_t;
+
+void SimPn512_Init(SimPn512_t *chip);
+void SimPn512_Reset(SimPn512_t *chip);
+
+/* Full duplex SPI transfer of len bytes */
+void SimPn512_Spi(SimPn512_t *chip, const uint8_t *tx, uint8_t *rx, uint16_t len);
+/* count transfers of lens[i] bytes back to back in tx, like one SPI_IOC_MESSAGE */
+void SimPn512_SpiMessage(SimPn512_t *chip, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count);
+
+void SimPn512_SetIrqHandler(SimPn512_t *chip, void (*handler)(void *ctx), void *ctx);
+void SimPn512_SetLatency(SimPn512_t *chip, uint32_t latencyUs);
+void SimPn512_InjectFault(SimPn512_t *chip, uint8_t kind, uint32_t count, uint32_t skip);
+
+/* Returns the slot of the new tag or -1. uid may be NULL to generate one. */
+int SimPn512_AddTag(SimPn512_t *chip, uint8_t type, const uint8_t *uid, uint8_t uidLen);
+int SimPn512_RemoveTag(SimPn512_t *chip, int slot);
+void SimPn512_RemoveAllTags(SimPn512_t *chip);
+
+/* Copy tag memory out of / into a slot. Return the number of bytes copied or -1. */
+int SimPn512_ReadMemory(SimPn512_t *chip, int slot, uint8_t *buffer, uint16_t bufferLen);
+int SimPn512_WriteMemory(SimPn512_t *chip, int slot, uint16_t offset, const uint8_t *data, uint16_t dataLen);
+
+#endif // SIM_PN512_H
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "Mifare.h"
+
+/*
+ * BAL of the hardware build. Takes the place of the Reader Library's spidev
+ * BAL so every register and FIFO access of a reader goes through its
+ * SpiBus_t, see spi_bus.h.
+ */
+
+phStatus_t phbalReg_Stub_Init(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wSizeOfDataParams)
+{
+    if (sizeof(phbalReg_Stub_DataParams_t) != wSizeOfDataParams) {
+        return PH_ADD_COMPCODE(PH_ERR_INVALID_DATA_PARAMS, PH_COMP_BAL);
+    }
+    pDataParams->wId = PH_COMP_BAL | PHBAL_REG_STUB_ID;
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_GetPortList(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wPortBufSize,
+                                     uint8_t * pPortNames, uint16_t * pNumOfPorts)
+{
+    const char *port = PLATFORM_DEFAULT_SPI;
+
+    if (wPortBufSize < strlen(port) + 1) {
+        return PH_ADD_COMPCODE(PH_ERR_BUFFER_OVERFLOW, PH_COMP_BAL);
+    }
+    strcpy((char *) pPortNames, port);
+    *pNumOfPorts = 1;
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_SetPort(phbalReg_Stub_DataParams_t * pDataParams, uint8_t * pPortName)
+{
+    nfc_data *nfc = NFC_DATA_OF_BAL(pDataParams);
+
+    // OpenPort takes the name from the platform, it is the same string
+    if (strcmp((const char *) pPortName, nfc->platform.spiDevice) != 0) {
+        return PH_ADD_COMPCODE(PH_ERR_INVALID_PARAMETER, PH_COMP_BAL);
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_OpenPort(phbalReg_Stub_DataParams_t * pDataParams)
+{
+    nfc_data *nfc = NFC_DATA_OF_BAL(pDataParams);
+
+    if (SpiBus_Open(&nfc->spi, nfc->platform.spiDevice) != 0) {
+        return PH_ADD_COMPCODE(PH_ERR_INTERFACE_ERROR, PH_COMP_BAL);
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_ClosePort(phbalReg_Stub_DataParams_t * pDataParams)
+{
+    SpiBus_Close(&NFC_DATA_OF_BAL(pDataParams)->spi);
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_Exchange(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wOption,
+                                  uint8_t * pTxBuffer, uint16_t wTxLength, uint16_t wRxBufSize,
+                                  uint8_t * pRxBuffer, uint16_t * pRxLength)
+{
+    if (wRxBufSize < wTxLength) {
+        return PH_ADD_COMPCODE(PH_ERR_BUFFER_OVERFLOW, PH_COMP_BAL);
+    }
+    if (SpiBus_Exchange(&NFC_DATA_OF_BAL(pDataParams)->spi, pTxBuffer, pRxBuffer, wTxLength) != 0) {
+        return PH_ADD_COMPCODE(PH_ERR_INTERFACE_ERROR, PH_COMP_BAL);
+    }
+
+    if (pRxLength != NULL) {
+        *pRxLength = wTxLength;
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_SetConfig(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wConfig, uint16_t wValue)
+{
+    if (wConfig == PHBAL_REG_CONFIG_HAL_HW_TYPE) {
+        pDataParams->bHalType = (uint8_t) wValue;
+    }
+    return PH_ERR_SUCCESS;
+}
+
+phStatus_t phbalReg_Stub_GetConfig(phbalReg_Stub_DataParams_t * pDataParams, uint16_t wConfig, uint16_t * pValue)
+{
+    if (wConfig != PHBAL_REG_CONFIG_HAL_HW_TYPE) {
+        return PH_ADD_COMPCODE(PH_ERR_UNSUPPORTED_PARAMETER, PH_COMP_BAL);
+    }
+    *pValue = pDataParams->bHalType;
+    return PH_ERR_SUCCESS;
+}
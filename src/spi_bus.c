@@ -0,0 +1,302 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "spi_bus.h"
+
+/*
+ * PN512 registers whose writes start something, or let an interrupt through
+ * that the HAL is about to wait for. Writing them flushes the queue.
+ */
+#define PN512_REG_COMMAND           0x01
+#define PN512_REG_COMIEN            0x02
+#define PN512_REG_DIVIEN            0x03
+#define PN512_REG_CONTROL           0x0C
+#define PN512_REG_BITFRAMING        0x0D
+#define PN512_REG_TXCONTROL         0x14
+
+#define PN512_CMD_TRANSMIT          0x04
+#define PN512_CMD_TRANSCEIVE        0x0C
+#define PN512_CMD_MFAUTHENT         0x0E
+#define PN512_CMD_SOFTRESET         0x0F
+#define PN512_CMD_MASK              0x0F
+#define PN512_BIT_STARTSEND         0x80
+
+#define SPI_BUS_READ                0x80        /* MSB of the address byte */
+
+/*******************************************************************************
+** spidev backend
+*******************************************************************************/
+
+static int spidev_backend(void *ctx, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count)
+{
+    SpiBus_t *bus = ctx;
+    struct spi_ioc_transfer transfers[SPI_BUS_MAX_FRAMES];
+    unsigned int offset = 0;
+    unsigned int i;
+
+    memset(transfers, 0, count * sizeof(transfers[0]));
+    for (i = 0; i < count; i++) {
+        transfers[i].tx_buf = (uintptr_t) &tx[offset];
+        transfers[i].rx_buf = (uintptr_t) &rx[offset];
+        transfers[i].len = lens[i];
+        transfers[i].speed_hz = bus->speedHz;
+        transfers[i].bits_per_word = 8;
+        // chip select goes up between frames, but not after the last
+        transfers[i].cs_change = i + 1 < count;
+        offset += lens[i];
+    }
+
+    return ioctl(bus->fd, SPI_IOC_MESSAGE(count), transfers) < 0 ? -1 : 0;
+}
+
+/*******************************************************************************
+** Queue
+*******************************************************************************/
+
+/*
+ * Follow what the frame tells the chip. Returns 1 if it has to reach the chip
+ * now: reads, and writes that start a command, the field, a timer or let an
+ * interrupt through.
+ */
+static int spi_bus_track(SpiBus_t *bus, const uint8_t *tx, uint16_t len)
+{
+    uint8_t reg = (tx[0] >> 1) & 0x3F;
+    int urgent = 0;
+    uint16_t i;
+
+    if (tx[0] & SPI_BUS_READ) {
+        return 1;
+    }
+
+    for (i = 1; i < len; i++) {
+        uint8_t value = tx[i];
+
+        if (reg == PN512_REG_COMMAND) {
+            uint8_t cmd = value & PN512_CMD_MASK;
+
+            if (cmd == PN512_CMD_TRANSMIT || cmd == PN512_CMD_MFAUTHENT ||
+                (cmd == PN512_CMD_TRANSCEIVE && (bus->bitFraming & PN512_BIT_STARTSEND))) {
+                bus->counters.rfCommands++;
+            }
+            if (cmd == PN512_CMD_SOFTRESET) {
+                bus->bitFraming = 0;
+            }
+            bus->command = cmd;
+            urgent = 1;
+        } else if (reg == PN512_REG_BITFRAMING) {
+            if (value & PN512_BIT_STARTSEND) {
+                if (bus->command == PN512_CMD_TRANSCEIVE) {
+                    bus->counters.rfCommands++;
+                }
+                urgent = 1;
+            }
+            bus->bitFraming = value;
+        } else if (reg == PN512_REG_COMIEN || reg == PN512_REG_DIVIEN || reg == PN512_REG_CONTROL ||
+                   reg == PN512_REG_TXCONTROL) {
+            urgent = 1;
+        }
+    }
+
+    return urgent;
+}
+
+/* Called with the lock held */
+static int spi_bus_send(SpiBus_t *bus, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count)
+{
+    int ret;
+
+    if (bus->backend == NULL) {
+        errno = ENODEV;
+        return -1;
+    }
+
+    bus->flushing = 1;
+    ret = bus->backend(bus->backendContext, tx, rx, lens, count);
+    bus->flushing = 0;
+
+    if (ret == 0) {
+        bus->counters.messages++;
+        bus->counters.transfers += count;
+    }
+    return ret;
+}
+
+/* Called with the lock held */
+static int spi_bus_flush(SpiBus_t *bus)
+{
+    int ret = 0;
+
+    if (bus->frameCount) {
+        ret = spi_bus_send(bus, bus->tx, bus->rx, bus->lens, bus->frameCount);
+        bus->frameCount = 0;
+        bus->used = 0;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+** Public interface
+*******************************************************************************/
+
+void SpiBus_Init(SpiBus_t *bus)
+{
+    pthread_mutexattr_t attr;
+
+    memset(bus, 0, sizeof(*bus));
+    bus->speedHz = SPI_BUS_DEFAULT_SPEED_HZ;
+    bus->queueSize = SPI_BUS_DEFAULT_QUEUE;
+    bus->fd = -1;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&bus->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void SpiBus_Destroy(SpiBus_t *bus)
+{
+    SpiBus_Close(bus);
+    pthread_mutex_destroy(&bus->lock);
+}
+
+void SpiBus_Configure(SpiBus_t *bus, uint32_t speedHz, uint16_t queueSize)
+{
+    pthread_mutex_lock(&bus->lock);
+    bus->speedHz = speedHz;
+    bus->queueSize = queueSize < SPI_BUS_MAX_QUEUE ? queueSize : SPI_BUS_MAX_QUEUE;
+    pthread_mutex_unlock(&bus->lock);
+}
+
+int SpiBus_Open(SpiBus_t *bus, const char *device)
+{
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    int fd;
+
+    fd = open(device, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &bus->speedHz) < 0) {
+        int error = errno;
+
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    SpiBus_Close(bus);
+    pthread_mutex_lock(&bus->lock);
+    bus->fd = fd;
+    bus->backend = spidev_backend;
+    bus->backendContext = bus;
+    pthread_mutex_unlock(&bus->lock);
+
+    return 0;
+}
+
+void SpiBus_Attach(SpiBus_t *bus, SpiBusBackend_t backend, void *ctx)
+{
+    SpiBus_Close(bus);
+    pthread_mutex_lock(&bus->lock);
+    bus->backend = backend;
+    bus->backendContext = ctx;
+    pthread_mutex_unlock(&bus->lock);
+}
+
+void SpiBus_Close(SpiBus_t *bus)
+{
+    pthread_mutex_lock(&bus->lock);
+    spi_bus_flush(bus);
+    if (bus->fd >= 0) {
+        close(bus->fd);
+        bus->fd = -1;
+    }
+    bus->backend = NULL;
+    bus->backendContext = NULL;
+    bus->command = 0;
+    bus->bitFraming = 0;
+    pthread_mutex_unlock(&bus->lock);
+}
+
+int SpiBus_Exchange(SpiBus_t *bus, const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+    uint16_t offset;
+    int urgent;
+    int ret = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (len > SPI_BUS_MAX_QUEUE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&bus->lock);
+    urgent = spi_bus_track(bus, tx, len);
+
+    if (bus->flushing) {
+        // an IRQ handler run by the backend, the queue is on its way out already
+        ret = spi_bus_send(bus, tx, rx, &len, 1);
+        pthread_mutex_unlock(&bus->lock);
+        return ret;
+    }
+
+    if (bus->used + len > (bus->queueSize > len ? bus->queueSize : len) || bus->frameCount == SPI_BUS_MAX_FRAMES) {
+        ret = spi_bus_flush(bus);
+    }
+
+    offset = bus->used;
+    memcpy(&bus->tx[offset], tx, len);
+    bus->lens[bus->frameCount++] = len;
+    bus->used += len;
+
+    if (urgent || !bus->queueSize) {
+        if (ret == 0) {
+            ret = spi_bus_flush(bus);
+        } else {
+            bus->frameCount = 0;
+            bus->used = 0;
+        }
+        if (ret == 0) {
+            memcpy(rx, &bus->rx[offset], len);
+        }
+    } else {
+        // a register write clocks out nothing of interest
+        memset(rx, 0, len);
+    }
+    pthread_mutex_unlock(&bus->lock);
+
+    return ret;
+}
+
+int SpiBus_Flush(SpiBus_t *bus)
+{
+    int ret;
+
+    pthread_mutex_lock(&bus->lock);
+    ret = spi_bus_flush(bus);
+    pthread_mutex_unlock(&bus->lock);
+
+    return ret;
+}
+
+void SpiBus_GetCounters(SpiBus_t *bus, SpiBusCounters_t *counters)
+{
+    pthread_mutex_lock(&bus->lock);
+    *counters = bus->counters;
+    pthread_mutex_unlock(&bus->lock);
+}
+
+void SpiBus_ResetCounters(SpiBus_t *bus)
+{
+    pthread_mutex_lock(&bus->lock);
+    memset(&bus->counters, 0, sizeof(bus->counters));
+    pthread_mutex_unlock(&bus->lock);
+}
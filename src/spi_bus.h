@@ -0,0 +1,92 @@
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+/*
+ * SPI transport of one PN512, underneath the Reader Library BAL.
+ *
+ * The HAL does every register and FIFO access as an SPI transfer of its own.
+ * Writes that have no effect until a command starts or something is read
+ * back are queued here instead, and go out together with the next access
+ * that needs the chip up to date: one SPI_IOC_MESSAGE, chip select released
+ * between the frames since the PN512 takes the first byte of each as an
+ * address. With a queue of 0 bytes every access goes out on its own, which
+ * is what the Reader Library's spidev BAL does.
+ *
+ * The frames go out through a backend: spidev on hardware, the PN512 model
+ * in the simulator build.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SPI_BUS_DEFAULT_SPEED_HZ    5000000     /* the PN512 takes up to 10 MHz */
+#define SPI_BUS_MAX_SPEED_HZ        10000000
+#define SPI_BUS_DEFAULT_QUEUE       256
+#define SPI_BUS_MAX_QUEUE           4096        /* spidev's default bufsiz, per message */
+#define SPI_BUS_MAX_FRAMES          64
+
+/*
+ * Clock out count frames of lens[i] bytes, stored back to back in tx, into
+ * rx. Returns 0, or -1 with errno set.
+ */
+typedef int (*SpiBusBackend_t)(void *ctx, const uint8_t *tx, uint8_t *rx, const uint16_t *lens, unsigned int count);
+
+typedef struct {
+    uint64_t transfers;         /* frames clocked out, one per HAL register or FIFO access */
+    uint64_t messages;          /* backend calls, SPI_IOC_MESSAGE ioctls on hardware */
+    uint64_t rfCommands;        /* Transceive, Transmit and MFAuthent started */
+} SpiBusCounters_t;
+
+typedef struct {
+    /* Settings, kept across Close and Open */
+    uint32_t speedHz;
+    uint16_t queueSize;         /* bytes of writes held back, 0 for none */
+
+    SpiBusBackend_t backend;    /* NULL while closed */
+    void *backendContext;
+    int fd;                     /* spidev, -1 with other backends */
+
+    /*
+     * Recursive, so an IRQ handler the backend runs on the same thread (the
+     * simulator does) can still get through; it bypasses the queue then.
+     */
+    pthread_mutex_t lock;
+    uint8_t flushing;
+
+    uint8_t tx[SPI_BUS_MAX_QUEUE];
+    uint8_t rx[SPI_BUS_MAX_QUEUE];
+    uint16_t lens[SPI_BUS_MAX_FRAMES];
+    unsigned int frameCount;
+    uint16_t used;
+
+    /* What the chip was last told, to see when an RF command starts */
+    uint8_t command;
+    uint8_t bitFraming;
+
+    SpiBusCounters_t counters;
+} SpiBus_t;
+
+void SpiBus_Init(SpiBus_t *bus);
+void SpiBus_Destroy(SpiBus_t *bus);
+
+/* The speed is set on the device at Open, and asked for with every message */
+void SpiBus_Configure(SpiBus_t *bus, uint32_t speedHz, uint16_t queueSize);
+
+/* Open a spidev device. Returns 0, or -1 with errno set. */
+int SpiBus_Open(SpiBus_t *bus, const char *device);
+/* Use another backend, the simulated chip for one */
+void SpiBus_Attach(SpiBus_t *bus, SpiBusBackend_t backend, void *ctx);
+/* Flush whatever is queued and let go of the backend */
+void SpiBus_Close(SpiBus_t *bus);
+
+/*
+ * One HAL access of len bytes, rx gets what the chip clocked out. Writes
+ * that may wait are queued and read back as zeros. Returns 0, or -1 with
+ * errno set.
+ */
+int SpiBus_Exchange(SpiBus_t *bus, const uint8_t *tx, uint8_t *rx, uint16_t len);
+int SpiBus_Flush(SpiBus_t *bus);
+
+void SpiBus_GetCounters(SpiBus_t *bus, SpiBusCounters_t *counters);
+void SpiBus_ResetCounters(SpiBus_t *bus);
+
+#endif // SPI_BUS_H
@@ -0,0 +1,110 @@
+#ifndef TAG_IMAGE_H
+#define TAG_IMAGE_H
+/*
+ * Binary tag image, as produced by Mifare.dump_into and consumed by
+ * Mifare.restore_from and nxppy/_image.py.
+ *
+ * A fixed 32 byte header followed by the raw pages, so images of the same tag
+ * type all have the same size and can be concatenated into one file and
+ * memory-mapped for bulk comparison. Multi-byte fields are little endian.
+ *
+ *   offset  size  field
+ *        0     4  magic "NXPI"
+ *        4     1  format version (1)
+ *        5     1  UID length
+ *        6    10  UID, zero padded
+ *       16     8  GET_VERSION response, zero if flags & 0x01 is clear
+ *       24     2  ATQA
+ *       26     1  SAK
+ *       27     1  flags
+ *       28     2  page size in bytes
+ *       30     2  page count
+ *       32     *  page data
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define TAG_IMAGE_MAGIC             "NXPI"
+#define TAG_IMAGE_FORMAT            1
+#define TAG_IMAGE_HEADER_SIZE       32
+#define TAG_IMAGE_MAX_UID           10
+#define TAG_IMAGE_FLAG_VERSION      0x01
+
+#define TAG_IMAGE_OFS_FORMAT        4
+#define TAG_IMAGE_OFS_UID_LEN       5
+#define TAG_IMAGE_OFS_UID           6
+#define TAG_IMAGE_OFS_VERSION       16
+#define TAG_IMAGE_OFS_ATQA          24
+#define TAG_IMAGE_OFS_SAK           26
+#define TAG_IMAGE_OFS_FLAGS         27
+#define TAG_IMAGE_OFS_PAGE_SIZE     28
+#define TAG_IMAGE_OFS_PAGE_COUNT    30
+
+static inline uint16_t tag_image_get_u16(const uint8_t *image, int offset)
+{
+    return (uint16_t) (image[offset] | (image[offset + 1] << 8));
+}
+
+static inline void tag_image_put_u16(uint8_t *image, int offset, uint16_t value)
+{
+    image[offset] = value & 0xFF;
+    image[offset + 1] = value >> 8;
+}
+
+static inline void tag_image_write_header(uint8_t *image, const uint8_t *uid, uint8_t uidLen,
+                                          const uint8_t *version, const uint8_t *atqa, uint8_t sak,
+                                          uint16_t pageSize, uint16_t pageCount)
+{
+    memset(image, 0, TAG_IMAGE_HEADER_SIZE);
+    memcpy(image, TAG_IMAGE_MAGIC, 4);
+    image[TAG_IMAGE_OFS_FORMAT] = TAG_IMAGE_FORMAT;
+    image[TAG_IMAGE_OFS_UID_LEN] = uidLen;
+    memcpy(&image[TAG_IMAGE_OFS_UID], uid, uidLen);
+    if (version != NULL) {
+        memcpy(&image[TAG_IMAGE_OFS_VERSION], version, 8);
+        image[TAG_IMAGE_OFS_FLAGS] |= TAG_IMAGE_FLAG_VERSION;
+    }
+    image[TAG_IMAGE_OFS_ATQA] = atqa[0];
+    image[TAG_IMAGE_OFS_ATQA + 1] = atqa[1];
+    image[TAG_IMAGE_OFS_SAK] = sak;
+    tag_image_put_u16(image, TAG_IMAGE_OFS_PAGE_SIZE, pageSize);
+    tag_image_put_u16(image, TAG_IMAGE_OFS_PAGE_COUNT, pageCount);
+}
+
+/* Returns 0 if image holds a complete image of a supported format */
+static inline int tag_image_check(const uint8_t *image, size_t len)
+{
+    if (len < TAG_IMAGE_HEADER_SIZE || memcmp(image, TAG_IMAGE_MAGIC, 4) != 0 ||
+        image[TAG_IMAGE_OFS_FORMAT] != TAG_IMAGE_FORMAT || image[TAG_IMAGE_OFS_UID_LEN] > TAG_IMAGE_MAX_UID) {
+        return -1;
+    }
+    if (len < TAG_IMAGE_HEADER_SIZE + (size_t) tag_image_get_u16(image, TAG_IMAGE_OFS_PAGE_SIZE) *
+        tag_image_get_u16(image, TAG_IMAGE_OFS_PAGE_COUNT)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Total number of pages of an NTAG21x / Ultralight EV1 from its GET_VERSION answer, 0 if unknown */
+static inline uint16_t tag_image_pages_from_version(const uint8_t *version)
+{
+    if (version[1] != 0x04 || (version[2] != 0x03 && version[2] != 0x04)) {
+        return 0;
+    }
+    switch (version[6]) {
+    case 0x0B:
+        return 20;              /* NTAG210, MF0UL11 */
+    case 0x0E:
+        return 41;              /* NTAG212, MF0UL21 */
+    case 0x0F:
+        return 45;              /* NTAG213 */
+    case 0x11:
+        return 135;             /* NTAG215 */
+    case 0x13:
+        return 231;             /* NTAG216 */
+    }
+    return 0;
+}
+
+#endif // TAG_IMAGE_H
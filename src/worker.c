@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "worker.h"
+
+#define QUEUE_MASK                  (WORKER_QUEUE_SIZE - 1)
+
+static void *worker_thread(void *arg)
+{
+    Worker_t *worker = arg;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&worker->lock);
+    while (worker->running) {
+        WorkerJob_t *job;
+
+        if (worker->next == worker->head) {
+            pthread_cond_wait(&worker->wake, &worker->lock);
+            continue;
+        }
+
+        // nobody else touches a submitted job until next moves past it
+        job = &worker->jobs[worker->next & QUEUE_MASK];
+        pthread_mutex_unlock(&worker->lock);
+        worker->run(worker->runContext, job);
+        pthread_mutex_lock(&worker->lock);
+
+        worker->next++;
+        if (write(worker->eventFd, &one, sizeof(one)) < 0) {
+            /* only fails if the counter would overflow, the fd is readable anyway */
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+int Worker_Init(Worker_t *worker)
+{
+    memset(worker, 0, sizeof(*worker));
+
+    worker->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->eventFd < 0) {
+        return -1;
+    }
+
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+    worker->nextId = 1;
+
+    return 0;
+}
+
+void Worker_Destroy(Worker_t *worker)
+{
+    Worker_Stop(worker);
+
+    pthread_cond_destroy(&worker->wake);
+    pthread_mutex_destroy(&worker->lock);
+    close(worker->eventFd);
+    worker->eventFd = -1;
+}
+
+int Worker_Start(Worker_t *worker, WorkerRun_t run, void *ctx)
+{
+    int ret;
+
+    if (worker->started) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    worker->run = run;
+    worker->runContext = ctx;
+    worker->running = 1;
+
+    ret = pthread_create(&worker->thread, NULL, worker_thread, worker);
+    if (ret != 0) {
+        worker->running = 0;
+        errno = ret;
+        return -1;
+    }
+
+    worker->started = 1;
+    return 0;
+}
+
+void Worker_Stop(Worker_t *worker)
+{
+    if (!worker->started) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    worker->running = 0;
+    pthread_cond_broadcast(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_join(worker->thread, NULL);
+    worker->started = 0;
+}
+
+WorkerJob_t *Worker_Reserve(Worker_t *worker)
+{
+    WorkerJob_t *job = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->head - worker->tail < WORKER_QUEUE_SIZE) {
+        job = &worker->jobs[worker->head & QUEUE_MASK];
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    if (job != NULL) {
+        // everything but the data buffer, which the caller fills as far as it needs
+        memset(job, 0, offsetof(WorkerJob_t, data));
+        job->status = 0;
+        job->progress = 0;
+    }
+    return job;
+}
+
+uint32_t Worker_Submit(Worker_t *worker)
+{
+    WorkerJob_t *job;
+    uint32_t id;
+
+    pthread_mutex_lock(&worker->lock);
+    job = &worker->jobs[worker->head & QUEUE_MASK];
+    id = worker->nextId++;
+    if (worker->nextId == 0) {
+        worker->nextId = 1;
+    }
+    job->id = id;
+    worker->head++;
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+
+    return id;
+}
+
+int Worker_Collect(Worker_t *worker, WorkerJob_t *job)
+{
+    uint64_t count;
+    int found = 0;
+
+    // drain first: a job finishing after this gets its own wakeup
+    if (read(worker->eventFd, &count, sizeof(count)) < 0) {
+        count = 0;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->tail != worker->next) {
+        *job = worker->jobs[worker->tail & QUEUE_MASK];
+        worker->tail++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return found;
+}
+
+int Worker_Fd(const Worker_t *worker)
+{
+    return worker->eventFd;
+}
@@ -0,0 +1,81 @@
+#ifndef WORKER_H
+#define WORKER_H
+/*
+ * Runs reader operations on a thread of their own, for callers that must not
+ * block, such as an asyncio event loop.
+ *
+ * Jobs live in one ring: submitted ones between next and head, finished ones
+ * between tail and next. Submitting and collecting must be serialised by the
+ * caller (nxppy does both with the GIL held). The worker thread runs jobs in
+ * order and signals an eventfd after each one, so an event loop can watch it.
+ * While there is nothing to do the thread sleeps on a condition variable and
+ * any number of waiting callers cost nothing.
+ *
+ * Nothing in here knows about Python or the Reader Library.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define WORKER_QUEUE_SIZE           16      /* must be a power of two */
+#define WORKER_DATA_SIZE            1024    /* a whole Type 2 tag */
+
+typedef struct {
+    uint32_t id;
+    uint8_t op;                 /* up to the run function */
+    uint8_t flags;
+    uint16_t start;
+    uint16_t end;
+    uint16_t len;               /* bytes in data, going in and coming out */
+    uint8_t data[WORKER_DATA_SIZE];
+
+    /* Filled in by the run function */
+    uint16_t status;
+    uint16_t progress;
+} WorkerJob_t;
+
+/* Runs one job on the worker thread */
+typedef void (*WorkerRun_t)(void *ctx, WorkerJob_t *job);
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;       /* protects the indexes and running */
+    pthread_cond_t wake;
+    int running;
+    int started;
+
+    WorkerRun_t run;
+    void *runContext;
+
+    WorkerJob_t jobs[WORKER_QUEUE_SIZE];
+    uint32_t head;              /* next slot to submit to */
+    uint32_t next;              /* next job to run */
+    uint32_t tail;              /* next finished job to collect */
+    uint32_t nextId;
+    int eventFd;
+} Worker_t;
+
+/* Returns 0 on success, -1 with errno set */
+int Worker_Init(Worker_t *worker);
+void Worker_Destroy(Worker_t *worker);
+
+/* Returns 0 on success, -1 with errno set */
+int Worker_Start(Worker_t *worker, WorkerRun_t run, void *ctx);
+
+/* Waits for the job being run, if any. Jobs still queued stay queued. */
+void Worker_Stop(Worker_t *worker);
+
+/*
+ * Slot for the next job, NULL if the ring is full. Fill it in and hand it
+ * over with Worker_Submit, which returns the job id.
+ */
+WorkerJob_t *Worker_Reserve(Worker_t *worker);
+uint32_t Worker_Submit(Worker_t *worker);
+
+/* Returns 1 and copies out a finished job, 0 if none are waiting */
+int Worker_Collect(Worker_t *worker, WorkerJob_t *job);
+
+/* Readable while finished jobs are waiting to be collected */
+int Worker_Fd(const Worker_t *worker);
+
+#endif // WORKER_H
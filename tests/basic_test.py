@@ -28,4 +28,4 @@ class nxppyTests(unittest.TestCase):
         import nxppy
         reader = nxppy.Mifare()
         self.assertIsInstance(reader, nxppy.Mifare)
-        self.assertIsNone(reader.select(), "Card UID is not None")
+        self.assertIsNone(reader.select(raise_on_absent=False), "Card UID is not None")
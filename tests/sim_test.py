@@ -0,0 +1,687 @@
+import binascii
+import struct
+import sys
+import unittest
+
+try:
+    from nxppy import _mifare
+    SIMULATOR = _mifare.SIMULATOR
+except ImportError:
+    SIMULATOR = False
+
+NTAG_UID = b'\x04\x11\x22\x33\x44\x55\x66'
+CLASSIC_UID = b'\x12\x34\x56\x78'
+
+
+@unittest.skipUnless(SIMULATOR, "nxppy was not built with NXPPY_SIMULATOR=1")
+class simulatorTests(unittest.TestCase):
+    """Exercise the full Reader Library stack against the simulated PN512."""
+
+    def setUp(self):
+        import nxppy
+        _mifare.sim_remove_tag()
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_NONE)
+        _mifare.sim_set_latency(0)
+        self.reader = nxppy.Mifare()
+
+    def test_empty_field(self):
+        """Test that select fails when no tag is present"""
+        import nxppy
+        self.assertRaises(nxppy.SelectError, self.reader.select)
+        self.assertRaises(nxppy.ReadError, self.reader.get_ident)
+
+    def test_select_ntag(self):
+        """Test that the UID of a 7 byte tag is resolved through both cascade levels"""
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        self.assertEqual(self.reader.select(), '04112233445566')
+        self.assertEqual(self.reader.get_ident()['sak'], 0x00)
+
+    def test_select_classic(self):
+        """Test that a 4 byte MIFARE Classic UID and SAK are reported"""
+        _mifare.sim_add_tag(_mifare.SIM_CLASSIC_1K, CLASSIC_UID)
+        self.assertEqual(self.reader.select(), '12345678')
+        self.assertEqual(self.reader.get_ident()['sak'], 0x08)
+
+    def test_get_version(self):
+        """Test that GET_VERSION reports the emulated NTAG size"""
+        _mifare.sim_add_tag(_mifare.SIM_NTAG216)
+        self.reader.select()
+        self.assertEqual(self.reader.get_version()['tag_size'], 0x13)
+
+    def test_read_write_block(self):
+        """Test a page write followed by a read back, and that it lands in tag memory"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        self.reader.write_block(10, b'abcd')
+        self.assertEqual(self.reader.read_block(10), b'abcd')
+        self.assertEqual(_mifare.sim_read_memory(slot)[40:44], b'abcd')
+
+    def test_ntag_roundtrip(self):
+        """Test the pure Python Ntag abstraction on top of the simulator"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG215)
+        ntag = nxppy.Ntag()
+        ntag.select()
+        ntag.write(4, "hello simulator")
+        self.assertEqual(ntag.read(4), "hello simulator")
+
+    def test_fault_injection(self):
+        """Test that an injected timeout surfaces as a ReadError"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_TIMEOUT)
+        self.assertRaises(nxppy.ReadError, self.reader.read_block, 4)
+
+    def test_select_absent(self):
+        """Test that raise_on_absent=False turns an empty field into None"""
+        self.assertIsNone(self.reader.select(raise_on_absent=False))
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        self.assertEqual(self.reader.select(raise_on_absent=False), '04112233445566')
+
+    def test_error_attributes(self):
+        """Test that Reader Library errors carry the numeric status"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_TIMEOUT)
+        with self.assertRaises(nxppy.ReadError) as cm:
+            self.reader.read_block(4)
+        self.assertEqual(cm.exception.code, nxppy.ERR_IO_TIMEOUT)
+        self.assertEqual(cm.exception.status, cm.exception.component | cm.exception.code)
+        self.assertIsNone(nxppy.ReadError("plain").status)
+
+    def test_tag_removed(self):
+        """Test that reads fail once the tag leaves the field"""
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        _mifare.sim_remove_tag(slot)
+        self.assertRaises(nxppy.ReadError, self.reader.read_block, 4)
+        self.assertRaises(nxppy.SelectError, self.reader.select)
+
+    def test_gil_released(self):
+        """Test that other Python threads run while the reader waits on RF"""
+        import threading
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        _mifare.sim_set_latency(20000)
+
+        done = threading.Event()
+        ticks = []
+
+        def scan():
+            self.reader.select()
+            done.set()
+
+        t = threading.Thread(target=scan)
+        t.start()
+        while not done.is_set():
+            ticks.append(1)
+        t.join()
+        self.assertGreater(len(ticks), 1000)
+
+    def test_read_range(self):
+        """Test that read_range returns the same bytes as the tag memory"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG216)
+        payload = bytes(bytearray(range(256))) * 3
+        _mifare.sim_write_memory(slot, 16, payload)
+        self.reader.select()
+        memory = _mifare.sim_read_memory(slot)
+
+        # 16 byte READ commands
+        self.assertEqual(self.reader.read_range(4, 200), memory[16:800])
+        self.assertEqual(self.reader.read_range(5, 6), memory[20:24])
+
+        # FAST_READ once the tag is known to be an NTAG
+        self.reader.get_version()
+        before = _mifare.sim_stats()['rf_transactions']
+        self.assertEqual(self.reader.read_range(4, 226), memory[16:904])
+        self.assertEqual(_mifare.sim_stats()['rf_transactions'] - before, 15)
+
+    def test_write_range(self):
+        """Test a multi-page write from a bytearray, padded to whole pages"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        self.assertEqual(self.reader.write_range(4, bytearray(b'0123456789')), 3)
+        self.assertEqual(_mifare.sim_read_memory(slot)[16:28], b'0123456789\0\0')
+
+    def test_write_range_progress(self):
+        """Test that a failed write_range reports how many pages made it"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_TIMEOUT, skip=5)
+        try:
+            self.reader.write_range(4, b'x' * 40)
+            self.fail("write_range did not fail")
+        except nxppy.WriteError as e:
+            self.assertEqual(e.pages_written, 5)
+
+    def test_dump_restore(self):
+        """Test that a dumped image restores onto a blank tag and walks with iter_images"""
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        _mifare.sim_write_memory(slot, 12, b'\xe1\x10\x12\x00' + b'hello tag image')
+        self.reader.select()
+
+        images = bytearray(2 * nxppy.image_size(45))
+        self.assertEqual(self.reader.dump_into(images), nxppy.image_size(45))
+        image = nxppy.TagImage(images)
+        self.assertEqual(image.uid, NTAG_UID)
+        self.assertEqual(image.page_count, 45)
+        self.assertEqual(bytes(image.pages), _mifare.sim_read_memory(slot)[:180])
+
+        # restore onto another tag, only the user memory announced by the CC
+        _mifare.sim_remove_tag()
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        self.assertRaises(nxppy.WriteError, self.reader.restore_from, images)
+        self.assertEqual(self.reader.restore_from(images, force=True), 0x12 * 2)
+        self.assertEqual(_mifare.sim_read_memory(slot)[16:31], b'hello tag image')
+
+        # a forged page count must not wrap page addresses back onto the UID
+        forged = bytearray(images[:32]) + bytearray(300 * 4)
+        forged[30:32] = struct.pack('<H', 300)
+        self.assertRaises(nxppy.WriteError, self.reader.restore_from, forged, force=True)
+        self.assertRaises(nxppy.WriteError, self.reader.restore_from, images, end=300, force=True)
+
+        self.reader.dump_into(memoryview(images)[image.size:])
+        second = list(nxppy.iter_images(images))[1]
+        self.assertEqual(second.uid, _mifare.sim_read_memory(slot)[:3] + _mifare.sim_read_memory(slot)[4:8])
+        self.assertTrue(all(page < 3 for page in second.diff(image)))  # only the UID pages
+
+    def test_polling_events(self):
+        """Test that background polling reports arrivals and departures in order"""
+        refs = sys.getrefcount(self.reader)
+        self.reader.start_polling(interval_us=1000)
+        try:
+            self.assertEqual(self.reader.get_event(timeout=0.05), None)
+
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+            arrival = self.reader.get_event(timeout=1)
+            self.assertEqual(arrival['event'], 'arrival')
+            self.assertEqual(arrival['uid'], '04112233445566')
+
+            _mifare.sim_remove_tag(slot)
+            departure = self.reader.get_event(timeout=1)
+            self.assertEqual(departure['event'], 'departure')
+            self.assertEqual(departure['uid'], '04112233445566')
+            self.assertTrue(departure['timestamp_ns'] > arrival['timestamp_ns'])
+        finally:
+            self.reader.stop_polling()
+
+        self.assertEqual(list(self.reader), [])
+        # nothing but the test holds on to a reader that polled
+        self.assertEqual(sys.getrefcount(self.reader), refs)
+
+    def test_polling_callback(self):
+        """Test that a polling callback runs on the dispatcher thread"""
+        import threading
+        received = []
+        done = threading.Event()
+
+        def callback(event):
+            received.append(event['event'])
+            done.set()
+
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.start_polling(interval_us=1000, callback=callback)
+        try:
+            self.assertTrue(done.wait(1))
+            self.assertRaises(RuntimeError, self.reader.start_polling)
+        finally:
+            self.reader.stop_polling()
+        self.assertEqual(received, ['arrival'])
+        # the tag the poller activated is the one the reader knows about
+        self.assertTrue(self.reader.is_present())
+
+    def test_polling_dropped_reader(self):
+        """Test that the exit hook stops a callback poller whose reader only the dispatcher holds"""
+        import threading
+        import nxppy
+        port = '/dev/spidev0.1'
+        done = threading.Event()
+        _mifare.sim_remove_tag(port=port)
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, port=port)
+
+        reader = nxppy.Mifare(spi=port)
+        reader.start_polling(interval_us=1000, callback=lambda event: done.set())
+        del reader
+        self.assertTrue(done.wait(1))
+        # holds the reader while its dispatcher lets go of it, then frees it
+        self.assertIsNone(_mifare._stop_all_polling())
+        self.assertIsNone(_mifare._stop_all_polling())
+
+    def test_polling_lpcd(self):
+        """Test that LPCD polling only runs full discovery when a probe sees a change"""
+        self.reader.start_polling(interval_us=1000, lpcd=True, lpcd_threshold=2)
+        try:
+            self.assertEqual(self.reader.get_event(timeout=0.05), None)
+            stats = self.reader.polling_stats()
+            self.assertTrue(stats['lpcd'])
+            self.assertTrue(stats['probes'] > 0)
+            self.assertEqual(stats['scans'], 0)
+
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'arrival')
+            _mifare.sim_remove_tag(slot)
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'departure')
+        finally:
+            self.reader.stop_polling()
+
+        stats = self.reader.polling_stats()
+        self.assertEqual(stats['wakeups'], 2)
+        self.assertEqual(stats['scans'], 2)
+        self.assertTrue(stats['last_detection_ns'] > 0)
+
+    def test_polling_lpcd_filter(self):
+        """Test that LPCD polling still scans for a second tag and for re-presents"""
+        self.reader.start_polling(interval_us=1000, lpcd=True, hold_us=300000, rearm_us=50000, max_uids=2)
+        try:
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'arrival')
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'represent')
+
+            # the probe still answers, but it is another tag
+            _mifare.sim_remove_tag(slot)
+            _mifare.sim_add_tag(_mifare.SIM_CLASSIC_1K, CLASSIC_UID)
+            event = self.reader.get_event(timeout=1)
+            while event['event'] == 'represent':
+                event = self.reader.get_event(timeout=1)
+            self.assertEqual(event['event'], 'arrival')
+            self.assertEqual(event['uid'], binascii.hexlify(CLASSIC_UID).decode().upper())
+        finally:
+            self.reader.stop_polling()
+
+    def test_polling_debounce(self):
+        """Test that the polling filter rides out read gaps and re-presents a held tag"""
+        self.reader.start_polling(interval_us=1000, hold_us=300000, rearm_us=100000)
+        try:
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'arrival')
+            self.assertEqual(self.reader.get_event(timeout=1)['event'], 'represent')
+
+            # a gap shorter than hold_us is no departure
+            _mifare.sim_remove_tag(slot)
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+            event = self.reader.get_event(timeout=1)
+            self.assertEqual((event['event'], event['uid']), ('represent', '04112233445566'))
+
+            _mifare.sim_remove_tag(slot)
+            while event['event'] == 'represent':
+                event = self.reader.get_event(timeout=1)
+            self.assertEqual(event['event'], 'departure')
+        finally:
+            self.reader.stop_polling()
+
+        self.assertTrue(self.reader.polling_stats()['suppressed'] > 0)
+        self.assertRaises(ValueError, self.reader.start_polling, max_uids=0)
+        self.assertRaises(ValueError, self.reader.start_polling, max_uids=33)
+
+    def test_select_all(self):
+        """Test that stacked tags are all resolved and can be activated in turn"""
+        uids = [b'\x04\x11\x22\x33\x44\x55\x66', b'\x04\x99\x88\x77\x66\x55\x44', CLASSIC_UID]
+        for i, uid in enumerate(uids[:2]):
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, uid)
+            _mifare.sim_write_memory(slot, 16, b'tag%d' % i)
+        _mifare.sim_add_tag(_mifare.SIM_CLASSIC_1K, uids[2])
+
+        tags = self.reader.select_all(limit=3)
+        hexuids = sorted(tag['uid'] for tag in tags)
+        self.assertEqual(hexuids, sorted(binascii.hexlify(uid).decode().upper() for uid in uids))
+
+        for i, uid in enumerate(hexuids[:2]):
+            self.assertEqual(self.reader.activate(uid), uid)
+            self.assertEqual(self.reader.get_ident()['sak'], 0x00)
+            self.assertEqual(self.reader.read_block(4), b'tag%d' % i)
+
+        self.assertEqual(len(self.reader.select_all(limit=1)), 1)
+
+    def test_select_all_empty(self):
+        """Test that an empty field resolves to no tags instead of raising"""
+        self.assertEqual(self.reader.select_all(), [])
+
+    def test_is_present(self):
+        """Test the presence check against the tag staying and leaving"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        self.assertFalse(self.reader.is_present())
+        self.reader.select()
+        self.assertTrue(self.reader.is_present())
+        self.assertTrue(self.reader.is_present())
+        # the tag is left active
+        self.assertEqual(len(self.reader.read_block(0)), 4)
+
+        _mifare.sim_remove_tag(slot)
+        self.assertFalse(self.reader.is_present())
+
+    def test_session(self):
+        """Test that select() in a session skips discovery while the tag stays"""
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        uid = self.reader.begin_session()
+        try:
+            before = _mifare.sim_stats()['rf_transactions']
+            self.assertEqual(self.reader.select(), uid)
+            # HLTA, WUPA and one SELECT per cascade level
+            self.assertEqual(_mifare.sim_stats()['rf_transactions'] - before, 4)
+
+            _mifare.sim_remove_tag()
+            slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+            self.assertNotEqual(self.reader.select(), uid)
+        finally:
+            self.reader.end_session()
+
+    def test_multiple_readers(self):
+        """Test that readers on different SPI devices see their own tags and run side by side"""
+        import threading
+        import nxppy
+        port = '/dev/spidev0.1'
+        _mifare.sim_remove_tag(port=port)
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        _mifare.sim_add_tag(_mifare.SIM_CLASSIC_1K, CLASSIC_UID, port=port)
+        second = nxppy.Mifare(spi=port)
+
+        results = {}
+
+        def select(name, reader):
+            results[name] = [reader.select() for i in range(20)]
+
+        threads = [threading.Thread(target=select, args=('first', self.reader)),
+                   threading.Thread(target=select, args=('second', second))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        self.assertEqual(results['first'], ['04112233445566'] * 20)
+        self.assertEqual(results['second'], ['12345678'] * 20)
+        self.assertTrue(_mifare.sim_stats(port=port)['rf_transactions'] > 0)
+
+    def test_page_cache(self):
+        """Test that cached pages skip the RF traffic and writes invalidate them"""
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        self.reader.select()
+        self.reader.get_version()
+        self.reader.enable_cache()
+
+        first = self.reader.read_range(4, 8)
+        before = _mifare.sim_stats()['rf_transactions']
+        self.assertEqual(self.reader.read_range(4, 8), first)
+        self.assertEqual(self.reader.read_block(5), first[4:8])
+        self.assertEqual(_mifare.sim_stats()['rf_transactions'], before)
+
+        self.reader.write_block(5, b'wxyz')
+        self.assertEqual(self.reader.read_block(5), b'wxyz')
+        stats = self.reader.cache_stats()
+        self.assertEqual((stats['hits'], stats['misses'], stats['invalidations']), (5, 5, 1))
+
+        # a full discovery may have brought back a different tag
+        self.reader.select()
+        self.assertEqual(self.reader.cache_stats()['pages'], 0)
+
+    def test_write_diff(self):
+        """Test that only changed pages are written, and the result matches write_range"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        record = b'The quick brown fox jumps over the lazy dog'
+        self.assertEqual(self.reader.write_diff(4, record), 11)
+        self.assertEqual(self.reader.write_diff(4, record), 0)
+
+        updated = record.replace(b'dog', b'cat')
+        self.assertEqual(self.reader.write_diff(4, updated), 1)
+        self.assertEqual(_mifare.sim_read_memory(slot)[16:16 + len(updated)], updated)
+
+    def test_ndef(self):
+        """Test an NDEF round trip, with multi-byte UTF-8 text across page boundaries"""
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        self.assertIsNone(self.reader.read_ndef())
+
+        text = u'gr\u00fc\u00dfe aus K\u00f6ln \u2713'
+        self.reader.write_ndef([{'text': text, 'lang': 'de'}, {'uri': u'https://www.example.com/'}])
+        self.assertEqual(_mifare.sim_read_memory(slot)[16], 0x03)
+
+        records = self.reader.read_ndef()
+        self.assertEqual(records[0]['text'], text)
+        self.assertEqual(records[0]['lang'], 'de')
+        self.assertEqual(records[1]['uri'], u'https://www.example.com/')
+        self.assertEqual(bytes(records[1]['payload']), b'\x02example.com/')
+
+        area = _mifare.ndef_encode(records)
+        self.assertEqual(_mifare.ndef_parse(area)[0]['text'], text)
+
+        # NULL padding without a message is no NDEF, a cut off NDEF TLV is an error
+        self.assertIsNone(_mifare.ndef_parse(b'\x00\x00\x00'))
+        self.assertRaises(ValueError, _mifare.ndef_parse, b'\x00\x03')
+        self.assertRaises(ValueError, _mifare.ndef_parse, bytes(area[:len(area) // 2]))
+
+    def test_stats(self):
+        """Test that operations land in the latency histograms and SPI transfers are counted"""
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.reset_stats()
+        before = _mifare.sim_stats()['spi_transfers']
+
+        self.reader.select()
+        self.reader.read_range(4, 8)
+        with self.assertRaises(_mifare.ReadError):
+            self.reader.read_block(200)
+
+        stats = self.reader.stats()
+        self.assertEqual(stats['select']['count'], 1)
+        self.assertEqual((stats['read']['count'], stats['read']['errors']), (2, 1))
+        self.assertEqual(sum(stats['read']['histogram']), 2)
+        self.assertTrue(stats['discovery_loops'] >= 1)
+        self.assertEqual(stats['spi_transfers'], _mifare.sim_stats()['spi_transfers'] - before)
+
+        self.reader.reset_stats()
+        self.assertEqual(self.reader.stats()['select']['count'], 0)
+
+    def test_spi_batching(self):
+        """Test that register writes share SPI messages, and go out one by one without a buffer"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+
+        def traffic(reader):
+            reader.reset_stats()
+            before = _mifare.sim_stats()
+            reader.select()
+            reader.read_range(4, 8)
+            after = _mifare.sim_stats()
+            stats = reader.stats()
+            # the reader counts what reached the chip, and every command it started
+            self.assertEqual(stats['spi_transfers'], after['spi_transfers'] - before['spi_transfers'])
+            self.assertEqual(stats['spi_messages'], after['spi_messages'] - before['spi_messages'])
+            self.assertEqual(stats['rf_commands'], after['rf_transactions'] - before['rf_transactions'])
+            return stats
+
+        batched = traffic(self.reader)
+        self.assertTrue(batched['spi_messages'] < batched['spi_transfers'])
+
+        unbatched = traffic(nxppy.Mifare(spi_buffer=0, spi_speed_hz=1000000))
+        self.assertEqual(unbatched['spi_messages'], unbatched['spi_transfers'])
+        self.assertTrue(batched['spi_messages'] < unbatched['spi_messages'])
+
+        self.assertRaises(ValueError, nxppy.Mifare, spi_buffer=-1)
+        self.assertRaises(ValueError, nxppy.Mifare, spi_speed_hz=20000000)
+
+    def test_irq_latency(self):
+        """Test the IRQ thread waking on edges from the pipe stand-in, and its latency"""
+        result = _mifare.sim_irq_benchmark(edges=500)
+        self.assertEqual(result['edges'], 500)
+        self.assertTrue(0 < result['handler_mean_ns'] <= result['handler_max_ns'])
+        self.assertTrue(result['handler_mean_ns'] <= result['wakeup_mean_ns'] <= result['wakeup_max_ns'])
+        self.assertRaises(ValueError, _mifare.sim_irq_benchmark, edges=0)
+
+        # the simulated chip calls the HAL directly, so there are no edges to time
+        self.assertEqual(self.reader.stats()['irq']['count'], 0)
+
+    @unittest.skipIf(sys.version_info < (3, 5), "asyncio front end needs Python 3.5")
+    def test_async(self):
+        """Test awaitable operations completing through the worker eventfd"""
+        import asyncio
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        loop = asyncio.new_event_loop()
+        if sys.version_info >= (3, 7):
+            self.assertRaises(RuntimeError, nxppy.AsyncMifare, self.reader)
+        # inside the loop, it is the running one
+        made = []
+        loop.call_soon(lambda: made.append(nxppy.AsyncMifare(self.reader)))
+        loop.run_until_complete(asyncio.sleep(0))
+        self.assertIs(made[0]._loop, loop)
+        made[0].close()
+
+        reader = nxppy.AsyncMifare(self.reader, loop=loop)
+
+        # more than the worker queue holds, so some wait in the backlog
+        futures = [reader.select()] + [reader.read_range(4, 8) for i in range(40)]
+        futures.append(reader.write_block(10, b'abcd'))
+        futures.append(reader.read_block(10))
+        results = loop.run_until_complete(asyncio.gather(*futures))
+
+        self.assertEqual(results[0], '04112233445566')
+        self.assertEqual(results[-1], b'abcd')
+        self.assertEqual(_mifare.sim_read_memory(slot)[40:44], b'abcd')
+
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_TIMEOUT)
+        with self.assertRaises(nxppy.ReadError):
+            loop.run_until_complete(reader.read_block(4))
+
+        reader.close()
+        loop.close()
+
+    def test_execute(self):
+        """Test a batch running to completion, and stopping at the first failure"""
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        outcome = self.reader.execute([
+            (nxppy.OP_SELECT,),
+            (nxppy.OP_GET_VERSION,),
+            (nxppy.OP_WRITE, 10, b'abcdefgh'),
+            (nxppy.OP_READ, 10, 12),
+        ])
+        self.assertEqual(outcome['failed'], None)
+        self.assertEqual(outcome['error'], None)
+        self.assertEqual(outcome['results'][0], '04112233445566')
+        self.assertEqual(outcome['results'][1]['tag_size'], 0x0F)
+        self.assertEqual(outcome['results'][2:], [2, b'abcdefgh'])
+        self.assertEqual(_mifare.sim_read_memory(slot)[40:48], b'abcdefgh')
+
+        _mifare.sim_inject_fault(_mifare.SIM_FAULT_TIMEOUT, skip=1)
+        outcome = self.reader.execute([(nxppy.OP_READ, 4, 5), (nxppy.OP_READ, 4, 5), (nxppy.OP_SELECT,)])
+        self.assertEqual(len(outcome['results']), 1)
+        self.assertEqual(outcome['failed'], 1)
+        self.assertTrue(isinstance(outcome['error'], nxppy.ReadError))
+        self.assertEqual(outcome['error'].code, _mifare.ERR_IO_TIMEOUT)
+
+        # bad operations are refused before anything runs
+        self.assertRaises(ValueError, self.reader.execute, [(nxppy.OP_SELECT,), (99,)])
+        self.assertRaises(nxppy.ReadError, self.reader.execute, [(nxppy.OP_READ, 5, 4)])
+
+    def test_classic(self):
+        """Test MIFARE Classic block access, the key search and the per-sector key cache"""
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_CLASSIC_1K, CLASSIC_UID)
+        self.reader.select()
+
+        # key A is wrong, so the sector is opened with the second candidate
+        self.reader.set_classic_keys([(nxppy.KEY_A, b'\xa0\xa1\xa2\xa3\xa4\xa5'), (nxppy.KEY_B, b'\xff' * 6)])
+        self.reader.classic_write_block(5, b'0123456789abcdef')
+        self.assertEqual(self.reader.classic_read_block(5), b'0123456789abcdef')
+        self.assertEqual(self.reader.classic_read_sector(1)[16:32], b'0123456789abcdef')
+        self.assertEqual(_mifare.sim_read_memory(slot)[80:96], b'0123456789abcdef')
+        stats = self.reader.classic_key_stats()
+        self.assertEqual((stats['misses'], stats['session_hits'], stats['authentications']), (1, 2, 2))
+
+        # a new selection ends the session, the remembered key B goes straight in
+        self.reader.select()
+        self.reader.classic_read_block(4)
+        stats = self.reader.classic_key_stats()
+        self.assertEqual((stats['hits'], stats['authentications']), (1, 3))
+        self.assertEqual(self.reader.stats()['auth']['errors'], 1)
+
+        # key B changed on the tag: the remembered key fails once and is not tried again as a candidate
+        _mifare.sim_write_memory(slot, 7 * 16 + 10, b'\xb0' * 6)
+        self.reader.select()
+        self.assertRaises(nxppy.ReadError, self.reader.classic_read_block, 4)
+        self.assertEqual(self.reader.classic_key_stats()['authentications'], 5)
+        _mifare.sim_write_memory(slot, 7 * 16 + 10, b'\xff' * 6)
+        self.assertRaises(ValueError, self.reader.set_classic_keys, [])
+
+        self.assertRaises(nxppy.WriteError, self.reader.classic_write_block, 7, b'\0' * 16)
+        self.reader.set_classic_keys([(nxppy.KEY_A, b'\0' * 6)])
+        self.assertRaises(nxppy.ReadError, self.reader.classic_read_block, 8)
+        # and the tag was woken up again afterwards
+        self.assertTrue(self.reader.is_present())
+
+    def test_iso_dep(self):
+        """Test APDUs to an ISO14443-4 tag, chained in both directions"""
+        import nxppy
+        slot = _mifare.sim_add_tag(_mifare.SIM_TYPE4)
+        self.reader.select()
+        select = b'\x00\xa4\x04\x00\x07\xd2\x76\x00\x00\x85\x01\x01\x00'
+        self.assertEqual(self.reader.transceive_apdu(select), b'\x90\x00')
+        params = self.reader.get_iso_dep()
+        self.assertEqual((params['fsd'], params['fsc']), (256, 64))
+
+        # longer than the FSC of 64 going out, answers chained coming back
+        data = bytes(bytearray(range(200)))
+        self.assertEqual(self.reader.transceive_apdu(b'\x00\xd6\x00\x10\xc8' + data), b'\x90\x00')
+        answers = self.reader.transceive_apdus([b'\x00\xb0\x00\x10\xc8', b'\x00\xb0\x00\x00\x00'])
+        self.assertEqual(answers[0], data + b'\x90\x00')
+        self.assertEqual(len(answers[1]), 258)
+        self.assertEqual(_mifare.sim_read_memory(slot)[16:216], data)
+        self.assertEqual(self.reader.transceive_apdu(b'\x00\xb0\x03\xf0\x20'), b'\x6b\x00')
+        self.assertEqual(self.reader.stats()['apdu']['count'], 5)
+
+        _mifare.sim_remove_tag()
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213)
+        self.reader.select()
+        self.assertEqual(self.reader.get_iso_dep(), None)
+        self.assertRaises(nxppy.ReadError, self.reader.transceive_apdu, select)
+
+    def test_bitrate(self):
+        """Test PPS to the fastest bit rate tag and reader share, and capping it"""
+        _mifare.sim_add_tag(_mifare.SIM_TYPE4)
+        self.reader.select()
+        read = b'\x00\xb0\x00\x00\x00'
+        self.assertEqual(len(self.reader.transceive_apdu(read)), 258)
+        params = self.reader.get_iso_dep()
+        self.assertEqual((params['tx_bitrate'], params['rx_bitrate']), (848, 848))
+
+        # waking the tag deselects it, back to 106 kbit/s until the next RATS
+        self.reader.set_max_bitrate(212)
+        self.assertTrue(self.reader.is_present())
+        self.assertEqual(len(self.reader.transceive_apdu(read)), 258)
+        params = self.reader.get_iso_dep()
+        self.assertEqual((params['tx_bitrate'], params['rx_bitrate']), (212, 212))
+
+        self.assertRaises(ValueError, self.reader.set_max_bitrate, 300)
+
+    def test_discovery_profile(self):
+        """Test changing the discovery profile on a live reader, and its validation"""
+        import nxppy
+        _mifare.sim_add_tag(_mifare.SIM_NTAG213, NTAG_UID)
+        profile = self.reader.configure_discovery()
+        self.assertEqual((profile['tech'], profile['guard_a_us']), (nxppy.TECH_A, 5100))
+
+        profile = self.reader.configure_discovery(tech=nxppy.TECH_A | nxppy.TECH_B, guard_a_us=1000,
+                                                  field_off_us=500)
+        self.assertEqual((profile['tech'], profile['bail_out'], profile['guard_a_us']),
+                         (nxppy.TECH_A | nxppy.TECH_B, nxppy.TECH_A, 1000))
+        self.assertEqual(self.reader.select(), '04112233445566')
+
+        # a bad setting leaves the profile alone
+        self.assertRaises(ValueError, self.reader.configure_discovery, tech=nxppy.TECH_V)
+        self.assertRaises(ValueError, self.reader.configure_discovery, bail_out=nxppy.TECH_A, tech=nxppy.TECH_B)
+        self.assertRaises(ValueError, self.reader.configure_discovery, device_limit=0)
+        self.assertRaises(ValueError, self.reader.configure_discovery, guard_a_us=0)
+        self.assertRaises(TypeError, self.reader.configure_discovery, guard_time=1)
+        self.assertEqual(self.reader.configure_discovery()['guard_a_us'], 1000)
+
+        # the simulator only has Type A tags
+        self.assertEqual(self.reader.configure_discovery(tech=nxppy.TECH_B)['bail_out'], 0)
+        self.assertEqual(self.reader.select(raise_on_absent=False), None)
+
+        reader = nxppy.Mifare(profile={'device_limit': 2})
+        self.assertEqual(reader.configure_discovery()['device_limit'], 2)
+        self.assertRaises(ValueError, nxppy.Mifare, profile={'mode': 7})